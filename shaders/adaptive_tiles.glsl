@@ -0,0 +1,48 @@
+#version 430 core
+
+// Builds the list of the tiles that still need samples, one work group per tile
+// The path tracers render the listed tiles as ranges of work groups, the count is read back by AdaptiveSampler
+// without waiting for the GPU, so the dispatches are sized from the list of the previous pass
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(rgba32f, binding = 0) uniform readonly image2D imgOutput;
+layout(rgba32f, binding = 2) uniform readonly image2D varianceImage;
+
+layout(std430, binding = 2) buffer TileList {
+    uint listedTiles; // reset to 0 before the dispatch
+    uint tiles[];
+};
+
+uniform int width;
+uniform int height;
+
+uniform int minSamples;
+uniform float errorThreshold;
+
+shared bool tileActive;
+
+void main() {
+    if (gl_LocalInvocationIndex == 0u) tileActive = false;
+    barrier();
+
+    ivec2 pixelCoord = ivec2(gl_GlobalInvocationID.xy);
+
+    if (pixelCoord.x < width && pixelCoord.y < height) {
+        float sampleCount = imageLoad(imgOutput, pixelCoord).w;
+        vec2 moments = imageLoad(varianceImage, pixelCoord).xy;
+
+        // Standard error of the pixel mean, relative to its luminance (dark pixels use an absolute error)
+        float variance = moments.y / max(sampleCount - 1.0, 1.0);
+        float error = sqrt(variance / max(sampleCount, 1.0)) / max(moments.x, 0.1);
+
+        if (sampleCount < float(minSamples) || error > errorThreshold) tileActive = true;
+    }
+
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0u && tileActive) {
+        uint idx = atomicAdd(listedTiles, 1u);
+        tiles[idx] = gl_WorkGroupID.x | (gl_WorkGroupID.y << 16);
+    }
+}
@@ -0,0 +1,50 @@
+#version 430 core
+
+// Guide buffers of the denoiser: albedo, normal and distance of the first hit, averaged over AOV_SAMPLES
+// jittered camera rays per pixel so that they are antialiased like the path traced image
+// Computed once per camera, when the accumulation restarts or is reprojected
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(rgba32f, binding = 3) uniform writeonly image2D albedoImage;      // rgb: albedo, a: fraction of rays that hit
+layout(rgba32f, binding = 4) uniform writeonly image2D normalDepthImage; // xyz: normal, w: distance (0 when nothing is hit)
+
+#define AOV_SAMPLES 4
+
+#include "scene.glsl"
+#include "sampler.glsl"
+
+void main() {
+    ivec2 pixelCoord = ivec2(gl_GlobalInvocationID.xy);
+    if (pixelCoord.x >= width || pixelCoord.y >= height) return;
+
+    float aspect = float(width) / float(height);
+
+    vec3 albedo = vec3(0.0);
+    vec3 normal = vec3(0.0);
+    float dist = 0.0;
+    float hits = 0.0;
+
+    for (int s = 0; s < AOV_SAMPLES; s++) {
+        // Same jitter as the first samples of the path tracer
+        Sampler sampler = initSampler(pixelCoord, s);
+        vec2 jitter = sample4D(sampler, 0u).xy;
+
+        vec3 rayDirection = getCameraRay(45.0, aspect, (vec2(pixelCoord) + jitter) / vec2(width, height));
+        rayDirection = normalize((vec4(rayDirection, 1.0) * viewMatrix).xyz);
+
+        HitInfo hitInfo = sendRay(cameraPosition, rayDirection);
+        if (!hitInfo.hasHit) continue;
+
+        // Reflectance of the surface for the path tracer: mirrors reflect white
+        albedo += mix(hitInfo.mat.color, vec3(1.0), hitInfo.mat.reflexivity);
+        normal += hitInfo.normal;
+        dist += hitInfo.dist;
+        hits += 1.0;
+    }
+
+    // Missed rays count as black albedo, normal and distance are averaged over the hits only
+    float invHits = hits > 0.0 ? 1.0 / hits : 0.0;
+    imageStore(albedoImage, pixelCoord, vec4(albedo / float(AOV_SAMPLES), hits / float(AOV_SAMPLES)));
+    imageStore(normalDepthImage, pixelCoord, vec4(normal * invHits, dist * invHits));
+}
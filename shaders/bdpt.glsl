@@ -0,0 +1,465 @@
+// Bidirectional path tracing (Veach 1997, with the structure of PBRT v3), included by compute_shader_bdpt.glsl
+// after path_tracer.glsl. A sample traces a camera subpath and a light subpath, then connects every prefix of one to
+// every prefix of the other: the strategy (s, t) uses s light vertices and t camera vertices, and the strategies of a
+// path are weighted by the balance heuristic. src/ReferenceRenderer.cpp runs the same integrator on the CPU
+//
+// The BSDF is the mix of the path tracer lobes: the diffuse lobe with probability 1 - reflexivity, the glossy lobe
+// normalize(mix(diffuseDir, specularDir, smoothness)) otherwise, whose f * cos is its pdf (sampling weight of 1)
+// A glossy lobe with smoothness > 0.99 is a mirror, drawn with a weight of 1 and never reached by a connection
+// The light subpaths start on the emissive spheres, tores and triangles: the environment map and the sky are only
+// reached by the camera subpaths that leave the scene, their only strategy
+// The light tracing strategies (t = 1) reach any pixel, they are added to the light splats of the pass, which the
+// pixels add to their samples of the next pass (LightSplats)
+
+#define BDPT_MAX_DEPTH 8 // bounces of the paths (segments - 1), bounds the vertex arrays of each invocation
+
+#define BDPT_CAMERA 0
+#define BDPT_LIGHT 1
+#define BDPT_SURFACE 2
+
+// RGB of each pixel in fixed point, written by the pass and by the previous one, swapped by LightSplats
+layout(std430, binding = 18) buffer LightSplats {
+    uint lightSplats[];
+};
+
+layout(std430, binding = 19) readonly buffer PreviousLightSplats {
+    uint previousLightSplats[];
+};
+
+uniform bool splatHistory; // previousLightSplats match the image size, the camera and the scene
+
+#define SPLAT_SCALE 4096.0
+#define SPLAT_MAX 16384.0 // a pixel takes at least 64 splats before its sum can wrap
+
+struct BdptVertex {
+    vec3 position;   // moved off the surface along the normal, like HitInfo.nextOrigin
+    int type;
+    vec3 normal;     // unused for the camera
+    float pdfFwd;    // area density of the vertex, drawn by its own subpath
+    vec3 beta;       // throughput of the subpath up to the vertex, the emission for a light vertex
+    float pdfRev;    // area density of the vertex drawn from the other end of the path
+    int objType;     // hit of the vertex, for its material and its area as an emitter
+    int objIdx;
+    int triangleIdx;
+    bool delta;      // the direction leaving the vertex comes from a mirror
+};
+
+BdptVertex cameraVertices[BDPT_MAX_DEPTH + 2];
+BdptVertex lightVertices[BDPT_MAX_DEPTH + 1];
+
+const float cameraFocalLength = 2.41421356237; // 1 / tan(22.5 degrees), getCameraRay with a 45 degrees field of view
+
+// Density of the camera directions, uniform on the image plane at distance 1, and the pixel position of direction
+// 0 outside the image
+float cameraDirectionPdf(vec3 direction, out vec2 raster){
+    vec3 local = mat3(viewMatrix) * direction;
+    if (local.z >= 0.0) return 0.0;
+
+    float aspect = float(width) / float(height);
+    vec2 pos = local.xy / -local.z * cameraFocalLength / vec2(aspect, 1.0);
+    if (abs(pos.x) >= 1.0 || abs(pos.y) >= 1.0) return 0.0;
+    raster = (pos * 0.5 + 0.5) * vec2(width, height);
+
+    float filmArea = 4.0 * aspect / (cameraFocalLength * cameraFocalLength);
+    float cosTheta = -local.z;
+    return 1.0 / (filmArea * cosTheta * cosTheta * cosTheta);
+}
+
+// f of the lobes a connection can reach, toCamera and toLight leave the vertex toward the two ends of the path
+vec3 bdptBsdf(Material mat, vec3 normal, vec3 toCamera, vec3 toLight){
+    float cosLight = dot(toLight, normal);
+    if (cosLight <= 0.0 || dot(toCamera, normal) <= 0.0) return vec3(0.0);
+
+    vec3 f = (1.0 - mat.reflexivity) * mat.color / PI;
+    if (mat.smoothness <= 0.99) f += mat.reflexivity * glossyPdf(toLight, normal, reflect(-toCamera, normal), mat.smoothness) / cosLight;
+    return f;
+}
+
+// Solid angle density of next drawn at a vertex reached from prev, both leaving the vertex, without the mirrors
+// The light subpaths draw their directions like the camera subpaths, so it serves both
+float bdptDirectionPdf(Material mat, vec3 normal, vec3 prev, vec3 next){
+    float cosNext = dot(next, normal);
+    if (cosNext <= 0.0) return 0.0;
+
+    float pdf = (1.0 - mat.reflexivity) * cosNext / PI;
+    if (mat.smoothness <= 0.99) pdf += mat.reflexivity * glossyPdf(next, normal, reflect(-prev, normal), mat.smoothness);
+    return pdf;
+}
+
+// Solid angle density at from converted to an area density at the vertex to
+float bdptConvertDensity(float pdf, vec3 from, BdptVertex to){
+    vec3 d = to.position - from;
+    float dist2 = dot(d, d);
+    if (dist2 <= 0.0) return 0.0;
+    if (to.type != BDPT_CAMERA) pdf *= abs(dot(to.normal, d)) * inversesqrt(dist2);
+    return pdf / dist2;
+}
+
+// Emitters the light subpaths start from: the light list without the environment map, which is its last light
+int bdptEmitterCount(){
+    return lightCount - int(useEnvironmentMap);
+}
+
+// Area density of the origin of the light subpaths at the emitter vertex v
+float bdptLightOriginPdf(BdptVertex v){
+    float pmf = 1.0 / float(bdptEmitterCount());
+
+    if (v.objType == 0) {
+        float r = spheres[v.objIdx].r;
+        return pmf / (4.0 * PI * r * r);
+    }
+    if (v.objType == 1) {  // uniform angles around the axis and around the tube, like sampleLightPoint
+        Tore tore = tores[v.objIdx];
+        float rho = max(length(v.position.xy - tore.pos.xy), 1e-4);
+        return pmf / (4.0 * PI * PI * tore.r * rho);
+    }
+
+    TriangleMesh mesh = triangleMeshes[v.objIdx];
+    Triangle tri = triangles[v.triangleIdx];
+    float area = 0.5 * length(cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+    return pmf / (float(mesh.endIdx - mesh.startIdx) * area);
+}
+
+// Area density of next on the cosine distributed emission of the emitter vertex v
+float bdptLightPdf(BdptVertex v, BdptVertex next){
+    vec3 toNext = normalize(next.position - v.position);
+    return bdptConvertDensity(max(dot(toNext, v.normal), 0.0) / PI, v.position, next);
+}
+
+// Area density of next drawn from the vertex v reached from prev (unused for the endpoints)
+float bdptPdf(BdptVertex v, BdptVertex prev, BdptVertex next){
+    if (v.type == BDPT_LIGHT) return bdptLightPdf(v, next);
+
+    vec3 toNext = normalize(next.position - v.position);
+    float pdf;
+    if (v.type == BDPT_CAMERA) {
+        vec2 raster;
+        pdf = cameraDirectionPdf(toNext, raster);
+    } else {
+        pdf = bdptDirectionPdf(getMaterial(v.objType, v.objIdx), v.normal, normalize(prev.position - v.position), toNext);
+    }
+    return bdptConvertDensity(pdf, v.position, next);
+}
+
+BdptVertex getVertex(bool isCamera, int i){
+    return isCamera ? cameraVertices[i] : lightVertices[i];
+}
+
+void setVertex(bool isCamera, int i, BdptVertex v){
+    if (isCamera) cameraVertices[i] = v;
+    else lightVertices[i] = v;
+}
+
+// Nothing between the two points, each one moved off its surface
+bool bdptVisible(vec3 from, vec3 to){
+    vec3 d = to - from;
+    float dist = length(d);
+    HitInfo hitInfo = sendRay(from, d / dist);
+    return !hitInfo.hasHit || hitInfo.dist > dist * 0.999 - 1e-3;
+}
+
+// Extends the camera or light subpath of count vertices up to maxCount, from a ray of density pdf and throughput beta
+// The directions come from the 4D patterns from dimension on. The camera rays that leave the scene add the ambient
+// light to escaped. Returns the vertex count
+int bdptRandomWalk(inout Sampler sampler, uint dimension, bool isCamera, int count, int maxCount, vec3 origin, vec3 direction,
+                   vec3 beta, float pdf, inout vec3 escaped){
+    while (count < maxCount) {
+        HitInfo hitInfo = sendRay(origin, direction);
+        if (!hitInfo.hasHit) {
+            if (isCamera) escaped += beta * getAmbientLight(direction);
+            break;
+        }
+        // The triangles are one-sided: a light ray also stops on the back faces that the camera ray going the other
+        // way would hit
+        if (!isCamera && !bdptVisible(hitInfo.nextOrigin, origin)) break;
+
+        BdptVertex prev = getVertex(isCamera, count - 1);
+
+        BdptVertex v;
+        v.position = hitInfo.nextOrigin;
+        v.type = BDPT_SURFACE;
+        v.normal = hitInfo.normal;
+        v.beta = beta;
+        v.pdfFwd = bdptConvertDensity(pdf, prev.position, v);
+        v.pdfRev = 0.0;
+        v.objType = hitInfo.objType;
+        v.objIdx = hitInfo.objIdx;
+        v.triangleIdx = hitInfo.triangleIdx;
+        v.delta = false;
+
+        count++;
+        if (count == maxCount) {
+            setVertex(isCamera, count - 1, v);
+            break;
+        }
+
+        // Next direction, drawn like the path tracer does
+        vec4 u = sample4D(sampler, dimension++);
+        Material mat = hitInfo.mat;
+        vec3 toPrev = -direction;
+        vec3 diffuseDir = cosineHemisphere(u.xy, v.normal);
+        vec3 specularDir = reflect(direction, v.normal);
+        int isReflexive = int(mat.reflexivity > u.z);
+        direction = normalize(mix(diffuseDir, specularDir, mat.smoothness * isReflexive));
+
+        float pdfRev;
+        if (isReflexive == 1 && mat.smoothness > 0.99) {
+            v.delta = true;
+            pdf = 0.0;
+            pdfRev = 0.0;
+        } else {
+            pdf = bdptDirectionPdf(mat, v.normal, toPrev, direction);
+            pdfRev = bdptDirectionPdf(mat, v.normal, direction, toPrev);
+            vec3 f = isCamera ? bdptBsdf(mat, v.normal, toPrev, direction) : bdptBsdf(mat, v.normal, direction, toPrev);
+            beta *= pdf > 0.0 ? f * abs(dot(direction, v.normal)) / pdf : vec3(0.0);
+        }
+
+        prev.pdfRev = bdptConvertDensity(pdfRev, v.position, prev);
+        setVertex(isCamera, count - 2, prev);
+        setVertex(isCamera, count - 1, v);
+
+        if (max(beta.x, max(beta.y, beta.z)) <= 0.0) break;
+        origin = v.position;
+    }
+    return count;
+}
+
+// Camera ray through the pixel, jittered like startPath, and its random walk
+int bdptCameraSubpath(inout Sampler sampler, ivec2 pixelCoord, int maxCount, inout vec3 escaped){
+    float aspect = float(width) / float(height);
+    vec2 jitter = sample4D(sampler, 0u).xy;
+    vec3 rayDirection = getCameraRay(45.0, aspect, (vec2(pixelCoord) + jitter) / vec2(width, height));
+    rayDirection = normalize((vec4(rayDirection, 1.0) * viewMatrix).xyz);
+
+    BdptVertex camera;
+    camera.position = cameraPosition;
+    camera.type = BDPT_CAMERA;
+    camera.normal = vec3(0.0);
+    camera.beta = vec3(1.0);
+    camera.pdfFwd = 1.0;
+    camera.pdfRev = 0.0;
+    camera.delta = false;
+    cameraVertices[0] = camera;
+
+    vec2 raster;
+    float pdf = cameraDirectionPdf(rayDirection, raster);
+    return bdptRandomWalk(sampler, 1u, true, 1, maxCount, cameraPosition, rayDirection, vec3(1.0), pdf, escaped);
+}
+
+// Point on an emitter picked uniformly in the light list (the triangles of a mesh uniformly too), uniform angles for
+// the tores like sampleLightPoint, uniform on the area otherwise, then a cosine distributed direction
+int bdptLightSubpath(inout Sampler sampler, uint dimension, int maxCount){
+    int emitterCount = bdptEmitterCount();
+    if (emitterCount <= 0) return 0;
+
+    vec4 u = sample4D(sampler, dimension);
+    vec4 w = sample4D(sampler, dimension + 1u);
+    int l = min(int(u.x * float(emitterCount)), emitterCount - 1);
+
+    BdptVertex light;
+    light.type = BDPT_LIGHT;
+    light.objType = lights[l].type;
+    light.objIdx = lights[l].idx;
+    light.triangleIdx = -1;
+    light.pdfRev = 0.0;
+    light.delta = false;
+
+    Material mat = getMaterial(light.objType, light.objIdx);
+    vec3 position;
+
+    if (light.objType == 0) {
+        Sphere sphere = spheres[light.objIdx];
+        float z = 1.0 - 2.0 * u.y;
+        float r = sqrt(max(0.0, 1.0 - z * z));
+        light.normal = vec3(r * cos(2.0 * PI * u.z), r * sin(2.0 * PI * u.z), z);
+        position = sphere.pos + sphere.r * light.normal;
+    } else if (light.objType == 1) {
+        Tore tore = tores[light.objIdx];
+        float theta = 2.0 * PI * u.y;
+        float phi = 2.0 * PI * u.z;
+        float rho = tore.R + tore.r * cos(phi);
+        light.normal = vec3(cos(phi) * cos(theta), cos(phi) * sin(theta), sin(phi));
+        position = tore.pos + vec3(rho * cos(theta), rho * sin(theta), tore.r * sin(phi));
+    } else {
+        TriangleMesh mesh = triangleMeshes[light.objIdx];
+        int triCount = mesh.endIdx - mesh.startIdx;
+        light.triangleIdx = mesh.startIdx + min(int(u.w * float(triCount)), triCount - 1);
+
+        Triangle tri = triangles[light.triangleIdx];
+        float su = sqrt(u.y);
+        float b1 = u.z * su;
+        position = (1.0 - su) * tri.v0 + b1 * tri.v1 + (su - b1) * tri.v2;
+        light.normal = tri.normal;
+    }
+
+    light.position = position + light.normal * 0.001;
+    light.beta = mat.emissionColor * mat.emissionStrength;
+    light.pdfFwd = bdptLightOriginPdf(light);
+    lightVertices[0] = light;
+    if (maxCount == 1) return 1;
+
+    // Le cos / (pdfPos pdfDir), the cosine cancels out
+    vec3 direction = cosineHemisphere(w.xy, light.normal);
+    float pdfDir = max(dot(direction, light.normal), 0.0) / PI;
+    vec3 beta = light.beta * PI / light.pdfFwd;
+
+    vec3 unused = vec3(0.0);
+    return bdptRandomWalk(sampler, dimension + 2u, false, 1, maxCount, light.position, direction, beta, pdfDir, unused);
+}
+
+float remap0(float pdf){
+    return pdf != 0.0 ? pdf : 1.0;
+}
+
+// Balance heuristic of the strategy (s, t) against the other strategies of the same path (PBRT's MISWeight), from the
+// ratios of the densities of each vertex drawn from either end. sampled is the vertex drawn by the connection when
+// s == 1 or t == 1. The endpoints of the connection and their neighbors get the densities of this path, the subpaths
+// themselves are left as they are for the other strategies
+float bdptMisWeight(int s, int t, BdptVertex sampled){
+    if (s + t == 2) return 1.0;
+
+    BdptVertex pt = t == 1 ? sampled : cameraVertices[t - 1];
+    BdptVertex qs;
+    if (s > 0) qs = s == 1 ? sampled : lightVertices[s - 1];
+
+    // Densities of the connection endpoints and of their neighbors, drawn from the other end
+    float ptPdfRev = s > 0 ? bdptPdf(qs, s > 1 ? lightVertices[s - 2] : qs, pt) : bdptLightOriginPdf(pt);
+    float ptMinusPdfRev = 0.0;
+    if (t > 1) ptMinusPdfRev = s > 0 ? bdptPdf(pt, qs, cameraVertices[t - 2]) : bdptLightPdf(pt, cameraVertices[t - 2]);
+    float qsPdfRev = 0.0;
+    float qsMinusPdfRev = 0.0;
+    if (s > 0) qsPdfRev = bdptPdf(pt, t > 1 ? cameraVertices[t - 2] : pt, qs);
+    if (s > 1) qsMinusPdfRev = bdptPdf(qs, pt, lightVertices[s - 2]);
+
+    // Ratios of the other strategies to this one, the strategies connecting a delta vertex do not exist. The
+    // endpoints of the connection are not deltas, for this strategy
+    float sumRi = 0.0;
+    float ri = 1.0;
+    for (int i = t - 1; i > 0; i--) {
+        float pdfRev = i == t - 1 ? ptPdfRev : (i == t - 2 ? ptMinusPdfRev : cameraVertices[i].pdfRev);
+        ri *= remap0(pdfRev) / remap0(cameraVertices[i].pdfFwd);
+        if ((i == t - 1 || !cameraVertices[i].delta) && !cameraVertices[i - 1].delta) sumRi += ri;
+    }
+
+    ri = 1.0;
+    for (int i = s - 1; i >= 0; i--) {
+        float pdfRev = i == s - 1 ? qsPdfRev : (i == s - 2 ? qsMinusPdfRev : lightVertices[i].pdfRev);
+        float pdfFwd = i == s - 1 ? qs.pdfFwd : lightVertices[i].pdfFwd;
+        ri *= remap0(pdfRev) / remap0(pdfFwd);
+        if ((i == s - 1 || !lightVertices[i].delta) && (i == 0 || !lightVertices[i - 1].delta)) sumRi += ri;
+    }
+
+    return 1.0 / (1.0 + sumRi);
+}
+
+// Adds a light tracing contribution to the pixel it reaches, divided by the spp light subpaths of each pixel
+void splatLight(vec2 raster, vec3 contribution){
+    ivec2 pixel = clamp(ivec2(raster), ivec2(0), ivec2(width, height) - 1);
+    uint base = uint(3 * (pixel.y * width + pixel.x));
+    uvec3 fixedPoint = uvec3(min(contribution / float(spp), vec3(SPLAT_MAX)) * SPLAT_SCALE + 0.5);
+    for (int c = 0; c < 3; c++) {
+        if (fixedPoint[c] > 0u) atomicAdd(lightSplats[base + uint(c)], fixedPoint[c]);
+    }
+}
+
+// Light tracing contributions of the previous pass at the pixel, already divided by its spp
+vec3 loadPreviousSplats(ivec2 pixelCoord){
+    uint base = uint(3 * (pixelCoord.y * width + pixelCoord.x));
+    return vec3(previousLightSplats[base], previousLightSplats[base + 1u], previousLightSplats[base + 2u]) / SPLAT_SCALE;
+}
+
+// Contribution of the strategy (s, t), weighted. Light tracing (t = 1) splats its contribution and returns 0
+vec3 bdptConnect(inout Sampler sampler, int s, int t){
+    BdptVertex pt = cameraVertices[t - 1];
+    BdptVertex sampled;
+    vec3 L = vec3(0.0);
+    vec2 raster;
+
+    if (s == 0) {  // the camera subpath reached an emitter
+        if (pt.type != BDPT_SURFACE) return vec3(0.0);
+        Material mat = getMaterial(pt.objType, pt.objIdx);
+        if (mat.emissionStrength <= 0.0 || dot(cameraVertices[t - 2].position - pt.position, pt.normal) <= 0.0) return vec3(0.0);
+        L = pt.beta * mat.emissionColor * mat.emissionStrength;
+
+    } else if (t == 1) {  // the light vertex is seen by the camera
+        BdptVertex qs = lightVertices[s - 1];
+        vec3 toCamera = cameraPosition - qs.position;
+        float dist2 = dot(toCamera, toCamera);
+        toCamera *= inversesqrt(dist2);
+
+        // We cos / dist^2 of a pinhole, We being 1 / (filmArea cos^4)
+        float pdf = cameraDirectionPdf(-toCamera, raster);
+        if (pdf <= 0.0) return vec3(0.0);
+
+        Material mat = getMaterial(qs.objType, qs.objIdx);
+        vec3 toLight = normalize(lightVertices[s - 2].position - qs.position);
+        L = qs.beta * bdptBsdf(mat, qs.normal, toCamera, toLight) * abs(dot(toCamera, qs.normal)) * pdf / dist2;
+
+        sampled = cameraVertices[0];
+        sampled.beta = vec3(pdf / dist2);
+        if (max(L.x, max(L.y, L.z)) <= 0.0 || !bdptVisible(cameraPosition, qs.position)) return vec3(0.0);
+
+    } else if (s == 1) {  // light sample, like the next event estimation of the path tracer
+        vec4 u = sample4D(sampler, uint(40 + t));
+        LightPoint light;
+        if (!sampleLightPoint(pt.position, pt.normal, u.xyz, light) || light.type == 3) return vec3(0.0);
+
+        sampled.position = light.position + light.normal * 0.001;
+        sampled.type = BDPT_LIGHT;
+        sampled.normal = light.normal;
+        sampled.beta = light.emission / light.pdf;
+        sampled.pdfRev = 0.0;
+        sampled.objType = light.type;
+        sampled.objIdx = light.idx;
+        sampled.triangleIdx = light.triangleIdx;
+        sampled.delta = false;
+        sampled.pdfFwd = bdptLightOriginPdf(sampled);
+
+        Material mat = getMaterial(pt.objType, pt.objIdx);
+        vec3 toCamera = normalize(cameraVertices[t - 2].position - pt.position);
+        L = pt.beta * bdptBsdf(mat, pt.normal, toCamera, light.direction) * abs(dot(light.direction, pt.normal)) * sampled.beta;
+        if (max(L.x, max(L.y, L.z)) <= 0.0 || !bdptVisible(pt.position, sampled.position)) return vec3(0.0);
+
+    } else {  // connection of two surface vertices
+        BdptVertex qs = lightVertices[s - 1];
+        vec3 d = pt.position - qs.position;
+        float dist2 = dot(d, d);
+        d *= inversesqrt(dist2);
+
+        Material qsMat = getMaterial(qs.objType, qs.objIdx);
+        Material ptMat = getMaterial(pt.objType, pt.objIdx);
+        vec3 qsF = bdptBsdf(qsMat, qs.normal, d, normalize(lightVertices[s - 2].position - qs.position));
+        vec3 ptF = bdptBsdf(ptMat, pt.normal, normalize(cameraVertices[t - 2].position - pt.position), -d);
+
+        float G = abs(dot(qs.normal, d)) * abs(dot(pt.normal, d)) / dist2;
+        L = qs.beta * qsF * ptF * pt.beta * G;
+        if (max(L.x, max(L.y, L.z)) <= 0.0 || !bdptVisible(pt.position, qs.position)) return vec3(0.0);
+    }
+
+    L *= bdptMisWeight(s, t, sampled);
+    if (t == 1) {
+        splatLight(raster, L);
+        return vec3(0.0);
+    }
+    return L;
+}
+
+// Radiance of one BDPT sample of the pixel, without its light tracing strategies which are splatted
+// Paths are at most maxBounces segments long like the ones of the path tracer (depth maxBounces - 1), within BDPT_MAX_DEPTH
+vec3 bdptSample(ivec2 pixelCoord, int sampleIndex){
+    Sampler sampler = initSampler(pixelCoord, sampleIndex);
+    int maxDepth = min(maxBounces - 1, BDPT_MAX_DEPTH);
+
+    vec3 L = vec3(0.0);
+    int cameraCount = bdptCameraSubpath(sampler, pixelCoord, maxDepth + 2, L);
+    int lightCount = bdptLightSubpath(sampler, 16u, maxDepth + 1);
+
+    for (int t = 1; t <= cameraCount; t++) {
+        for (int s = 0; s <= lightCount; s++) {
+            int depth = s + t - 2;
+            if ((s == 1 && t == 1) || depth < 0 || depth > maxDepth) continue;
+            L += bdptConnect(sampler, s, t);
+        }
+    }
+    return L;
+}
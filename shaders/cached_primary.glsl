@@ -0,0 +1,26 @@
+// Primary hit cache, included after scene.glsl by the path tracers and primary_cache.glsl
+// While the camera holds still, the first hits of the camera rays of the first primaryCacheStrata sample indices of
+// every pixel are traced once (PrimaryCache); sample n goes through the jitter of sample n % primaryCacheStrata and
+// starts at its cached hit, the paths only trace their bounces
+
+// x: distance bits, y: hit type + 1 (0 for a miss) | object << 2 | triangle << 6
+layout(rg32ui, binding = 3) uniform uimage2DArray primaryCache;
+
+uniform bool usePrimaryCache;
+uniform int primaryCacheStrata;
+
+uvec2 packCachedHit(HitInfo hitInfo) {
+    if (!hitInfo.hasHit) return uvec2(0u);
+    uint id = uint(hitInfo.objType + 1) | (uint(hitInfo.objIdx) << 2);
+    if (hitInfo.objType == 2) id |= uint(hitInfo.triangleIdx) << 6;
+    return uvec2(floatBitsToUint(hitInfo.dist), id);
+}
+
+// Same hit as sendRay for the camera ray of the cached sample
+HitInfo loadCachedHit(vec3 origin, vec3 direction, ivec2 pixelCoord, int sampleIndex) {
+    uvec2 cached = imageLoad(primaryCache, ivec3(pixelCoord, sampleIndex % primaryCacheStrata)).xy;
+    int hitType = int(cached.y & 3u) - 1;
+    int objIdx = int((cached.y >> 2) & 15u);
+    int triangleIdx = int(cached.y >> 6);
+    return getHitInfo(origin, direction, uintBitsToFloat(cached.x), objIdx, hitType, triangleIdx);
+}
@@ -0,0 +1,43 @@
+#version 430 core
+
+// Bidirectional variant of compute_shader.glsl (shaders/bdpt.glsl): the pixels of a pass all trace their light
+// subpaths, so the passes always cover the whole image
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+// Tiles are dispatched as a range of work groups, tileOffset being the first one
+uniform int tileOffset;
+
+#include "path_tracer.glsl"
+#include "bdpt.glsl"
+
+// Adds spp samples to the pixel, each with the light tracing estimate of the previous pass
+void renderPixel(ivec2 pixelCoord) {
+    vec4 accumulated = frameCount == 0 ? vec4(0.0) : imageLoad(imgOutput, pixelCoord);
+    vec4 variance = frameCount == 0 ? vec4(0.0) : imageLoad(varianceImage, pixelCoord);
+
+    vec3 color = accumulated.xyz;
+    float sampleCount = accumulated.w;
+    vec2 moments = variance.xy;
+    float sampleIndex = variance.z;
+
+    vec3 splats = splatHistory && frameCount > 0 ? loadPreviousSplats(pixelCoord) : vec3(0.0);
+
+    for (int s = 0; s < spp; s++) {
+        addSample(bdptSample(pixelCoord, int(sampleIndex)) + splats, color, sampleCount, moments);
+        sampleIndex += 1.0;
+    }
+
+    imageStore(imgOutput, pixelCoord, vec4(color, sampleCount));
+    imageStore(varianceImage, pixelCoord, vec4(moments, sampleIndex, 0.0));
+    storeDisplay(pixelCoord, color, sampleCount);
+}
+
+void main() {
+
+    ivec2 pixelCoord = tileOrigin(uint(tileOffset) + gl_WorkGroupID.x) + ivec2(gl_LocalInvocationID.xy);
+
+    if (pixelCoord.x >= width || pixelCoord.y >= height) return;
+
+    renderPixel(pixelCoord);
+}
@@ -0,0 +1,213 @@
+#version 430 core
+
+// Primary sample space Metropolis light transport (Kelemen et al. 2002, with the bootstrap of PBRT v3): Markov chains
+// walk the random numbers of the path tracer, the samples of sampler.glsl being read from the vector of the chain
+// (SAMPLER_PRIMARY). Each work group runs 256 chains, the stages are dispatched by MetropolisChains:
+// - bootstrap: two candidate vectors per chain, drawn at random and traced, their luminance gives the normalization
+// - start: each chain takes a candidate picked by the CPU proportionally to its luminance
+// - mutate: spp mutations per chain, small steps around the vector or large steps to a new random vector
+// - resolve: the splats of the pass, normalized, are added to the accumulated image like a pass of the path tracer
+// The chains ignore the rasterized primary rays, the cache, ReSTIR and the guiding
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+// Chain groups, or tiles for the resolve, are dispatched as a range of work groups, tileOffset being the first one
+uniform int tileOffset;
+
+#include "path_tracer.glsl"
+
+#define MLT_BOOTSTRAP 0
+#define MLT_START 1
+#define MLT_MUTATE 2
+#define MLT_RESOLVE 3
+
+#define MLT_LARGE_STEP 0.3 // probability of a large step
+#define MLT_SMALL_STEP_MIN (1.0 / 1024.0) // range of the small step perturbations
+#define MLT_SMALL_STEP_MAX (1.0 / 64.0)
+
+#define MLT_SPLAT_SCALE 1024.0 // fixed point of the splats, rounded at random to stay unbiased
+#define MLT_SPLAT_MAX 64.0
+
+// Current sample of a chain: its vector is 2 * chain + slot, the proposals are written in the other slot
+struct MltChain {
+    vec4 contribution; // color of the path, its luminance in w
+    vec2 raster;
+    uint slot;
+    uint rng;          // PCG state of the mutations
+};
+
+layout(std430, binding = 21) buffer MltChains {
+    MltChain chains[];
+};
+
+// Traced bootstrap candidates, candidate i has the vector of seed i
+layout(std430, binding = 22) buffer MltCandidates {
+    MltChain candidates[];
+};
+
+// Candidate of each chain, written by the CPU before the start stage
+layout(std430, binding = 23) readonly buffer MltStarts {
+    uint starts[];
+};
+
+// RGB of each pixel in fixed point, emptied by the resolve
+layout(std430, binding = 24) buffer MltSplats {
+    uint mltSplats[];
+};
+
+// Proposed and accepted small steps, proposed and accepted large steps
+layout(std430, binding = 25) buffer MltStats {
+    uint mltStats[4];
+};
+
+uniform int mltStage;
+uniform float mltNormalization;    // mean luminance of the bootstrap candidates
+uniform float mltMutationsPerPixel; // mutations of the pass over the pixel count
+
+const vec3 mltLuminance = vec3(0.2126, 0.7152, 0.0722);
+
+void generateVector(uint vector, uint seed) {
+    uint state = hash(seed);
+    for (uint d = 0u; d < uint(mltDimensions); d++) {
+        primarySamples[vector * uint(mltDimensions) + d] = vec4(random(state), random(state), random(state), random(state));
+    }
+}
+
+// Kelemen mutation: exponentially distributed offset between the two step sizes, wrapped around [0, 1)
+float perturb(float x, inout uint state) {
+    float u = random(state);
+    float offset = MLT_SMALL_STEP_MAX * exp(-log(MLT_SMALL_STEP_MAX / MLT_SMALL_STEP_MIN) * random(state));
+    x += u < 0.5 ? offset : -offset;
+    return x - floor(x);
+}
+
+// Traces the path of the vector, the pixel and the sub-pixel jitter being its first pattern
+MltChain evaluateVector(uint vector, uint stream) {
+    vec4 camera = primarySamples[vector * uint(mltDimensions)];
+    ivec2 pixel = min(ivec2(camera.zw * vec2(width, height)), ivec2(width, height) - 1);
+
+    primarySampleStream = stream;
+    vec3 color = tracePath(pixel, int(vector));
+
+    MltChain result;
+    result.contribution = vec4(color, dot(color, mltLuminance));
+    if (any(isnan(color)) || any(isinf(color))) result.contribution = vec4(0.0);
+    result.raster = vec2(pixel) + camera.xy;
+    return result;
+}
+
+void splat(vec2 raster, vec3 contribution, inout uint state) {
+    ivec2 pixel = clamp(ivec2(raster), ivec2(0), ivec2(width, height) - 1);
+    uint base = uint(3 * (pixel.y * width + pixel.x));
+    vec3 scaled = min(contribution, vec3(MLT_SPLAT_MAX)) * MLT_SPLAT_SCALE;
+    for (int c = 0; c < 3; c++) {
+        uint fixedPoint = uint(scaled[c] + random(state));
+        if (fixedPoint > 0u) atomicAdd(mltSplats[base + uint(c)], fixedPoint);
+    }
+}
+
+// spp mutations of the chain, both the proposal and the current sample are splatted, weighted by the acceptance
+// probability (expected values), so the rejected proposals still contribute
+void mutateChain(uint chainIdx) {
+    MltChain chain = chains[chainIdx];
+    uint dimensions = uint(mltDimensions);
+    uvec4 stats = uvec4(0u);
+
+    for (int s = 0; s < spp; s++) {
+        uint current = 2u * chainIdx + chain.slot;
+        uint proposal = 2u * chainIdx + 1u - chain.slot;
+
+        bool largeStep = random(chain.rng) < MLT_LARGE_STEP;
+        for (uint d = 0u; d < dimensions; d++) {
+            vec4 x = primarySamples[current * dimensions + d];
+            if (largeStep) {
+                x = vec4(random(chain.rng), random(chain.rng), random(chain.rng), random(chain.rng));
+            } else {
+                x = vec4(perturb(x.x, chain.rng), perturb(x.y, chain.rng), perturb(x.z, chain.rng), perturb(x.w, chain.rng));
+            }
+            primarySamples[proposal * dimensions + d] = x;
+        }
+
+        MltChain proposed = evaluateVector(proposal, chain.rng);
+
+        float accept = chain.contribution.w > 0.0 ? min(1.0, proposed.contribution.w / chain.contribution.w) : 1.0;
+        if (proposed.contribution.w > 0.0) {
+            splat(proposed.raster, proposed.contribution.rgb * accept / proposed.contribution.w, chain.rng);
+        }
+        if (chain.contribution.w > 0.0) {
+            splat(chain.raster, chain.contribution.rgb * (1.0 - accept) / chain.contribution.w, chain.rng);
+        }
+
+        bool accepted = random(chain.rng) < accept;
+        stats += largeStep ? uvec4(0u, 0u, 1u, uint(accepted)) : uvec4(1u, uint(accepted), 0u, 0u);
+        if (accepted) {
+            chain.contribution = proposed.contribution;
+            chain.raster = proposed.raster;
+            chain.slot = 1u - chain.slot;
+        }
+    }
+
+    chains[chainIdx] = chain;
+    for (int i = 0; i < 4; i++) {
+        if (stats[i] > 0u) atomicAdd(mltStats[i], stats[i]);
+    }
+}
+
+// Adds the pass to the pixel with the weight of its mutations. The pass counts as that many samples whose variance
+// is the weight times its own, so the squared deviations of the Welford update are scaled by the squared weight:
+// the standard error of adaptive_tiles.glsl stays the one of the mean of the passes
+void resolvePixel(ivec2 pixelCoord) {
+    vec4 accumulated = frameCount == 0 ? vec4(0.0) : imageLoad(imgOutput, pixelCoord);
+    vec4 variance = frameCount == 0 ? vec4(0.0) : imageLoad(varianceImage, pixelCoord);
+    vec2 moments = variance.xy;
+
+    uint base = uint(3 * (pixelCoord.y * width + pixelCoord.x));
+    vec3 splats = vec3(mltSplats[base], mltSplats[base + 1u], mltSplats[base + 2u]) / MLT_SPLAT_SCALE;
+    mltSplats[base] = 0u;
+    mltSplats[base + 1u] = 0u;
+    mltSplats[base + 2u] = 0u;
+
+    vec3 estimate = splats * mltNormalization / mltMutationsPerPixel;
+    float weight = mltMutationsPerPixel;
+    float sampleCount = accumulated.w + weight;
+    vec3 color = accumulated.xyz + (estimate - accumulated.xyz) * weight / sampleCount;
+
+    float luminance = dot(estimate, mltLuminance);
+    float delta = luminance - moments.x;
+    moments.x += delta * weight / sampleCount;
+    moments.y += weight * weight * delta * (luminance - moments.x);
+
+    imageStore(imgOutput, pixelCoord, vec4(color, sampleCount));
+    imageStore(varianceImage, pixelCoord, vec4(moments, variance.z, 0.0)); // the chains use no pixel sample index
+    storeDisplay(pixelCoord, color, sampleCount);
+}
+
+void main() {
+    uint group = uint(tileOffset) + gl_WorkGroupID.x;
+
+    if (mltStage == MLT_RESOLVE) {
+        ivec2 pixelCoord = tileOrigin(group) + ivec2(gl_LocalInvocationID.xy);
+        if (pixelCoord.x >= width || pixelCoord.y >= height) return;
+        resolvePixel(pixelCoord);
+        return;
+    }
+
+    uint index = group * 256u + gl_LocalInvocationIndex;
+
+    if (mltStage == MLT_BOOTSTRAP) {
+        if (index >= uint(candidates.length())) return;
+        generateVector(index, index);
+        candidates[index] = evaluateVector(index, ~index);
+    } else if (mltStage == MLT_START) {
+        if (index >= uint(chains.length())) return;
+        uint candidate = starts[index];
+        generateVector(2u * index, candidate);
+        MltChain chain = candidates[candidate];
+        chain.slot = 0u;
+        chain.rng = hash(index ^ 0x5bd1e995u);
+        chains[index] = chain;
+    } else {
+        if (index >= uint(chains.length())) return;
+        mutateChain(index);
+    }
+}
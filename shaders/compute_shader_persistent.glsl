@@ -0,0 +1,65 @@
+#version 430 core
+
+// Persistent threads variant of compute_shader.glsl, launched with only enough work groups to fill the GPU
+// (see PersistentScheduler): the lanes fetch pixels from a global counter until it reaches workItemEnd
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+// Pixels are numbered in tile order, tiles of the list with useTileList, all the tiles of the image otherwise
+// The counter starts at the first pixel of the dispatched range
+layout(std430, binding = 3) buffer WorkCounter {
+    uint nextWorkItem;
+};
+
+uniform int workItemEnd;
+
+#include "path_tracer.glsl"
+
+void main() {
+    // One segment per iteration: a lane whose path ended starts the next one, or fetches its next pixel,
+    // instead of waiting for the longest path of its SIMD group. No barrier, the lanes drift apart
+    uint tileSize = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+    ivec2 pixelCoord;
+    vec3 color;
+    float sampleCount;
+    vec2 moments;
+    float sampleIndex;
+    int remaining = 0;   // samples left in the current pixel
+    bool tracing = false;
+    Path path;
+
+    while (true) {
+        if (!tracing) {
+            if (remaining == 0) {
+                uint item = atomicAdd(nextWorkItem, 1u);
+                if (item >= uint(workItemEnd)) break;
+
+                uint local = item % tileSize;
+                pixelCoord = tileOrigin(item / tileSize) + ivec2(local % gl_WorkGroupSize.x, local / gl_WorkGroupSize.x);
+                if (pixelCoord.x >= width || pixelCoord.y >= height) continue;
+
+                vec4 accumulated = frameCount == 0 ? vec4(0.0) : imageLoad(imgOutput, pixelCoord);
+                vec4 variance = frameCount == 0 ? vec4(0.0) : imageLoad(varianceImage, pixelCoord);
+                color = accumulated.xyz;
+                sampleCount = accumulated.w;
+                moments = variance.xy;
+                sampleIndex = variance.z;
+                remaining = spp;
+            }
+            path = startPath(pixelCoord, int(sampleIndex));
+        }
+
+        tracing = extendPath(path);
+
+        if (!tracing) {
+            addSample(path.emiColor, color, sampleCount, moments);
+            sampleIndex += 1.0;
+            remaining--;
+            if (remaining == 0) {
+                imageStore(imgOutput, pixelCoord, vec4(color, sampleCount));
+                imageStore(varianceImage, pixelCoord, vec4(moments, sampleIndex, 0.0));
+                storeDisplay(pixelCoord, color, sampleCount);
+            }
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#version 430 core
+
+// Background update of the irradiance probes (ProbeGrid, shaders/probe_cache.glsl): each work group traces 256 paths
+// from one probe of the queue, in directions stratified over the sphere, and adds their projection on the spherical
+// harmonics to the running mean of the probe
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+#include "path_tracer.glsl"
+
+// Probe of each work group, the high bit restarts its mean (the probe was near an edited object)
+layout(std430, binding = 27) readonly buffer ProbeQueue {
+    uint probeQueue[];
+};
+
+shared vec4 sharedRed[256];
+shared vec4 sharedGreen[256];
+shared vec4 sharedBlue[256];
+shared float sharedBackfaces[256];
+
+void main() {
+    uint entry = probeQueue[gl_WorkGroupID.x];
+    int probe = int(entry & 0x7fffffffu);
+    bool restart = (entry >> 31) != 0u;
+    uint lane = gl_LocalInvocationIndex;
+
+    float samples = restart ? 0.0 : probes[probe].info.x;
+    ivec3 p = ivec3(probe % probeCounts.x, (probe / probeCounts.x) % probeCounts.y, probe / (probeCounts.x * probeCounts.y));
+
+    Path path;
+    path.sampler = initSampler(ivec2(probe, 0), int(samples) + int(lane));
+
+    // One direction per stratum of z, spread in phi by the golden ratio
+    float z = 1.0 - 2.0 * (float(lane) + random(path.sampler.state)) / 256.0;
+    float phi = 2.0 * PI * (float(lane) * 0.618034 + random(path.sampler.state));
+    float r = sqrt(max(0.0, 1.0 - z * z));
+    vec3 direction = vec3(r * cos(phi), r * sin(phi), z);
+
+    path.origin = probePosition(p);
+    path.rayDirection = direction;
+    path.matColor = vec3(1.0);
+    path.emiColor = vec3(0.0);
+    path.depth = 0;
+    path.sampledLights = false;
+    path.guidePdf = 0.0;
+
+    // Only the spheres and the tores have back faces, the triangles are one-sided
+    HitInfo firstHit = sendRay(path.origin, direction);
+    float backface = firstHit.hasHit && dot(firstHit.normal, direction) > 0.0 ? 1.0 : 0.0;
+
+    while (extendPath(path)) {}
+
+    vec3 radiance = path.emiColor;
+    if (any(isnan(radiance)) || any(isinf(radiance))) radiance = vec3(0.0);
+
+    // Uniform directions: the projection is the mean of the radiance times the basis over the pdf 1 / (4 pi)
+    vec4 basis = 4.0 * PI * shBasis(direction);
+    sharedRed[lane] = radiance.r * basis;
+    sharedGreen[lane] = radiance.g * basis;
+    sharedBlue[lane] = radiance.b * basis;
+    sharedBackfaces[lane] = backface;
+    barrier();
+
+    for (uint stride = 128u; stride > 0u; stride >>= 1) {
+        if (lane < stride) {
+            sharedRed[lane] += sharedRed[lane + stride];
+            sharedGreen[lane] += sharedGreen[lane + stride];
+            sharedBlue[lane] += sharedBlue[lane + stride];
+            sharedBackfaces[lane] += sharedBackfaces[lane + stride];
+        }
+        barrier();
+    }
+
+    if (lane == 0u) {
+        float total = samples + 256.0;
+        IrradianceProbe old = probes[probe];
+        if (restart) {
+            old.red = vec4(0.0);
+            old.green = vec4(0.0);
+            old.blue = vec4(0.0);
+            old.info = vec4(0.0);
+        }
+        probes[probe].red = (old.red * samples + sharedRed[0]) / total;
+        probes[probe].green = (old.green * samples + sharedGreen[0]) / total;
+        probes[probe].blue = (old.blue * samples + sharedBlue[0]) / total;
+        probes[probe].info = vec4(total, (old.info.y * samples + sharedBackfaces[0]) / total, 0.0, 0.0);
+    }
+}
@@ -0,0 +1,131 @@
+#version 430 core
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010), with the variance guided luminance weight of SVGF
+// One dispatch per iteration: the 5x5 B3 spline kernel is spread over 2^iteration pixels, and the weights stop at
+// the edges of the guide buffers of aov.glsl and at luminance differences larger than the noise of the pixel
+// Iteration 0 reads the accumulated image and turns the luminance moments into the variance of the pixel mean,
+// the next ones read the previous output: color in rgb, variance in alpha, filtered with the squared weights
+// The last iteration only writes the display image
+// Denoiser::denoiseOnCpu is the same filter on the CPU, for the saved render (Raytracing --check-denoiser compares them)
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(rgba32f, binding = 0) uniform readonly image2D imgOutput;
+layout(rgba32f, binding = 2) uniform readonly image2D varianceImage;
+layout(rgba32f, binding = 3) uniform readonly image2D albedoImage;
+layout(rgba32f, binding = 4) uniform readonly image2D normalDepthImage;
+layout(rgba32f, binding = 5) uniform readonly image2D inputImage;
+layout(rgba32f, binding = 6) uniform writeonly image2D outputImage;
+
+uniform int width;
+uniform int height;
+uniform int iteration;
+uniform bool lastIteration;
+
+#include "display_image.glsl"
+
+#define SIGMA_LUMINANCE 4.0  // luminance differences in standard deviations of the pixel mean
+#define SIGMA_NORMAL 128.0   // exponent of the normals cosine
+#define SIGMA_DEPTH 0.02     // relative distance difference per pixel of offset
+#define SIGMA_ALBEDO 0.1
+
+float luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Color and variance of the pixel mean
+vec4 fetch(ivec2 pixel) {
+    if (iteration > 0) return imageLoad(inputImage, pixel);
+
+    vec4 accumulated = imageLoad(imgOutput, pixel);
+    float sampleCount = accumulated.w;
+    float m2 = imageLoad(varianceImage, pixel).y;
+
+    // Unknown below 2 samples, large enough to not stop the filter
+    float variance = sampleCount > 1.0 ? m2 / ((sampleCount - 1.0) * sampleCount) : 1.0;
+    return vec4(accumulated.rgb, variance);
+}
+
+// 3x3 gaussian of the variance around the pixel, steadier for the luminance weight
+float filteredVariance(ivec2 pixel) {
+    const float kernel[2] = float[](0.5, 0.25);
+
+    float sum = 0.0;
+    float weightSum = 0.0;
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            ivec2 q = pixel + ivec2(dx, dy);
+            if (q.x < 0 || q.y < 0 || q.x >= width || q.y >= height) continue;
+
+            float k = kernel[abs(dx)] * kernel[abs(dy)];
+            sum += k * fetch(q).a;
+            weightSum += k;
+        }
+    }
+    return sum / weightSum;
+}
+
+void main() {
+    ivec2 pixelCoord = ivec2(gl_GlobalInvocationID.xy);
+    if (pixelCoord.x >= width || pixelCoord.y >= height) return;
+
+    const float kernel[3] = float[](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+    int stepWidth = 1 << iteration;
+
+    vec4 center = fetch(pixelCoord);
+    vec4 normalDepth = imageLoad(normalDepthImage, pixelCoord);
+    vec3 albedo = imageLoad(albedoImage, pixelCoord).rgb;
+
+    float centerLuminance = luminance(center.rgb);
+    float luminanceScale = SIGMA_LUMINANCE * sqrt(max(filteredVariance(pixelCoord), 0.0)) + 1e-4;
+
+    // Averaged normals are shorter on silhouettes, only their direction is compared
+    vec3 normal = normalDepth.xyz / max(length(normalDepth.xyz), 1e-6);
+
+    // The center pixel has the full kernel weight
+    float centerWeight = kernel[0] * kernel[0];
+    vec3 colorSum = centerWeight * center.rgb;
+    float varianceSum = centerWeight * centerWeight * center.a;
+    float weightSum = centerWeight;
+
+    for (int dy = -2; dy <= 2; dy++) {
+        for (int dx = -2; dx <= 2; dx++) {
+            if (dx == 0 && dy == 0) continue;
+
+            ivec2 q = pixelCoord + ivec2(dx, dy) * stepWidth;
+            if (q.x < 0 || q.y < 0 || q.x >= width || q.y >= height) continue;
+
+            vec4 color = fetch(q);
+            vec4 qNormalDepth = imageLoad(normalDepthImage, q);
+            vec3 qAlbedo = imageLoad(albedoImage, q).rgb;
+
+            // Geometry weights only between two hits, a hit never mixes with the background
+            float geometryWeight = 1.0;
+            if (normalDepth.w > 0.0 && qNormalDepth.w > 0.0) {
+                vec3 qNormal = qNormalDepth.xyz / max(length(qNormalDepth.xyz), 1e-6);
+                float normalWeight = pow(max(dot(normal, qNormal), 0.0), SIGMA_NORMAL);
+                float depthScale = SIGMA_DEPTH * normalDepth.w * length(vec2(dx, dy)) * float(stepWidth) + 1e-4;
+                float depthWeight = exp(-abs(normalDepth.w - qNormalDepth.w) / depthScale);
+                geometryWeight = normalWeight * depthWeight;
+            } else if (normalDepth.w > 0.0 || qNormalDepth.w > 0.0) {
+                geometryWeight = 0.0;
+            }
+
+            vec3 albedoDifference = albedo - qAlbedo;
+            float albedoWeight = exp(-dot(albedoDifference, albedoDifference) / (SIGMA_ALBEDO * SIGMA_ALBEDO));
+            float luminanceWeight = exp(-abs(centerLuminance - luminance(color.rgb)) / luminanceScale);
+
+            float weight = kernel[abs(dx)] * kernel[abs(dy)] * geometryWeight * albedoWeight * luminanceWeight;
+
+            colorSum += weight * color.rgb;
+            varianceSum += weight * weight * color.a;
+            weightSum += weight;
+        }
+    }
+
+    if (lastIteration) {
+        storeDisplay(pixelCoord, colorSum / weightSum, imageLoad(imgOutput, pixelCoord).w);
+    } else {
+        imageStore(outputImage, pixelCoord, vec4(colorSum / weightSum, varianceSum / (weightSum * weightSum)));
+    }
+}
@@ -0,0 +1,21 @@
+#version 430 core
+
+// Rewrites the 8 bit display copy from the accumulated image, when the denoiser is turned off
+// or the exposure changed while no kernel writes it
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(rgba32f, binding = 0) uniform readonly image2D imgOutput;
+
+uniform int width;
+uniform int height;
+
+#include "display_image.glsl"
+
+void main() {
+    ivec2 pixelCoord = ivec2(gl_GlobalInvocationID.xy);
+    if (pixelCoord.x >= width || pixelCoord.y >= height) return;
+
+    vec4 color = imageLoad(imgOutput, pixelCoord);
+    storeDisplay(pixelCoord, color.rgb, color.w);
+}
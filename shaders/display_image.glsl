@@ -0,0 +1,12 @@
+// 8 bit copy of the image shown by frag_shader_rt.glsl, stored by every kernel that changes the accumulated image
+// (path tracers, reproject) or filters it (last iteration of denoise_atrous), so that the display pass reads
+// 4 bytes per texel instead of the 16 of the accumulated image
+// Colors are tone mapped (tone_map.glsl), alpha tells the pixels that have samples
+
+#include "tone_map.glsl"
+
+layout(rgba8, binding = 7) uniform writeonly image2D displayImage;
+
+void storeDisplay(ivec2 pixelCoord, vec3 color, float sampleCount) {
+    imageStore(displayImage, pixelCoord, vec4(toneMap(color), sampleCount > 0.0 ? 1.0 : 0.0));
+}
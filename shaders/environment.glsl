@@ -0,0 +1,79 @@
+// Equirectangular HDR environment map sent by EnvironmentMap, included by scene.glsl
+// v = 0 looks up (+y), u = 0.5 looks along +x
+// Importance sampled with the marginal-conditional CDF of its luminance times sin(theta): the marginal CDF
+// picks a row, the CDF of the row picks a column, and the position in the pixel is kept from the random numbers
+
+uniform bool useEnvironmentMap;
+uniform float environmentStrength;
+uniform sampler2D environmentMap;
+uniform sampler2D environmentConditionalCdf; // (width + 1) x height, the CDF of each row
+uniform sampler2D environmentMarginalCdf;    // (height + 1) x 1, the CDF of the rows
+
+vec2 directionToEnvironment(vec3 direction){
+    float u = atan(direction.z, direction.x) / (2.0 * PI) + 0.5;
+    float v = acos(clamp(direction.y, -1.0, 1.0)) / PI;
+    return vec2(u, v);
+}
+
+vec3 environmentToDirection(vec2 uv){
+    float phi = (uv.x - 0.5) * 2.0 * PI;
+    float theta = uv.y * PI;
+    return vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+}
+
+// direction must be normalized
+vec3 environmentRadiance(vec3 direction){
+    return textureLod(environmentMap, directionToEnvironment(direction), 0.0).rgb * environmentStrength;
+}
+
+// Interval of the CDF stored in the row of cdf that holds u: cdf[i] <= u < cdf[i + 1], with cdf[0] = 0 and cdf[count] = 1
+int searchCdf(sampler2D cdf, int row, int count, float u){
+    int low = 0;
+    int high = count;
+    while (high - low > 1) {
+        int middle = (low + high) / 2;
+        if (texelFetch(cdf, ivec2(middle, row), 0).r <= u) low = middle;
+        else high = middle;
+    }
+    return low;
+}
+
+// Solid angle pdf of a direction of the pixel whose probability is pixelProbability
+float environmentSolidAnglePdf(float pixelProbability, float v){
+    float sinTheta = sin(v * PI);
+    if (sinTheta <= 0.0) return 0.0;
+
+    ivec2 size = textureSize(environmentMap, 0);
+    return pixelProbability * float(size.x * size.y) / (2.0 * PI * PI * sinTheta);
+}
+
+// Direction picked proportionally to the distribution, pdf is its solid angle pdf
+vec3 sampleEnvironment(vec2 u, out float pdf){
+    ivec2 size = textureSize(environmentMap, 0);
+
+    int y = searchCdf(environmentMarginalCdf, 0, size.y, u.y);
+    float rowStart = texelFetch(environmentMarginalCdf, ivec2(y, 0), 0).r;
+    float rowEnd = texelFetch(environmentMarginalCdf, ivec2(y + 1, 0), 0).r;
+
+    int x = searchCdf(environmentConditionalCdf, y, size.x, u.x);
+    float columnStart = texelFetch(environmentConditionalCdf, ivec2(x, y), 0).r;
+    float columnEnd = texelFetch(environmentConditionalCdf, ivec2(x + 1, y), 0).r;
+
+    // Position in the pixel, from where u falls in its interval
+    vec2 offset = clamp((u - vec2(columnStart, rowStart)) / vec2(columnEnd - columnStart, rowEnd - rowStart), 0.0, 1.0);
+    vec2 uv = (vec2(x, y) + offset) / vec2(size);
+
+    pdf = environmentSolidAnglePdf((rowEnd - rowStart) * (columnEnd - columnStart), uv.y);
+    return environmentToDirection(uv);
+}
+
+// Solid angle pdf of sampleEnvironment for a direction
+float environmentPdf(vec3 direction){
+    ivec2 size = textureSize(environmentMap, 0);
+    vec2 uv = directionToEnvironment(direction);
+    ivec2 pixel = clamp(ivec2(uv * vec2(size)), ivec2(0), size - 1);
+
+    float row = texelFetch(environmentMarginalCdf, ivec2(pixel.y + 1, 0), 0).r - texelFetch(environmentMarginalCdf, ivec2(pixel.y, 0), 0).r;
+    float column = texelFetch(environmentConditionalCdf, ivec2(pixel.x + 1, pixel.y), 0).r - texelFetch(environmentConditionalCdf, pixel, 0).r;
+    return environmentSolidAnglePdf(row * column, uv.y);
+}
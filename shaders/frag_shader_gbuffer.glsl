@@ -0,0 +1,32 @@
+#version 430 core
+
+// Writes the triangle seen through the pixel, read by raster_primary.glsl
+// gl_PrimitiveID follows the index buffer, the order in which ObjectManager::genAllTriangles stores the triangles
+
+in vec3 FragPos;
+
+layout(location = 0) out ivec2 primaryHit;
+
+struct Triangle {
+    vec3 v0;
+    vec3 v1;
+    vec3 v2;
+    vec3 normal;
+};
+
+layout(std430, binding = 1) buffer TrianglesBuffer {
+    Triangle triangles[];
+};
+
+uniform vec3 cameraPosition;
+uniform int triangleMeshIdx; // index in the triangleMeshes uniform of the path tracer
+uniform int firstTriangle;
+
+void main() {
+    int triangleIdx = firstTriangle + gl_PrimitiveID;
+
+    // sendRay ignores the triangles facing away from the ray, whatever their winding
+    if (dot(FragPos - cameraPosition, triangles[triangleIdx].normal) >= 0.0) discard;
+
+    primaryHit = ivec2(triangleMeshIdx, triangleIdx);
+}
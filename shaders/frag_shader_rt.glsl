@@ -5,6 +5,55 @@ out vec4 color;
 
 uniform sampler2D renderedImage;
 
+// Dynamic resolution: low resolution image rendered while the camera moves, in the corner of previewImage
+// Tiles of renderedImage from fullResTiles on (row-major 16x16 tiles) are not rendered yet and show the preview,
+// as do the pixels without samples left by the temporal reprojection
+uniform sampler2D previewImage;
+uniform bool previewValid;
+uniform int previewWidth;
+uniform int previewHeight;
+uniform int fullResTiles;
+
+// Catmull-Rom weights of the 4 texels around t in [0, 1)
+vec4 catmullRom(float t) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return vec4(-0.5 * t3 + t2 - 0.5 * t,
+                1.5 * t3 - 2.5 * t2 + 1.0,
+                -1.5 * t3 + 2.0 * t2 + 0.5 * t,
+                0.5 * t3 - 0.5 * t2);
+}
+
+// Bicubic upscale of the preview, sharper than the bilinear filter at the same cost in the display pass
+vec3 upscalePreview(vec2 uv) {
+    ivec2 size = ivec2(previewWidth, previewHeight);
+    vec2 position = uv * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+
+    vec4 wx = catmullRom(f.x);
+    vec4 wy = catmullRom(f.y);
+
+    vec3 result = vec3(0.0);
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 4; i++) {
+            ivec2 texel = clamp(base + ivec2(i - 1, j - 1), ivec2(0), size - 1);
+            result += wx[i] * wy[j] * texelFetch(previewImage, texel, 0).rgb;
+        }
+    }
+
+    // The negative lobes can overshoot next to bright emitters
+    return max(result, vec3(0.0));
+}
+
 void main() {
+    ivec2 imageSize = textureSize(renderedImage, 0);
+    ivec2 tile = ivec2(fragTexCoord * vec2(imageSize)) / 16;
+    int tilesX = (imageSize.x + 15) / 16;
+
     color = texture(renderedImage, fragTexCoord);
+
+    if (tile.y * tilesX + tile.x >= fullResTiles || (previewValid && color.a == 0.0)) {
+        color = vec4(upscalePreview(fragTexCoord), 1.0);
+    }
 }
@@ -0,0 +1,161 @@
+// Path guiding of the diffuse bounces (practical path guiding, Müller et al. 2017), included by lighting.glsl
+// GuidingTree learns the incident radiance in a spatial binary tree over the scene bounds whose leaves hold a
+// quadtree over the directions, in cylindrical coordinates (cos theta, phi) which preserve the areas
+// The paths record the radiance they receive at each diffuse vertex, and the diffuse directions are drawn from the
+// quadtree learned by the previous training iteration or from the cosine lobe, the two pdfs being mixed (one sample MIS)
+
+// Spatial nodes: x is the split axis, -1 for a leaf, y the first of the two children or the quadtree root of a leaf
+layout(std430, binding = 15) readonly buffer GuideSpatialNodes {
+    ivec2 guideSpatialNodes[];
+};
+
+// Quadtree node: energy of the 4 quadrants (x + 2 y), child node of each quadrant or -1
+struct GuideQuadNode {
+    vec4 energy;
+    ivec4 child;
+};
+
+layout(std430, binding = 16) readonly buffer GuideQuadNodes {
+    GuideQuadNode guideQuadNodes[];
+};
+
+// Radiance recorded by the current iteration, in 64 bit fixed point: 8 words per quadtree node (low and high word of
+// each quadrant), then the vertex count of each spatial node from guideCountOffset
+layout(std430, binding = 17) buffer GuideRecords {
+    uint guideRecords[];
+};
+
+uniform bool useGuiding;
+uniform bool recordGuiding;
+uniform vec3 guideBoundsMin; // cube around the scene
+uniform vec3 guideBoundsMax;
+uniform int guideCountOffset;
+
+#define GUIDING_FRACTION 0.5      // probability to draw a diffuse direction from the quadtree
+#define GUIDE_RECORD_SCALE 65536.0
+#define GUIDE_RECORD_MAX 60000.0  // a recorded value fits in 32 bits
+#define GUIDE_RECORDED_VERTICES 8 // first diffuse vertices of a path recorded by the training passes
+
+// Spatial leaf containing a point
+int guideSpatialLeaf(vec3 p){
+    vec3 boundsMin = guideBoundsMin;
+    vec3 boundsMax = guideBoundsMax;
+    int node = 0;
+    while (guideSpatialNodes[node].x >= 0) {
+        int axis = guideSpatialNodes[node].x;
+        float middle = 0.5 * (boundsMin[axis] + boundsMax[axis]);
+        if (p[axis] < middle) {
+            boundsMax[axis] = middle;
+            node = guideSpatialNodes[node].y;
+        } else {
+            boundsMin[axis] = middle;
+            node = guideSpatialNodes[node].y + 1;
+        }
+    }
+    return node;
+}
+
+// Quadtree learned around a vertex, -1 when it has not received any light yet
+int guideQuadRoot(vec3 p){
+    int root = guideSpatialNodes[guideSpatialLeaf(p)].y;
+    vec4 energy = guideQuadNodes[root].energy;
+    return energy.x + energy.y + energy.z + energy.w > 0.0 ? root : -1;
+}
+
+vec2 directionToSquare(vec3 direction){
+    float phi = atan(direction.y, direction.x);
+    return vec2(0.5 * (clamp(direction.z, -1.0, 1.0) + 1.0), fract(phi / (2.0 * PI) + 1.0));
+}
+
+vec3 squareToDirection(vec2 p){
+    float cosTheta = 2.0 * p.x - 1.0;
+    float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+    float phi = 2.0 * PI * p.y;
+    return vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+}
+
+// Direction drawn from a quadtree: at each level a column then a row, in proportion to their energy, u is rescaled
+vec3 sampleGuide(int root, vec2 u){
+    vec2 origin = vec2(0.0);
+    float size = 1.0;
+    int node = root;
+    while (node >= 0) {
+        vec4 energy = guideQuadNodes[node].energy;
+        float left = energy.x + energy.z;
+        float right = energy.y + energy.w;
+
+        int quadrant = 0;
+        float pLeft = left / (left + right);
+        if (u.x < pLeft) {
+            u.x = min(u.x / pLeft, 0.99999994);
+        } else {
+            u.x = min((u.x - pLeft) / (1.0 - pLeft), 0.99999994);
+            quadrant = 1;
+        }
+
+        float pBottom = quadrant == 0 ? energy.x / left : energy.y / right;
+        if (u.y < pBottom) {
+            u.y = min(u.y / pBottom, 0.99999994);
+        } else {
+            u.y = min((u.y - pBottom) / (1.0 - pBottom), 0.99999994);
+            quadrant += 2;
+        }
+
+        size *= 0.5;
+        origin += size * vec2(quadrant & 1, quadrant >> 1);
+        node = guideQuadNodes[node].child[quadrant];
+    }
+    return squareToDirection(origin + size * u);
+}
+
+// Solid angle pdf of sampleGuide
+float guidePdf(int root, vec3 direction){
+    vec2 p = directionToSquare(direction);
+    float pdf = 1.0 / (4.0 * PI);
+    int node = root;
+    while (node >= 0) {
+        vec4 energy = guideQuadNodes[node].energy;
+        int quadrant = int(p.x >= 0.5) + 2 * int(p.y >= 0.5);
+        pdf *= 4.0 * energy[quadrant] / (energy.x + energy.y + energy.z + energy.w);
+        if (pdf <= 0.0) return 0.0;
+
+        p = fract(2.0 * p);
+        node = guideQuadNodes[node].child[quadrant];
+    }
+    return pdf;
+}
+
+// pdf of the diffuse directions at a vertex whose quadtree is guideRoot (-1 when not guided)
+float diffuseSamplingPdf(int guideRoot, vec3 normal, vec3 direction){
+    float cosinePdf = max(dot(direction, normal), 0.0) / PI;
+    if (guideRoot < 0) return cosinePdf;
+    return mix(cosinePdf, guidePdf(guideRoot, direction), GUIDING_FRACTION);
+}
+
+// Counts a vertex at p in its spatial leaf, and returns the slot of the quadrant containing direction
+uint guideRecordSlot(vec3 p, vec3 direction){
+    int leaf = guideSpatialLeaf(p);
+    atomicAdd(guideRecords[guideCountOffset + leaf], 1u);
+
+    vec2 square = directionToSquare(direction);
+    int node = guideSpatialNodes[leaf].y;
+    int quadrant;
+    while (true) {
+        quadrant = int(square.x >= 0.5) + 2 * int(square.y >= 0.5);
+        int child = guideQuadNodes[node].child[quadrant];
+        if (child < 0) break;
+        square = fract(2.0 * square);
+        node = child;
+    }
+    return uint(8 * node + 2 * quadrant);
+}
+
+// Adds the radiance received from the direction of a slot, divided by the pdf of the direction, to its quadrant
+void recordGuideSample(uint slot, float value){
+    if (!(value > 0.0)) return;
+
+    // The carry of the low word goes to the high word
+    uint fixedPoint = uint(min(value, GUIDE_RECORD_MAX) * GUIDE_RECORD_SCALE);
+    uint previous = atomicAdd(guideRecords[slot], fixedPoint);
+    if (previous + fixedPoint < previous) atomicAdd(guideRecords[slot + 1u], 1u);
+}
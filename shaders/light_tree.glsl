@@ -0,0 +1,122 @@
+// Light BVH built by LightTree over the emissive spheres, tores and triangles, included by lighting.glsl
+// A light is picked by walking down from the root, each child chosen in proportion to its importance seen from the
+// shaded point, an upper bound of the light it can send there (LightBounds::Importance of PBRT v4)
+
+struct LightNode {
+    vec3 boundsMin;
+    float power;
+    vec3 boundsMax;
+    float cosThetaO;  // normals within thetaO of axis
+    vec3 axis;
+    float cosThetaE;  // emission up to thetaE away from the normals
+    int secondChild;  // -1 for a leaf, the first child follows the node
+    int type;
+    int idx;
+    int triangleIdx;
+};
+
+layout(std430, binding = 11) readonly buffer LightTreeNodes {
+    LightNode lightNodes[];
+};
+
+// Branches from the root to each emitter, bit i set for the second child at depth i, see LightTree::trailIndex
+layout(std430, binding = 12) readonly buffer LightTreeTrails {
+    uint lightTrails[];
+};
+
+uniform bool useLightTree;
+uniform int lightTreeSize;
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of the angles
+float cosSubClamped(float sinA, float cosA, float sinB, float cosB){
+    return cosA > cosB ? 1.0 : cosA * cosB + sinA * sinB;
+}
+
+float sinSubClamped(float sinA, float cosA, float sinB, float cosB){
+    return cosA > cosB ? 0.0 : sinA * cosB - cosA * sinB;
+}
+
+// Upper bound of the light of the emitters of a node reaching p, for a surface of normal n
+float lightImportance(vec3 p, vec3 n, LightNode node){
+    vec3 center = 0.5 * (node.boundsMin + node.boundsMax);
+    vec3 toPoint = p - center;
+
+    // Inside or close to the bounds, the distance is clamped to half their diagonal
+    float d2 = max(dot(toPoint, toPoint), 0.5 * length(node.boundsMax - node.boundsMin));
+    vec3 wi = normalize(toPoint);
+
+    float cosThetaW = dot(node.axis, wi);
+    float sinThetaW = sqrt(max(0.0, 1.0 - cosThetaW * cosThetaW));
+
+    // Cone of the directions from p to the bounding sphere of the node
+    float radius2 = 0.25 * dot(node.boundsMax - node.boundsMin, node.boundsMax - node.boundsMin);
+    float dist2 = dot(toPoint, toPoint);
+    float cosThetaB = dist2 > radius2 ? sqrt(1.0 - radius2 / dist2) : -1.0;
+    float sinThetaB = sqrt(max(0.0, 1.0 - cosThetaB * cosThetaB));
+
+    // Smallest angle between the emitter normals and the direction to p
+    float sinThetaO = sqrt(max(0.0, 1.0 - node.cosThetaO * node.cosThetaO));
+    float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= node.cosThetaE) return 0.0;
+
+    // Smallest angle between the normal at p and the directions to the node
+    float cosThetaI = -dot(wi, n);
+    float sinThetaI = sqrt(max(0.0, 1.0 - cosThetaI * cosThetaI));
+    float cosThetaPI = cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+
+    return max(node.power * cosThetaP * cosThetaPI / d2, 0.0);
+}
+
+// Picks a leaf, u is rescaled at each node and can be reused, returns false when no emitter can light p
+bool sampleLightTree(vec3 p, vec3 n, inout float u, out LightNode leaf, out float pmf){
+    pmf = 1.0;
+    if (lightTreeSize == 0) return false;
+
+    int node = 0;
+    if (lightNodes[0].secondChild < 0 && lightImportance(p, n, lightNodes[0]) <= 0.0) return false;
+
+    while (lightNodes[node].secondChild >= 0) {
+        int second = lightNodes[node].secondChild;
+        float importance0 = lightImportance(p, n, lightNodes[node + 1]);
+        float importance1 = lightImportance(p, n, lightNodes[second]);
+        if (importance0 + importance1 <= 0.0) return false;
+
+        float p0 = importance0 / (importance0 + importance1);
+        if (u < p0) {
+            node = node + 1;
+            u = min(u / p0, 0.99999994);
+            pmf *= p0;
+        } else {
+            node = second;
+            u = min((u - p0) / (1.0 - p0), 0.99999994);
+            pmf *= 1.0 - p0;
+        }
+    }
+
+    leaf = lightNodes[node];
+    return true;
+}
+
+// Probability that sampleLightTree picks the emitter of a trail
+float lightTreePmf(vec3 p, vec3 n, uint trail){
+    if (lightTreeSize == 0 || trail == 0xFFFFFFFFu) return 0.0;
+
+    int node = 0;
+    if (lightNodes[0].secondChild < 0) return lightImportance(p, n, lightNodes[0]) > 0.0 ? 1.0 : 0.0;
+
+    float pmf = 1.0;
+    while (lightNodes[node].secondChild >= 0) {
+        int second = lightNodes[node].secondChild;
+        float importance0 = lightImportance(p, n, lightNodes[node + 1]);
+        float importance1 = lightImportance(p, n, lightNodes[second]);
+        if (importance0 + importance1 <= 0.0) return 0.0;
+
+        bool isSecond = (trail & 1u) != 0u;
+        pmf *= (isSecond ? importance1 : importance0) / (importance0 + importance1);
+        node = isSecond ? second : node + 1;
+        trail >>= 1;
+    }
+    return pmf;
+}
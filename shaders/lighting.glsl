@@ -0,0 +1,322 @@
+// Light sampling and pdfs of the BSDF lobes for next event estimation and MIS, included after scene.glsl
+
+uniform bool useNEE;
+uniform bool useMIS;
+
+#include "light_tree.glsl"
+#include "guiding.glsl"
+
+float powerHeuristic(float pdf, float otherPdf){
+    return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+}
+
+// pdf of the glossy lobe normalize(mix(diffuseDir, specularDir, smoothness)), diffuseDir being cosine distributed
+// Every diffuseDir mapped to direction lies on the sphere of radius (1 - smoothness) centered on smoothness * specularDir
+float glossyPdf(vec3 direction, vec3 normal, vec3 specularDir, float smoothness){
+    float s = smoothness;
+    float c = dot(direction, specularDir);
+    float disc = s*s*c*c - s*s + (1.0 - s) * (1.0 - s);
+    if (disc < 0.0) return 0.0;
+
+    float pdf = 0.0;
+    for (int i=-1; i<=1; i+=2){
+        float k = s * c + i * sqrt(disc);
+        if (k <= 0.0) continue;
+
+        vec3 diffuseDir = (k * direction - s * specularDir) / (1.0 - s);
+        float cosDiffuse = dot(diffuseDir, normal);
+        if (cosDiffuse <= 0.0) continue;
+
+        // Jacobian from the sphere of diffuse directions to the normalized direction
+        pdf += cosDiffuse / PI * k * k / ((1.0 - s) * (1.0 - s) * max(abs(dot(diffuseDir, direction)), 1e-4));
+    }
+    return pdf;
+}
+
+// pdf of the lobe chosen at a vertex, a mirror lobe (smoothness ~ 1) is a dirac and is never light sampled
+float bsdfPdf(vec3 direction, vec3 normal, vec3 specularDir, Material mat, int isReflexive){
+    if (isReflexive == 0) return max(dot(direction, normal), 0.0) / PI;
+    return glossyPdf(direction, normal, specularDir, mat.smoothness);
+}
+
+// Probability that selectLight picks an emitter, the light list is uniform and the light BVH depends on the
+// position and normal of the vertex, with one chance in two to pick the environment map when there is one
+float environmentSelectionProbability(){
+    if (!useEnvironmentMap) return 0.0;
+    if (!useLightTree) return 1.0 / lightCount;
+    return lightTreeSize > 0 ? 0.5 : 1.0;
+}
+
+float lightSelectionPmf(vec3 origin, vec3 normal, int type, int idx, int triangleIdx){
+    if (!useLightTree) {
+        float pmf = 1.0 / lightCount;
+        if (type == 2) pmf /= triangleMeshes[idx].endIdx - triangleMeshes[idx].startIdx;
+        return pmf;
+    }
+    if (lightTreeSize == 0) return 0.0;
+
+    uint trail = lightTrails[type == 0 ? idx : (type == 1 ? 10 + idx : 20 + triangleIdx)];
+    return (1.0 - environmentSelectionProbability()) * lightTreePmf(origin, normal, trail);
+}
+
+// Picks the emitter of a light sample: a light of the list and one of its triangles, or a leaf of the light BVH
+// u is rescaled and can be reused, returns false when there is no emitter to sample
+bool selectLight(vec3 origin, vec3 normal, inout float u, out int type, out int idx, out int triangleIdx, out float pmf){
+    triangleIdx = -1;
+    if (lightCount == 0) return false;
+
+    if (!useLightTree) {
+        int l = min(int(u * lightCount), lightCount - 1);
+        u = u * lightCount - l;
+        type = lights[l].type;
+        idx = lights[l].idx;
+        pmf = 1.0 / lightCount;
+
+        if (type == 2) {
+            TriangleMesh mesh = triangleMeshes[idx];
+            int triCount = mesh.endIdx - mesh.startIdx;
+            triangleIdx = mesh.startIdx + min(int(u * triCount), triCount - 1);
+            pmf /= triCount;
+        }
+        return true;
+    }
+
+    float environmentProbability = environmentSelectionProbability();
+    if (u < environmentProbability) {
+        u /= environmentProbability;
+        type = 3;
+        idx = 0;
+        pmf = environmentProbability;
+        return true;
+    }
+    u = (u - environmentProbability) / (1.0 - environmentProbability);
+
+    LightNode leaf;
+    float treePmf;
+    if (!sampleLightTree(origin, normal, u, leaf, treePmf)) return false;
+
+    type = leaf.type;
+    idx = leaf.idx;
+    triangleIdx = leaf.triangleIdx;
+    pmf = (1.0 - environmentProbability) * treePmf;
+    return true;
+}
+
+// Cosine of the half angle of the cone the sphere subtends from origin, shared by the sampling and the pdf so that
+// they agree on which directions the light samples can reach. False inside the sphere: sendRay only hits the
+// spheres from outside, so neither the light samples nor the BSDF rays can reach it from there
+bool sphereCone(Sphere sphere, vec3 origin, out float cosMax){
+    vec3 toCenter = sphere.pos - origin;
+    float sinMax2 = sphere.r * sphere.r / dot(toCenter, toCenter);
+    cosMax = sqrt(max(0.0, 1.0 - sinMax2));
+    return sinMax2 < 1.0;
+}
+
+// Probability that sampleLight picks the direction from origin to the hit point, 0 if the hit is not an emitter
+// A direction it cannot pick has a pdf of 0, and the emission reached by the BSDF ray then keeps its full weight:
+// a light sample that could not be taken never drops the emission of its light
+// normal is the one of the vertex at origin, it changes the choices of the light BVH
+float lightPdf(vec3 origin, vec3 normal, vec3 direction, HitInfo hitInfo){
+    if (hitInfo.mat.emissionStrength <= 0.0) return 0.0;
+
+    float pmf = lightSelectionPmf(origin, normal, hitInfo.objType, hitInfo.objIdx, hitInfo.triangleIdx);
+    if (pmf <= 0.0) return 0.0;
+
+    if (hitInfo.objType == 0) {  // Sphere
+
+        float cosMax;
+        if (!sphereCone(spheres[hitInfo.objIdx], origin, cosMax)) return 0.0;
+
+        return pmf / (2.0 * PI * (1.0 - cosMax));
+    }
+
+    if (hitInfo.objType == 1) {  // Tore, the area pdf of sampleLight is 1 / (4 PI^2 r rho), rho being the distance to the axis
+
+        Tore tore = tores[hitInfo.objIdx];
+        vec3 hitPoint = origin + direction * hitInfo.dist;
+        float cosLight = -dot(direction, hitInfo.normal);
+        if (cosLight <= 0.0) return 0.0;
+
+        float rho = length(hitPoint.xy - tore.pos.xy);
+        return pmf * hitInfo.dist * hitInfo.dist / (cosLight * 4.0 * PI * PI * tore.r * rho);
+    }
+
+    // Triangle
+    Triangle tri = triangles[hitInfo.triangleIdx];
+    float cosLight = -dot(direction, tri.normal);
+    if (cosLight <= 0.0) return 0.0;
+
+    float area = 0.5 * length(cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+    return pmf * hitInfo.dist * hitInfo.dist / (cosLight * area);
+}
+
+// Probability that sampleLight picks a direction leaving the scene, 0 when there is no environment map
+float environmentLightPdf(vec3 direction){
+    if (!useEnvironmentMap) return 0.0;
+    return environmentPdf(direction) * environmentSelectionProbability();
+}
+
+// Point sampled on an emitter, the environment map has no point and position is then the direction
+// The solid angle pdf includes the probability to select the emitter
+struct LightPoint {
+    vec3 position;
+    float pdf;
+    vec3 normal;
+    float distance;   // to the point for the emitters that can hide a part of themselves, -1 otherwise
+    vec3 direction;
+    int type;
+    vec3 emission;
+    int idx;
+    int triangleIdx;  // for the triangles, -1 otherwise
+};
+
+// Point on one emitter picked by selectLight, seen from origin
+// Spheres are sampled in the cone they subtend, triangles and tores by picking a point on their surface,
+// the environment map by its luminance
+// u.x picks the light, u.yz pick the point
+// Returns false when the point cannot light origin
+bool sampleLightPoint(vec3 origin, vec3 normal, vec3 u, out LightPoint light){
+    int triangleIdx;
+    float pmf;
+    if (!selectLight(origin, normal, u.x, light.type, light.idx, triangleIdx, pmf)) return false;
+
+    light.triangleIdx = triangleIdx;
+    light.distance = -1.0;
+
+    if (light.type == 0) {  // Sphere
+
+        Sphere sphere = spheres[light.idx];
+        float cosMax;
+        if (!sphereCone(sphere, origin, cosMax)) return false;
+
+        vec3 toCenter = sphere.pos - origin;
+        float dist2 = dot(toCenter, toCenter);
+        float cosTheta = mix(cosMax, 1.0, u.y);
+        float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+        float phi = 2.0 * PI * u.z;
+
+        vec3 w = toCenter / sqrt(dist2);
+        vec3 u = normalize(cross(abs(w.x) > 0.9 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), w));
+        vec3 v = cross(w, u);
+
+        light.direction = (u * cos(phi) + v * sin(phi)) * sinTheta + w * cosTheta;
+        light.pdf = 1.0 / (2.0 * PI * (1.0 - cosMax));
+        light.emission = sphere.mat.emissionColor * sphere.mat.emissionStrength;
+
+        // First intersection of the direction with the sphere
+        float b = dot(toCenter, light.direction);
+        float t = b - sqrt(max(0.0, sphere.r * sphere.r - dist2 + b * b));
+        light.position = origin + light.direction * t;
+        light.normal = normalize(light.position - sphere.pos);
+
+    } else if (light.type == 1) {  // Tore, uniform angles around the axis (theta) and around the tube (phi)
+
+        Tore tore = tores[light.idx];
+        float theta = 2.0 * PI * u.y;
+        float phi = 2.0 * PI * u.z;
+        float rho = tore.R + tore.r * cos(phi);
+
+        light.normal = vec3(cos(phi) * cos(theta), cos(phi) * sin(theta), sin(phi));
+        light.position = tore.pos + vec3(rho * cos(theta), rho * sin(theta), tore.r * sin(phi));
+
+        vec3 toLight = light.position - origin;
+        float dist2 = dot(toLight, toLight);
+        light.distance = sqrt(dist2);
+        light.direction = toLight / light.distance;
+
+        // Points facing away are hidden by the tore itself
+        float cosLight = -dot(light.direction, light.normal);
+        if (cosLight <= 0.0) return false;
+
+        light.pdf = dist2 / (cosLight * 4.0 * PI * PI * tore.r * rho);
+        light.emission = tore.mat.emissionColor * tore.mat.emissionStrength;
+
+    } else if (light.type == 3) {  // Environment map
+
+        light.direction = sampleEnvironment(u.yz, light.pdf);
+        if (light.pdf <= 0.0) return false;
+        light.emission = environmentRadiance(light.direction);
+        light.position = light.direction;
+        light.normal = vec3(0.0);
+
+    } else {  // Triangle
+
+        Triangle tri = triangles[triangleIdx];
+
+        float su = sqrt(u.y);
+        float b1 = u.z * su;
+        light.position = (1.0 - su) * tri.v0 + b1 * tri.v1 + (su - b1) * tri.v2;
+        light.normal = tri.normal;
+
+        vec3 toLight = light.position - origin;
+        float dist2 = dot(toLight, toLight);
+        light.distance = sqrt(dist2);
+        light.direction = toLight / light.distance;
+
+        // Triangles are one-sided in sendRay
+        float cosLight = -dot(light.direction, tri.normal);
+        if (cosLight <= 0.0) return false;
+
+        float area = 0.5 * length(cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+        light.pdf = dist2 / (cosLight * area);
+        light.emission = triangleMeshes[light.idx].mat.emissionColor * triangleMeshes[light.idx].mat.emissionStrength;
+    }
+
+    light.pdf *= pmf;
+    return true;
+}
+
+// Unoccluded light sample, the emitter is visible if a ray along direction hits it first, at distance for
+// the emitters that can hide a part of themselves (-1 otherwise)
+struct LightSample {
+    vec3 direction;
+    vec3 contribution;
+    int type;
+    int idx;
+    float distance;
+};
+
+// Direct light from a point of an emitter (sampleLightPoint), through the lobe chosen at the vertex
+// Without MIS only the diffuse lobe is light sampled, with a weight of 1
+// Returns false when the sample does not contribute, the shadow ray can then be skipped
+bool sampleLight(vec3 origin, vec3 normal, vec3 specularDir, Material surface, int isReflexive, vec3 u, out LightSample lightSample){
+    lightSample.contribution = vec3(0.0);
+
+    LightPoint light;
+    if (!sampleLightPoint(origin, normal, u, light)) return false;
+
+    float cosSurface = dot(light.direction, normal);
+    if (cosSurface <= 0.0) return false;
+
+    // The lobes were normalized so that a BSDF sample has a weight of color (diffuse) or 1 (glossy),
+    // so brdf * cos is color * cos / PI for the diffuse lobe and the lobe pdf for the glossy one
+    float lobePdf = bsdfPdf(light.direction, normal, specularDir, surface, isReflexive);
+    if (lobePdf <= 0.0) return false;
+    vec3 brdfCos = isReflexive == 0 ? surface.color * lobePdf : vec3(lobePdf);
+
+    // The diffuse directions of the guided vertices are drawn from the mixture with the learned quadtree
+    float samplingPdf = useGuiding && isReflexive == 0 ? diffuseSamplingPdf(guideQuadRoot(origin), normal, light.direction) : lobePdf;
+    float weight = useMIS ? powerHeuristic(light.pdf, samplingPdf) : 1.0;
+
+    lightSample.direction = light.direction;
+    lightSample.contribution = light.emission * brdfCos * weight / light.pdf;
+    lightSample.type = light.type;
+    lightSample.idx = light.idx;
+    lightSample.distance = light.distance;
+    return true;
+}
+
+// Shadow ray of a light sample, the environment map is visible when the ray leaves the scene
+// Another part of a tore or of a concave mesh can be in front of the sampled point
+bool isLightVisible(vec3 origin, LightSample lightSample){
+    HitInfo shadow = sendRay(origin, lightSample.direction);
+    if (lightSample.type == 3) return !shadow.hasHit;
+    if (!shadow.hasHit || shadow.objType != lightSample.type || shadow.objIdx != lightSample.idx) return false;
+    return lightSample.distance < 0.0 || shadow.dist > lightSample.distance * 0.999 - 1e-3;
+}
+
+vec3 sampleLights(vec3 origin, vec3 normal, vec3 specularDir, Material surface, int isReflexive, vec3 u){
+    LightSample lightSample;
+    if (!sampleLight(origin, normal, specularDir, surface, isReflexive, u, lightSample)) return vec3(0.0);
+    return isLightVisible(origin, lightSample) ? lightSample.contribution : vec3(0.0);
+}
@@ -0,0 +1,242 @@
+// Path tracer shared by compute_shader.glsl and compute_shader_persistent.glsl
+// The including shader declares a 16 x 16 local size, the tile size, before including this file
+
+// Accumulated color, the alpha channel holds the number of samples of the pixel
+layout(rgba32f, binding = 0) uniform image2D imgOutput;
+// Running mean and sum of squared deviations of the sample luminance (Welford), read by adaptive_tiles.glsl
+// The third channel is the index of the next sample of the pixel, which only increases: after a reprojection
+// the sample count of the pixel restarts lower, while its next samples must not repeat the sequence points
+layout(rgba32f, binding = 2) uniform image2D varianceImage;
+
+// With adaptive sampling only the tiles listed by adaptive_tiles.glsl are rendered
+// The CPU reads listedTiles one pass late, the work groups past it render nothing
+layout(std430, binding = 2) buffer TileList {
+    uint listedTiles;
+    uint tiles[];
+};
+
+uniform bool useTileList;
+uniform int frameCount;
+uniform int spp; // samples per pixel and per dispatch
+
+uniform int maxBounces;
+
+// Paths longer than rrMinDepth segments survive with a probability given by their throughput
+uniform bool useRussianRoulette;
+uniform int rrMinDepth;
+
+#include "scene.glsl"
+#include "sampler.glsl"
+#include "lighting.glsl"
+#include "probe_cache.glsl"
+#include "restir.glsl"
+#include "raster_primary.glsl"
+#include "cached_primary.glsl"
+#include "display_image.glsl"
+
+// Path between two bounces
+struct Path {
+    Sampler sampler;
+    vec3 origin;
+    vec3 rayDirection;
+    vec3 matColor;
+    vec3 emiColor;
+    int depth;
+
+    // Emitters of the light list reached after a light sampled vertex were already accounted for:
+    // their emission is skipped without MIS, or weighted against the light sampling pdf with it
+    bool sampledLights;
+    vec3 prevOrigin;
+    vec3 prevNormal;
+    float prevBsdfPdf;
+
+    ivec2 rasterHit; // triangle hit by the camera ray, with useRasterPrimary
+
+    float guidePdf; // pdf of the direction leaving the last vertex when it is recorded for the guiding, 0 otherwise
+};
+
+// Camera ray through the pixel
+Path startPath(ivec2 pixelCoord, int sampleIndex) {
+
+    float aspect = float(width) / float(height);
+
+    Path path;
+    path.sampler = initSampler(pixelCoord, sampleIndex);
+
+    // Sub-pixel jitter, the accumulation averages the pixel footprint
+    vec2 jitter = sample4D(path.sampler, 0u).xy;
+    if (usePrimaryCache) {
+        // Camera ray of the cached sample
+        Sampler cachedSampler = initSampler(pixelCoord, sampleIndex % primaryCacheStrata);
+        jitter = sample4D(cachedSampler, 0u).xy;
+    } else if (useRasterPrimary) {
+        jitter = primaryJitter;
+        path.rasterHit = loadRasterHit(pixelCoord);
+    }
+
+    vec3 rayDirection = getCameraRay(45.0, aspect, (vec2(pixelCoord) + jitter) / vec2(width, height));
+    path.rayDirection = (vec4(rayDirection, 1.0) * viewMatrix).xyz;
+
+    path.origin = cameraPosition;
+
+    path.matColor = vec3(1.0);
+    path.emiColor = vec3(0.0);
+    path.depth = 0;
+
+    path.sampledLights = false;
+    path.guidePdf = 0.0;
+
+    return path;
+}
+
+// Traces one segment of the path and samples the next one, false once the path has ended
+bool extendPath(inout Path path) {
+    int m = path.depth;
+
+    HitInfo hitInfo;
+    if (usePrimaryCache && m == 0) hitInfo = loadCachedHit(path.origin, path.rayDirection, path.sampler.pixel, int(path.sampler.index));
+    else if (useRasterPrimary && m == 0) hitInfo = sendPrimaryRay(path.origin, path.rayDirection, path.rasterHit);
+    else hitInfo = sendRay(path.origin, path.rayDirection);
+
+    if (!hitInfo.hasHit) {
+        // The environment map is in the light list, weighted like the emitters
+        float envWeight = 1.0;
+        if (path.sampledLights) {
+            float pdf = dot(path.rayDirection, path.prevNormal) > 0.0 ? environmentLightPdf(path.rayDirection) : 0.0;
+            if (pdf > 0.0) envWeight = useMIS ? powerHeuristic(path.prevBsdfPdf, pdf) : 0.0;
+        }
+        path.emiColor += getAmbientLight(path.rayDirection) * path.matColor * envWeight;
+        return false;
+    }
+
+    vec3 rayDirection = path.rayDirection;
+    vec3 origin = hitInfo.nextOrigin;
+    vec3 normal = hitInfo.normal;
+    Material mat = hitInfo.mat;
+
+    float emiWeight = 1.0;
+    if (path.sampledLights) {
+        // Light samples below the surface are discarded, so glossy rays going there are never light sampled
+        float pdf = dot(rayDirection, path.prevNormal) > 0.0 ? lightPdf(path.prevOrigin, path.prevNormal, rayDirection, hitInfo) : 0.0;
+        if (pdf > 0.0) emiWeight = useMIS ? powerHeuristic(path.prevBsdfPdf, pdf) : 0.0;
+    }
+    path.emiColor += mat.emissionColor * mat.emissionStrength * path.matColor * emiWeight;
+
+    // Preview integrator: after one bounce the path ends with the diffuse light reflected from the irradiance probes
+    if (useProbeCache && m == 1) {
+        path.emiColor += sampleProbes(origin, normal) * mat.color / PI * path.matColor;
+        return false;
+    }
+
+    // Two 4D patterns per bounce: direction and lobe, then light sample and roulette
+    vec4 u = sample4D(path.sampler, uint(2 * m + 1));
+    vec4 v = sample4D(path.sampler, uint(2 * m + 2));
+
+    vec3 diffuseDir = cosineHemisphere(u.xy, normal);
+    vec3 specularDir = rayDirection - 2.0*dot(rayDirection, normal) * normal;
+
+    int isReflexive = int(mat.reflexivity > u.z);
+
+    // Guided diffuse bounce: the direction comes from the learned quadtree of the vertex with probability GUIDING_FRACTION
+    int guideRoot = useGuiding && isReflexive == 0 ? guideQuadRoot(origin) : -1;
+    if (guideRoot >= 0 && v.w < GUIDING_FRACTION) diffuseDir = sampleGuide(guideRoot, u.xy);
+
+    rayDirection = mix(diffuseDir, specularDir, mat.smoothness * isReflexive);
+    rayDirection = normalize(rayDirection);
+
+    float diffusePdf = isReflexive == 0 ? diffuseSamplingPdf(guideRoot, normal, rayDirection) : 0.0;
+
+    // The light sample adds one segment to the path, like the next bounce would
+    bool isMirror = isReflexive == 1 && mat.smoothness > 0.99;
+    path.sampledLights = useNEE && (useMIS ? !isMirror : isReflexive == 0) && m < maxBounces - 1;
+    if (path.sampledLights) {
+        // The reservoirs have no pdf to weight the emitters reached by the BSDF ray against, they are skipped
+        bool useReservoir = useReSTIR && m == 0 && isReflexive == 0;
+        if (useReservoir) {
+            uint seed = hashCombine(path.sampler.seed, ~path.sampler.index);
+            path.emiColor += restirDirectLight(path.sampler.pixel, seed, origin, normal, mat.color) * path.matColor;
+        } else {
+            vec3 lightSample = vec3(u.w, v.xy);
+            path.emiColor += sampleLights(origin, normal, specularDir, mat, isReflexive, lightSample) * path.matColor;
+        }
+
+        path.prevOrigin = origin;
+        path.prevNormal = normal;
+        path.prevBsdfPdf = useReservoir ? 0.0 : (isReflexive == 0 ? diffusePdf : bsdfPdf(rayDirection, normal, specularDir, mat, isReflexive));
+    }
+
+    // The guided diffuse directions are weighted by the cosine lobe over the mixture pdf, the cosine samples by 1
+    float diffuseWeight = 1.0;
+    if (guideRoot >= 0) diffuseWeight = diffusePdf > 0.0 ? max(dot(rayDirection, normal), 0.0) / (PI * diffusePdf) : 0.0;
+    path.matColor *= mix(mat.color * diffuseWeight, vec3(1.0), isReflexive);
+    path.guidePdf = recordGuiding ? diffusePdf : 0.0;
+
+    path.origin = origin;
+    path.rayDirection = rayDirection;
+    path.depth = m + 1;
+    if (diffuseWeight <= 0.0) return false;
+
+    // Unbiased termination: surviving paths are reweighted by 1 / probability
+    // maxBounces stays as a safety cap for paths trapped between bright surfaces
+    // Without roulette the dark paths are cut as before it, biased but at the same cost
+    if (useRussianRoulette && m + 1 >= rrMinDepth) {
+        float survival = min(max(path.matColor.x, max(path.matColor.y, path.matColor.z)), 0.95);
+        if (v.z >= survival) return false;
+        path.matColor /= survival;
+    } else if (!useRussianRoulette && max(path.matColor.x, max(path.matColor.y, path.matColor.z)) < 0.005) {
+        return false;
+    }
+
+    return path.depth < maxBounces;
+}
+
+// Radiance of one camera path through the pixel
+vec3 tracePath(ivec2 pixelCoord, int sampleIndex) {
+    Path path = startPath(pixelCoord, sampleIndex);
+
+    // Guiding training (path.guidePdf > 0 only with recordGuiding): the radiance reaching a diffuse vertex is the
+    // light gathered by the path after it, divided by the throughput of the path up to its next segment
+    // (luminances, to keep the records small)
+    const vec3 luminance = vec3(0.2126, 0.7152, 0.0722);
+    uint slots[GUIDE_RECORDED_VERTICES];
+    float emissions[GUIDE_RECORDED_VERTICES];
+    float throughputs[GUIDE_RECORDED_VERTICES]; // times the pdf of the direction
+    int recorded = 0;
+
+    while (extendPath(path)) {
+        if (path.guidePdf > 0.0 && recorded < GUIDE_RECORDED_VERTICES) {
+            slots[recorded] = guideRecordSlot(path.origin, path.rayDirection);
+            emissions[recorded] = dot(path.emiColor, luminance);
+            throughputs[recorded] = dot(path.matColor, luminance) * path.guidePdf;
+            recorded++;
+        }
+    }
+
+    float gathered = dot(path.emiColor, luminance);
+    for (int i = 0; i < recorded; i++) {
+        if (throughputs[i] > 0.0) recordGuideSample(slots[i], (gathered - emissions[i]) / throughputs[i]);
+    }
+    return path.emiColor;
+}
+
+// Running mean of the pixel color and Welford update of the luminance moments
+void addSample(vec3 emiColor, inout vec3 color, inout float sampleCount, inout vec2 moments) {
+    sampleCount += 1.0;
+    color += (emiColor - color) / sampleCount;
+
+    float luminance = dot(emiColor, vec3(0.2126, 0.7152, 0.0722));
+    float delta = luminance - moments.x;
+    moments.x += delta / sampleCount;
+    moments.y += delta * (luminance - moments.x);
+}
+
+// First pixel of a tile, the tiles are the work groups of compute_shader.glsl
+ivec2 tileOrigin(uint tileIdx) {
+    if (useTileList) {
+        if (tileIdx >= listedTiles) return ivec2(width, height); // outside the image, skipped by the callers
+        uint tile = tiles[tileIdx];
+        return ivec2(tile & 0xffffu, tile >> 16) * ivec2(gl_WorkGroupSize.xy);
+    }
+    int tilesX = (width + int(gl_WorkGroupSize.x) - 1) / int(gl_WorkGroupSize.x);
+    return ivec2(int(tileIdx) % tilesX, int(tileIdx) / tilesX) * ivec2(gl_WorkGroupSize.xy);
+}
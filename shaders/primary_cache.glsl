@@ -0,0 +1,25 @@
+#version 430 core
+
+// Fills the primary hit cache of cached_primary.glsl, one layer per stratum (gl_GlobalInvocationID.z)
+// The camera rays are those of startPath for the sample indices 0 to primaryCacheStrata - 1
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+#include "scene.glsl"
+#include "sampler.glsl"
+#include "cached_primary.glsl"
+
+void main() {
+    ivec2 pixelCoord = ivec2(gl_GlobalInvocationID.xy);
+    int stratum = int(gl_GlobalInvocationID.z);
+    if (pixelCoord.x >= width || pixelCoord.y >= height) return;
+
+    Sampler sampler = initSampler(pixelCoord, stratum);
+    vec2 jitter = sample4D(sampler, 0u).xy;
+
+    float aspect = float(width) / float(height);
+    vec3 rayDirection = getCameraRay(45.0, aspect, (vec2(pixelCoord) + jitter) / vec2(width, height));
+    rayDirection = (vec4(rayDirection, 1.0) * viewMatrix).xyz;
+
+    imageStore(primaryCache, ivec3(pixelCoord, stratum), uvec4(packCachedHit(sendRay(cameraPosition, rayDirection)), 0u, 0u));
+}
@@ -0,0 +1,71 @@
+// Irradiance probe cache of the preview integrator, included by path_tracer.glsl
+// ProbeGrid places one probe at the center of each cell of a regular grid over the scene, and path traces a few of
+// them per frame in the background (compute_shader_probes.glsl): each probe holds the incident radiance projected
+// on the L1 spherical harmonics, one vec4 per color channel, from which the irradiance around any normal follows
+// With useProbeCache the paths end after one bounce, the second vertex reflecting the irradiance of the probes
+
+// Coefficients (Y00, Y1 along x, y, z) of the red, green and blue radiance, info.x is the sample count of the probe
+// and info.y the fraction of its rays starting on a back face (the probe is inside an object)
+struct IrradianceProbe {
+    vec4 red;
+    vec4 green;
+    vec4 blue;
+    vec4 info;
+};
+
+layout(std430, binding = 26) buffer IrradianceProbes {
+    IrradianceProbe probes[];
+};
+
+uniform bool useProbeCache;
+uniform vec3 probeGridMin;
+uniform float probeSpacing;
+uniform ivec3 probeCounts;
+
+#define PROBE_MAX_BACKFACES 0.25 // probes seeing more back faces are inside an object and not interpolated
+
+// L1 spherical harmonics basis
+vec4 shBasis(vec3 d){
+    return vec4(0.282095, 0.488603 * d);
+}
+
+vec3 probePosition(ivec3 p){
+    return probeGridMin + (vec3(p) + 0.5) * probeSpacing;
+}
+
+int probeIndex(ivec3 p){
+    return p.x + probeCounts.x * (p.y + probeCounts.y * p.z);
+}
+
+// Irradiance around the normal: the radiance convolved with the clamped cosine (Ramamoorthi and Hanrahan 2001)
+vec3 probeIrradiance(int idx, vec3 normal){
+    vec4 c = vec4(PI, vec3(2.0 * PI / 3.0)) * shBasis(normal);
+    return max(vec3(dot(probes[idx].red, c), dot(probes[idx].green, c), dot(probes[idx].blue, c)), vec3(0.0));
+}
+
+// Trilinear interpolation of the 8 probes around the point, the probes behind the surface weighted down
+// (wrapped cosine of DDGI, Majercik et al. 2019), the empty probes and the ones inside objects skipped
+vec3 sampleProbes(vec3 position, vec3 normal){
+    vec3 g = clamp((position - probeGridMin) / probeSpacing - 0.5, vec3(0.0), vec3(probeCounts - 1));
+    ivec3 base = min(ivec3(g), max(probeCounts - 2, ivec3(0)));
+    vec3 t = g - vec3(base);
+
+    vec3 irradiance = vec3(0.0);
+    float weightSum = 0.0;
+    for (int i = 0; i < 8; i++) {
+        ivec3 offset = ivec3(i & 1, (i >> 1) & 1, i >> 2);
+        ivec3 p = min(base + offset, probeCounts - 1);
+        int idx = probeIndex(p);
+        vec4 info = probes[idx].info;
+        if (info.x <= 0.0 || info.y > PROBE_MAX_BACKFACES) continue;
+
+        vec3 trilinear = mix(1.0 - t, t, vec3(offset));
+        vec3 toProbe = probePosition(p) - position;
+        float wrap = dot(toProbe, toProbe) > 1e-8 ? 0.5 * (dot(normalize(toProbe), normal) + 1.0) : 1.0;
+        float weight = max(trilinear.x * trilinear.y * trilinear.z, 1e-4) * (wrap * wrap + 0.2);
+
+        irradiance += probeIrradiance(idx, normal) * weight;
+        weightSum += weight;
+    }
+    return weightSum > 0.0 ? irradiance / weightSum : vec3(0.0);
+}
@@ -0,0 +1,38 @@
+// Hybrid primary visibility, included after scene.glsl by the path tracers
+// GBuffer rasterizes the triangle meshes once per pass with a sub-pixel jitter shared by all the pixels: the camera rays
+// of the pass go through the rasterized sample positions and only test the triangle seen there, plus the spheres and
+// tores that are not rasterized, instead of every triangle of the scene
+
+// x: index in triangleMeshes, y: index in triangles, -1 when no triangle covers the pixel
+layout(rg32i, binding = 1) uniform readonly iimage2D primaryHits;
+
+uniform bool useRasterPrimary;
+uniform vec2 primaryJitter; // sub-pixel position of the rasterized samples
+
+ivec2 loadRasterHit(ivec2 pixelCoord) {
+    return imageLoad(primaryHits, pixelCoord).xy;
+}
+
+// Same closest hit as sendRay for a camera ray through the rasterized sample of the pixel
+HitInfo sendPrimaryRay(vec3 origin, vec3 direction, ivec2 rasterHit){
+    int nextObj = -1;
+    float intersection = 1.0 / 0.0;
+
+    int hitType = -1;
+
+    intersectAnalytic(origin, direction, intersection, nextObj, hitType);
+
+    // The rasterizer already did the coverage test and kept the nearest front face
+    int j = rasterHit.y;
+    if (j >= 0) {
+        float dirNormal = dot(direction, triangles[j].normal);
+        float t = dirNormal < 0 ? dot(triangles[j].v0 - origin, triangles[j].normal) / dirNormal : 0.0;
+        if (t > 0 && t < intersection){
+            intersection = t;
+            hitType = 2;
+            nextObj = rasterHit.x;
+        }
+    }
+
+    return getHitInfo(origin, direction, intersection, nextObj, hitType, j);
+}
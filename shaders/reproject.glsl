@@ -0,0 +1,135 @@
+#version 430 core
+
+// Temporal reprojection of the accumulated image after a camera move
+// The center ray of every pixel is traced for the new camera and its first hit (normal, distance) stored,
+// then the point it hits is projected into the view of the history camera and the history pixels around it are
+// filtered, each one weighted by how well its own first hit matches (depth and normal tests), as is the sample count
+// Silhouette pixels are not reprojected, their color mixes surfaces in proportions that depend on the view
+// The sample index of a pixel goes on from the largest one around, it never goes back to a sample already taken
+// With reprojectHistory = false only the first hits are stored, for the camera of a new accumulation
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(rgba32f, binding = 0) uniform writeonly image2D imgOutput;
+layout(rgba32f, binding = 2) uniform writeonly image2D varianceImage;
+
+// Copies of the accumulated and variance images before the move
+layout(rgba32f, binding = 3) uniform readonly image2D historyImage;
+layout(rgba32f, binding = 4) uniform readonly image2D historyVariance;
+
+// Normal and distance of the first hit of the pixel center, distance 0 when the ray leaves the scene
+layout(rgba32f, binding = 5) uniform writeonly image2D firstHits;
+layout(rgba32f, binding = 6) uniform readonly image2D historyFirstHits;
+
+uniform bool reprojectHistory;
+uniform vec3 historyCameraPosition;
+uniform mat4 historyViewMatrix;
+
+#define DEPTH_TOLERANCE 0.05   // relative distance difference at which the history is rejected
+#define NORMAL_TOLERANCE 0.9   // cosine between the normals at which the history is rejected
+
+#include "scene.glsl"
+#include "display_image.glsl"
+
+// Whether two first hits are on the same surface, 1 when they match and 0 past the tolerances
+float matchFirstHits(vec4 a, vec4 b) {
+    if (a.w == 0.0 || b.w == 0.0) return float(a.w == b.w);
+
+    float depthWeight = 1.0 - abs(a.w - b.w) / (b.w * DEPTH_TOLERANCE);
+    float normalWeight = (dot(a.xyz, b.xyz) - NORMAL_TOLERANCE) / (1.0 - NORMAL_TOLERANCE);
+    return clamp(depthWeight, 0.0, 1.0) * clamp(normalWeight, 0.0, 1.0);
+}
+
+// Pixels on a silhouette average several surfaces, in proportions that change with the view
+bool isSilhouette(ivec2 pixel, vec4 firstHit) {
+    const ivec2 neighbors[4] = ivec2[](ivec2(1, 0), ivec2(-1, 0), ivec2(0, 1), ivec2(0, -1));
+    for (int i = 0; i < 4; i++) {
+        ivec2 neighbor = clamp(pixel + neighbors[i], ivec2(0), ivec2(width, height) - 1);
+        if (matchFirstHits(imageLoad(historyFirstHits, neighbor), firstHit) == 0.0) return true;
+    }
+    return false;
+}
+
+// Continuous pixel coordinates of a world direction seen by a camera, pixel centers at .5
+// Inverse of the camera rays of startPath, x < 0 behind the camera
+vec2 projectToPixel(vec3 direction, mat4 view) {
+    vec3 d = mat3(view) * direction;
+    if (d.z >= 0.0) return vec2(-1.0);
+
+    float focalLength = 1.0 / tan(0.5 * 45.0 * 3.14159265359 / 180.0);
+    float aspect = float(width) / float(height);
+    vec2 pos = vec2(d.x / aspect, d.y) * focalLength / -d.z;
+
+    return (pos * 0.5 + 0.5) * vec2(width, height);
+}
+
+void main() {
+    ivec2 pixelCoord = ivec2(gl_GlobalInvocationID.xy);
+    if (pixelCoord.x >= width || pixelCoord.y >= height) return;
+
+    float aspect = float(width) / float(height);
+    vec3 rayDirection = getCameraRay(45.0, aspect, (vec2(pixelCoord) + 0.5) / vec2(width, height));
+    rayDirection = normalize((vec4(rayDirection, 1.0) * viewMatrix).xyz);
+
+    HitInfo hitInfo = sendRay(cameraPosition, rayDirection);
+    vec4 firstHit = hitInfo.hasHit ? vec4(hitInfo.normal, hitInfo.dist) : vec4(0.0);
+    imageStore(firstHits, pixelCoord, firstHit);
+
+    if (!reprojectHistory) return;
+
+    // Same point, or same background direction, seen from the history camera
+    vec3 historyDirection = hitInfo.hasHit ? cameraPosition + rayDirection * hitInfo.dist - historyCameraPosition : rayDirection;
+    vec4 currentHit = vec4(firstHit.xyz, hitInfo.hasHit ? length(historyDirection) : 0.0); // seen from the history camera
+    vec2 historyCoord = projectToPixel(historyDirection, historyViewMatrix) - 0.5;
+
+    // Bilinear filter over the 4 history pixels around the point, each one weighted by its first hit match
+    ivec2 base = ivec2(floor(historyCoord));
+    vec2 f = historyCoord - vec2(base);
+
+    vec4 color = vec4(0.0);
+    vec2 moments = vec2(0.0);
+    float totalWeight = 0.0;
+    float sampleIndex = imageLoad(historyVariance, pixelCoord).z;
+
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 historyPixel = base + offset;
+        if (any(lessThan(historyPixel, ivec2(0))) || historyPixel.x >= width || historyPixel.y >= height) continue;
+
+        vec4 historyVarianceTexel = imageLoad(historyVariance, historyPixel);
+        sampleIndex = max(sampleIndex, historyVarianceTexel.z);
+
+        vec4 historyHit = imageLoad(historyFirstHits, historyPixel);
+
+        float weight = matchFirstHits(historyHit, currentHit);
+        if (weight == 0.0 || isSilhouette(historyPixel, historyHit)) continue;
+
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        weight *= bilinear.x * bilinear.y;
+
+        vec4 history = imageLoad(historyImage, historyPixel);
+        vec2 historyMoments = historyVarianceTexel.xy;
+
+        color += weight * history;
+        moments += weight * vec2(historyMoments.x, historyMoments.y / max(history.w, 1.0));
+        totalWeight += weight;
+    }
+
+    if (totalWeight > 0.0) {
+        // The bilinear blur is traded for new samples, a tap off the pixel center keeps half its samples
+        float blur = 4.0 * max(f.x * (1.0 - f.x), f.y * (1.0 - f.y));
+        float sampleCount = color.w * (1.0 - 0.5 * blur);
+
+        if (sampleCount > 0.0) {
+            color = vec4(color.rgb / totalWeight, sampleCount);
+            moments = vec2(moments.x / totalWeight, moments.y / totalWeight * sampleCount);
+        } else {
+            color = vec4(0.0);
+            moments = vec2(0.0);
+        }
+    }
+
+    imageStore(imgOutput, pixelCoord, color);
+    imageStore(varianceImage, pixelCoord, vec4(moments, sampleIndex, 0.0));
+    storeDisplay(pixelCoord, color.rgb, color.w);
+}
@@ -0,0 +1,261 @@
+// Spatiotemporal reservoir resampling of the direct light at the first vertex of the camera paths
+// (ReSTIR, Bitterli et al. 2020), included by path_tracer.glsl after lighting.glsl
+// A path resamples restirCandidates light samples of sampleLightPoint by their unshadowed contribution, then merges
+// the reservoirs left by the previous pass at its pixel and at RESTIR_NEIGHBORS random pixels around it, when their
+// first vertex looks like its own. One shadow ray shades the selected sample, an occluded sample is dropped before
+// the reservoir is stored for the next pass
+// The merged reservoirs are weighted by the balance heuristic of their target pdfs (generalized RIS), so a sample
+// unlikely at the pixel that drew it does not become a firefly where it matters more
+// The reuse is still biased: the reused samples are not checked against the visibility at the pixels that drew
+// them, and a reservoir whose sample was occluded is not reused, which shifts the penumbras a little, a trade for
+// the noise of the interactive previews
+// Only the diffuse lobe uses the reservoirs, the glossy lobes keep the light sample of lighting.glsl
+
+// Light sample of a reservoir: a point of an emitter, or a direction of the environment map
+struct Reservoir {
+    vec3 lightPosition;
+    float weight;          // unbiased contribution weight of the sample (W)
+    vec3 shadingPosition;  // first vertex the reservoir was built for
+    uint countAndLight;    // candidates seen (M) << 8 | light type << 4 | light idx
+    uint lightNormal;      // octahedral
+    uint shadingNormal;
+};
+
+// Written by the previous pass and by the current one, swapped by LightReservoirs at the end of each pass
+layout(std430, binding = 13) readonly buffer PreviousReservoirs {
+    Reservoir previousReservoirs[];
+};
+
+layout(std430, binding = 14) writeonly buffer Reservoirs {
+    Reservoir reservoirs[];
+};
+
+uniform bool useReSTIR;
+uniform bool reservoirHistory;  // previousReservoirs match the image size and the scene
+uniform int restirCandidates;
+
+#define RESTIR_NEIGHBORS 1
+#define RESTIR_RADIUS 20.0          // pixels
+#define RESTIR_HISTORY 20.0         // a reused reservoir counts for at most 20 times the candidates of a path
+#define RESTIR_DEPTH_TOLERANCE 0.1  // relative difference of the distances to the camera
+#define RESTIR_NORMAL_TOLERANCE 0.9 // cosine between the normals
+
+uint packNormal(vec3 n){
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+    return packSnorm2x16(e);
+}
+
+vec3 unpackNormal(uint octahedral){
+    vec2 e = unpackSnorm2x16(octahedral);
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
+// Selected sample and running sums of a reservoir being built
+struct ReservoirState {
+    vec3 lightPosition;
+    vec3 lightNormal;
+    int lightType;
+    int lightIdx;
+    float weightSum;
+    float target;  // target pdf of the selected sample
+};
+
+// Reservoir merged into the one of a path: its sample, and the first vertex it was built for
+struct ReservoirInput {
+    vec3 lightPosition;
+    float weight;       // W
+    vec3 lightNormal;
+    float sampleCount;  // M
+    vec3 position;
+    int lightType;
+    vec3 normal;
+    int lightIdx;
+};
+
+// Target pdf of a light sample at a diffuse vertex: luminance of its unshadowed contribution without the albedo,
+// in the measure of the sample (area for the emitters, solid angle for the environment map)
+// radiance is the emission times the geometry term, direction and distance are the ones of the shadow ray
+float reservoirTarget(vec3 origin, vec3 normal, vec3 lightPosition, vec3 lightNormal, int lightType, int lightIdx,
+                      out vec3 radiance, out vec3 direction, out float distance){
+    radiance = vec3(0.0);
+    distance = -1.0;
+
+    if (lightType == 3) {
+        direction = lightPosition;
+        radiance = environmentRadiance(direction);
+    } else {
+        vec3 toLight = lightPosition - origin;
+        float dist2 = dot(toLight, toLight);
+        float dist = sqrt(dist2);
+        direction = toLight / dist;
+        if (lightType != 0) distance = dist;
+
+        float cosLight = -dot(direction, lightNormal);
+        if (cosLight <= 0.0) return 0.0;
+
+        Material mat = getMaterial(lightType, lightIdx);
+        radiance = mat.emissionColor * mat.emissionStrength * cosLight / dist2;
+    }
+
+    float cosSurface = dot(direction, normal);
+    if (cosSurface <= 0.0) return 0.0;
+
+    radiance *= cosSurface / PI;
+    return dot(radiance, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Target pdf of the sample of an input at the first vertex of another one
+float inputTarget(ReservoirInput vertex, ReservoirInput sampleInput){
+    vec3 radiance, direction;
+    float distance;
+    return reservoirTarget(vertex.position, vertex.normal, sampleInput.lightPosition, sampleInput.lightNormal,
+                           sampleInput.lightType, sampleInput.lightIdx, radiance, direction, distance);
+}
+
+// Weighted reservoir sampling: the new sample replaces the selected one with probability weight / weightSum
+void addToReservoir(inout ReservoirState r, vec3 lightPosition, vec3 lightNormal, int lightType, int lightIdx,
+                    float target, float weight, float u){
+    r.weightSum += weight;
+    if (weight > 0.0 && u * r.weightSum < weight) {
+        r.lightPosition = lightPosition;
+        r.lightNormal = lightNormal;
+        r.lightType = lightType;
+        r.lightIdx = lightIdx;
+        r.target = target;
+    }
+}
+
+// Reservoir left by the previous pass at a pixel, false when its first vertex does not look like the one of the path
+bool readReservoir(ivec2 pixel, vec3 origin, vec3 normal, out ReservoirInput previousInput){
+    Reservoir previous = previousReservoirs[pixel.y * width + pixel.x];
+
+    previousInput.lightPosition = previous.lightPosition;
+    previousInput.weight = previous.weight;
+    previousInput.lightNormal = unpackNormal(previous.lightNormal);
+    previousInput.sampleCount = min(float(previous.countAndLight >> 8), RESTIR_HISTORY * float(restirCandidates));
+    previousInput.position = previous.shadingPosition;
+    previousInput.lightType = int(previous.countAndLight >> 4) & 0xf;
+    previousInput.normal = unpackNormal(previous.shadingNormal);
+    previousInput.lightIdx = int(previous.countAndLight) & 0xf;
+    if (previousInput.sampleCount == 0.0 || previousInput.weight <= 0.0) return false;
+
+    float depth = length(origin - cameraPosition);
+    if (abs(length(previousInput.position - cameraPosition) - depth) > RESTIR_DEPTH_TOLERANCE * depth) return false;
+    return dot(previousInput.normal, normal) >= RESTIR_NORMAL_TOLERANCE;
+}
+
+// Shadow ray toward a light sample, radiance is its unshadowed contribution without the albedo
+bool isInputSampleVisible(vec3 origin, vec3 normal, ReservoirInput sampleInput, out vec3 radiance){
+    vec3 direction;
+    float distance;
+    reservoirTarget(origin, normal, sampleInput.lightPosition, sampleInput.lightNormal, sampleInput.lightType, sampleInput.lightIdx,
+                    radiance, direction, distance);
+
+    LightSample lightSample;
+    lightSample.direction = direction;
+    lightSample.type = sampleInput.lightType;
+    lightSample.idx = sampleInput.lightIdx;
+    lightSample.distance = distance;
+    return isLightVisible(origin, lightSample);
+}
+
+// Direct light of a diffuse first vertex of albedo color, from its reservoir, and stores the reservoir for the next pass
+vec3 restirDirectLight(ivec2 pixel, uint seed, vec3 origin, vec3 normal, vec3 color){
+    uint state = seed;
+
+    ReservoirState r;
+    r.lightType = -1;
+    r.lightIdx = 0;
+    r.weightSum = 0.0;
+    r.target = 0.0;
+
+    // Candidates weighted by target / source pdf, in solid angle for both: the geometry terms cancel out
+    for (int i = 0; i < restirCandidates; i++) {
+        vec3 u = vec3(random(state), random(state), random(state));
+        LightPoint light;
+        if (!sampleLightPoint(origin, normal, u, light)) continue;
+
+        vec3 radiance, direction;
+        float distance;
+        float target = reservoirTarget(origin, normal, light.position, light.normal, light.type, light.idx, radiance, direction, distance);
+        float solidAngleTarget = dot(light.emission, vec3(0.2126, 0.7152, 0.0722)) * max(dot(light.direction, normal), 0.0) / PI;
+
+        float weight = target > 0.0 ? solidAngleTarget / light.pdf : 0.0;
+        addToReservoir(r, light.position, light.normal, light.type, light.idx, target, weight, random(state));
+    }
+
+    // The reservoir of the candidates, then the ones of the pixel and of the neighbors in the previous pass
+    ReservoirInput inputs[2 + RESTIR_NEIGHBORS];
+    inputs[0] = ReservoirInput(r.lightPosition, r.target > 0.0 ? r.weightSum / (float(restirCandidates) * r.target) : 0.0,
+                               r.lightNormal, float(restirCandidates), origin, max(r.lightType, 0), normal, r.lightIdx);
+
+    // Visibility reuse: an occluded candidate is dropped before the merge, so the reservoirs passed to the next
+    // pass hold the light that reaches their pixel
+    vec3 radiance = vec3(0.0);
+    bool isVisible = inputs[0].weight > 0.0 && isInputSampleVisible(origin, normal, inputs[0], radiance);
+    if (!isVisible) inputs[0].weight = 0.0;
+
+    int inputCount = 1;
+    if (reservoirHistory) {
+        if (readReservoir(pixel, origin, normal, inputs[inputCount])) inputCount++;
+
+        for (int i = 0; i < RESTIR_NEIGHBORS; i++) {
+            float angle = 2.0 * PI * random(state);
+            vec2 offset = RESTIR_RADIUS * sqrt(random(state)) * vec2(cos(angle), sin(angle));
+            ivec2 neighbor = clamp(pixel + ivec2(round(offset)), ivec2(0), ivec2(width, height) - 1);
+            if (readReservoir(neighbor, origin, normal, inputs[inputCount])) inputCount++;
+        }
+    }
+
+    // Generalized RIS: the sample of each input is weighted by the balance heuristic of the target pdfs at the
+    // vertices of all the inputs, times their candidate counts, so that a sample drawn where it was unlikely does
+    // not turn into a firefly where it matters more
+    float weightSum = 0.0;
+    float selectedTarget = 0.0;
+    int selected = 0;
+    float sampleCount = 0.0;
+    for (int i = 0; i < inputCount; i++) {
+        sampleCount += inputs[i].sampleCount;
+        if (inputs[i].weight <= 0.0) continue;
+
+        float target = 0.0;
+        float ownTarget = 0.0;
+        float targetSum = 0.0;
+        for (int k = 0; k < inputCount; k++) {
+            float vertexTarget = inputTarget(inputs[k], inputs[i]);
+            targetSum += inputs[k].sampleCount * vertexTarget;
+            if (k == 0) target = vertexTarget;
+            if (k == i) ownTarget = vertexTarget;
+        }
+        if (target <= 0.0) continue;
+
+        float weight = inputs[i].sampleCount * ownTarget / targetSum * target * inputs[i].weight;
+        weightSum += weight;
+        if (random(state) * weightSum < weight) {
+            selected = i;
+            selectedTarget = target;
+        }
+    }
+
+    ReservoirInput result = inputs[selected];
+    float weight = selectedTarget > 0.0 ? weightSum / selectedTarget : 0.0;
+
+    // A reused sample needs its own shadow ray
+    if (selected > 0) isVisible = weight > 0.0 && isInputSampleVisible(origin, normal, result, radiance);
+    if (!isVisible) weight = 0.0;
+
+    Reservoir stored;
+    stored.lightPosition = result.lightPosition;
+    stored.weight = weight;
+    stored.shadingPosition = origin;
+    stored.countAndLight = uint(min(sampleCount, RESTIR_HISTORY * float(restirCandidates))) << 8 |
+                           uint(result.lightType) << 4 | uint(result.lightIdx);
+    stored.lightNormal = packNormal(result.lightType == 3 ? vec3(0.0, 0.0, 1.0) : result.lightNormal);
+    stored.shadingNormal = packNormal(normal);
+    reservoirs[pixel.y * width + pixel.x] = stored;
+
+    return color * radiance * weight;
+}
@@ -0,0 +1,171 @@
+// Random numbers for the path tracer, included by compute_shader.glsl
+// Samples are drawn by 4D patterns: each pattern is indexed by a fixed dimension so that
+// the same bounce of every sample of a pixel uses the same pattern
+// Uses the width uniform (per pixel seeds) and PI of scene.glsl, included here so that the file stands on its own
+
+#include "scene.glsl"
+
+#define SAMPLER_RANDOM 0
+#define SAMPLER_SOBOL 1
+#define SAMPLER_BLUE_NOISE 2
+#define SAMPLER_PRIMARY 3 // Metropolis chains (compute_shader_mlt.glsl): the samples are read from a primary sample vector
+
+uniform int samplerType;
+
+// Primary sample vectors of the Metropolis chains, mltDimensions 4D patterns each, the sample index being the vector
+// The patterns past mltDimensions are drawn at random on every evaluation, with primarySampleStream in the seed
+layout(std430, binding = 20) buffer PrimarySamples {
+    vec4 primarySamples[];
+};
+
+uniform int mltDimensions;
+uint primarySampleStream = 0u;
+
+// Tileable blue noise ranks (data/bluenoise, generated by tools/BlueNoiseGenerator.cpp)
+uniform usampler2D blueNoise;
+
+// random float between 0 and 1
+// https://en.wikipedia.org/wiki/Permuted_congruential_generator
+// GLSL uses 32 bit integers
+float random(inout uint state){
+    uint x = state;
+    uint count = uint(x >> 28);
+
+    state = x * 4046619565u + 3654262205u;
+    x ^= x >> (4 + count);
+    x *= 277803737u;
+    return float(x ^ (x >> 22)) / 4294967295.0;
+}
+
+// https://www.reedbeta.com/blog/hash-functions-for-gpu-rendering/
+uint hash(uint x){
+    uint state = x * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint hashCombine(uint seed, uint v){
+    return hash(seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+// Sobol direction numbers of dimensions 1 to 3, bit reversed, dimension 0 is the index itself
+// Working on reversed bits saves one bitfieldReverse per dimension in the Owen scrambling
+// Only 16 bits are used: 65536 samples per pixel
+// https://web.maths.unsw.edu.au/~fkuo/sobol/ (new-joe-kuo-6.21201)
+const uvec3 sobolReversedDirections[16] = uvec3[16](
+    uvec3(0x00000001u, 0x00000001u, 0x00000001u),
+    uvec3(0x00000003u, 0x00000003u, 0x00000003u),
+    uvec3(0x00000005u, 0x00000006u, 0x00000004u),
+    uvec3(0x0000000fu, 0x00000009u, 0x0000000au),
+    uvec3(0x00000011u, 0x00000017u, 0x0000001fu),
+    uvec3(0x00000033u, 0x0000003au, 0x0000002eu),
+    uvec3(0x00000055u, 0x00000071u, 0x00000045u),
+    uvec3(0x000000ffu, 0x000000a3u, 0x000000c9u),
+    uvec3(0x00000101u, 0x00000116u, 0x0000011bu),
+    uvec3(0x00000303u, 0x00000339u, 0x000002a4u),
+    uvec3(0x00000505u, 0x00000677u, 0x0000079au),
+    uvec3(0x00000f0fu, 0x000009aau, 0x00000b67u),
+    uvec3(0x00001111u, 0x00001601u, 0x0000101eu),
+    uvec3(0x00003333u, 0x00003903u, 0x0000302du),
+    uvec3(0x00005555u, 0x00007706u, 0x00004041u),
+    uvec3(0x0000ffffu, 0x0000aa09u, 0x0000a0c3u)
+);
+
+// Laine-Karras permutation on bit reversed values: with the final bitfieldReverse this is
+// the hash-based Owen scrambling of "Practical Hash-based Owen Scrambling" (Burley 2020)
+uint laineKarrasPermutation(uint x, uint seed){
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+// Owen-scrambled 4D Sobol point
+// The index is Owen scrambled too, with the pattern seed: the first 2^k samples are still an aligned block
+// of the sequence, hence a stratified net, while the patterns are decorrelated from each other
+// (a plain xor of the index would only shift the same linear sequence and correlate the bounces)
+vec4 sobol4D(uint index, uint seed){
+    index = bitfieldReverse(laineKarrasPermutation(bitfieldReverse(index), seed)) & 0xffffu;
+
+    uvec4 x = uvec4(index, 0u, 0u, 0u);
+    for (int bit=0; bit<16; bit++){
+        x.yzw ^= sobolReversedDirections[bit] * ((index >> bit) & 1u);
+    }
+
+    x.x = laineKarrasPermutation(x.x, hashCombine(seed, 0u));
+    x.y = laineKarrasPermutation(x.y, hashCombine(seed, 1u));
+    x.z = laineKarrasPermutation(x.z, hashCombine(seed, 2u));
+    x.w = laineKarrasPermutation(x.w, hashCombine(seed, 3u));
+
+    // 24 bits are exact in a float, the samples stay in [0, 1)
+    return vec4(bitfieldReverse(x) >> 8) / 16777216.0;
+}
+
+// Kronecker sequence of the generalized golden ratio in 4D (the R2 sequence extended to 4 dimensions):
+// 1/g^i in 0.32 fixed point, g being the root of x^5 = x + 1
+// The integer product wraps exactly, a float product would lose the fractional part after a few thousand frames
+// http://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/
+const uvec4 r4Alpha = uvec4(0xdb4f0b91u, 0xbbe05633u, 0xa0f2ec75u, 0x89e18285u);
+
+// The R4 shift only stratifies each dimension on its own: past the preview frames the blue noise
+// sampler hands over to Sobol, which keeps converging faster (the average stays unbiased)
+const uint blueNoiseFrames = 8u;
+
+// Blue noise 4D point: the ranks of the tile are spatially blue noise in each channel, and the
+// per frame shift along the R4 sequence keeps each pixel stratified over time
+// Each pattern reads the tile with its own toroidal offset so that the patterns are decorrelated
+vec4 blueNoise4D(ivec2 pixel, uint frame, uint dimension){
+    ivec2 size = textureSize(blueNoise, 0);
+    uint offset = hash(dimension);
+    ivec2 coord = (pixel + ivec2(offset & 0xffffu, offset >> 16)) % size;
+
+    uvec4 rank = texelFetch(blueNoise, coord, 0);
+    uvec4 shift = r4Alpha * frame;
+
+    vec4 x = (vec4(rank) + 0.5) / float(size.x * size.y);
+    return fract(x + vec4(shift >> 8) / 16777216.0);
+}
+
+struct Sampler {
+    ivec2 pixel;
+    uint index;  // sample number in the pixel
+    uint seed;   // per pixel seed
+    uint state;  // PCG state of the random sampler
+};
+
+Sampler initSampler(ivec2 pixel, int frame){
+    Sampler sampler;
+    sampler.pixel = pixel;
+    sampler.index = uint(frame);
+    sampler.seed = hash(uint(pixel.y * width + pixel.x));
+    sampler.state = hashCombine(sampler.seed, uint(frame));
+    if (samplerType == SAMPLER_PRIMARY) sampler.state = hashCombine(sampler.state, primarySampleStream);
+    return sampler;
+}
+
+vec4 sample4D(inout Sampler sampler, uint dimension){
+    if (samplerType == SAMPLER_PRIMARY) {
+        if (dimension < uint(mltDimensions)) return primarySamples[sampler.index * uint(mltDimensions) + dimension];
+        return vec4(random(sampler.state), random(sampler.state), random(sampler.state), random(sampler.state));
+    }
+    if (samplerType == SAMPLER_BLUE_NOISE && sampler.index < blueNoiseFrames) {
+        return blueNoise4D(sampler.pixel, sampler.index, dimension);
+    }
+    if (samplerType != SAMPLER_RANDOM) {
+        return sobol4D(sampler.index, hashCombine(sampler.seed, dimension));
+    }
+    return vec4(random(sampler.state), random(sampler.state), random(sampler.state), random(sampler.state));
+}
+
+// Cosine weighted direction around normal (Malley's method)
+vec3 cosineHemisphere(vec2 u, vec3 normal){
+    float r = sqrt(u.x);
+    float phi = 2.0 * PI * u.y;
+
+    vec3 t = normalize(cross(abs(normal.x) > 0.9 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), normal));
+    vec3 b = cross(normal, t);
+
+    return normalize(t * r * cos(phi) + b * r * sin(phi) + normal * sqrt(max(0.0, 1.0 - u.x)));
+}
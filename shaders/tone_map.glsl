@@ -0,0 +1,9 @@
+// Maps the linear radiance of the image to [0, 1] before it is quantized to 8 bits, the same curve as ToDisplay in main.cpp
+// ACES filmic fit (Narkowicz 2015) of color * exposure: HDR emitters and environment maps roll off instead of clipping
+
+uniform float exposure;
+
+vec3 toneMap(vec3 color) {
+    vec3 x = max(color * exposure, vec3(0.0));
+    return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
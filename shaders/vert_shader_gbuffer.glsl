@@ -0,0 +1,16 @@
+#version 430 core
+
+// Triangle meshes rasterized by GBuffer, in world space like the triangles of the path tracer
+
+layout(location = 0) in vec3 aPos;
+
+out vec3 FragPos;
+
+uniform mat4 model;
+uniform mat4 viewProjection; // jittered projection of the path tracer camera
+
+void main()
+{
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,92 @@
+// Path states and queues of the wavefront pipeline, included by the wavefront_*.glsl kernels
+// generate fills one path slot per pixel of the chunk, then every iteration extend traces the ray queue,
+// shade samples the next vertex of the hit paths and connect traces their shadow rays
+// accumulate adds the radiance of the slots to the image once the paths are done
+
+// Pixel coordinates are packed as x | y << 16
+struct PathState {
+    vec3 origin;
+    uint pixel;
+    vec3 direction;
+    uint sampleIndex;
+    vec3 throughput;
+    uint rngState;       // PCG state of the random sampler, the other samplers are stateless
+    vec3 radiance;
+    int depth;
+    vec3 prevOrigin;     // last light sampled vertex, for MIS
+    float prevBsdfPdf;
+    vec3 prevNormal;
+    int sampledLights;
+    vec3 hitPoint;       // written by extend
+    int objType;
+    vec3 hitNormal;
+    int objIdx;
+    float hitDist;
+    int triangleIdx;
+};
+
+struct ShadowRay {
+    vec3 origin;
+    uint path;
+    vec3 direction;
+    int lightType;
+    vec3 contribution;   // already multiplied by the path throughput
+    int lightIdx;
+    float lightDistance;
+};
+
+// Length of a queue followed by the work group count of the kernel consuming it, for glDispatchComputeIndirect
+struct QueueCounter {
+    uint count;
+    uint groupsX;
+    uint groupsY;
+    uint groupsZ;
+};
+
+layout(std430, binding = 3) buffer PathStates {
+    PathState paths[];
+};
+
+layout(std430, binding = 4) buffer RayQueue {
+    uint rayQueue[];
+};
+
+layout(std430, binding = 5) buffer HitQueue {
+    uint hitQueue[];
+};
+
+layout(std430, binding = 6) buffer ShadowQueue {
+    ShadowRay shadowQueue[];
+};
+
+layout(std430, binding = 7) buffer QueueCounters {
+    QueueCounter rayQueueCounter;
+    QueueCounter hitQueueCounter;
+    QueueCounter shadowQueueCounter;
+};
+
+// local_size_x of the kernels
+#define WAVEFRONT_GROUP_SIZE 64u
+
+// The first item of every group of WAVEFRONT_GROUP_SIZE also adds a work group to the dispatch
+void pushRay(uint path){
+    uint idx = atomicAdd(rayQueueCounter.count, 1u);
+    if (idx % WAVEFRONT_GROUP_SIZE == 0u) atomicAdd(rayQueueCounter.groupsX, 1u);
+    rayQueue[idx] = path;
+}
+
+void pushHit(uint path){
+    uint idx = atomicAdd(hitQueueCounter.count, 1u);
+    if (idx % WAVEFRONT_GROUP_SIZE == 0u) atomicAdd(hitQueueCounter.groupsX, 1u);
+    hitQueue[idx] = path;
+}
+
+void pushShadowRay(ShadowRay shadowRay){
+    uint idx = atomicAdd(shadowQueueCounter.count, 1u);
+    if (idx % WAVEFRONT_GROUP_SIZE == 0u) atomicAdd(shadowQueueCounter.groupsX, 1u);
+    shadowQueue[idx] = shadowRay;
+}
+
+ivec2 unpackPixel(uint pixel){
+    return ivec2(pixel & 0xffffu, pixel >> 16);
+}
@@ -0,0 +1,39 @@
+#version 430 core
+
+// Wavefront pipeline: adds the radiance of the finished paths of the chunk to the accumulated image
+// Same accumulation as compute_shader.glsl, one sample per pixel
+
+layout(local_size_x = 64) in;
+
+layout(rgba32f, binding = 0) uniform image2D imgOutput;
+layout(rgba32f, binding = 2) uniform image2D varianceImage; // z: sample index of the pixel
+
+uniform bool clearAccumulation;
+uniform int pixelCount;
+
+#include "wavefront.glsl"
+#include "display_image.glsl"
+
+void main() {
+    uint slot = gl_GlobalInvocationID.x;
+    if (slot >= uint(pixelCount)) return;
+
+    ivec2 pixelCoord = unpackPixel(paths[slot].pixel);
+    if (any(greaterThanEqual(pixelCoord, imageSize(imgOutput)))) return;
+    vec3 radiance = paths[slot].radiance;
+
+    vec4 accumulated = clearAccumulation ? vec4(0.0) : imageLoad(imgOutput, pixelCoord);
+    vec2 moments = clearAccumulation ? vec2(0.0) : imageLoad(varianceImage, pixelCoord).xy;
+
+    float sampleCount = accumulated.w + 1.0;
+    vec3 color = accumulated.xyz + (radiance - accumulated.xyz) / sampleCount;
+
+    float luminance = dot(radiance, vec3(0.2126, 0.7152, 0.0722));
+    float delta = luminance - moments.x;
+    moments.x += delta / sampleCount;
+    moments.y += delta * (luminance - moments.x);
+
+    imageStore(imgOutput, pixelCoord, vec4(color, sampleCount));
+    imageStore(varianceImage, pixelCoord, vec4(moments, float(paths[slot].sampleIndex + 1u), 0.0));
+    storeDisplay(pixelCoord, color, sampleCount);
+}
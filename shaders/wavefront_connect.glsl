@@ -0,0 +1,25 @@
+#version 430 core
+
+// Wavefront pipeline: shadow rays queued by shade, the light sample is added when the emitter is visible
+
+layout(local_size_x = 64) in;
+
+#include "scene.glsl"
+#include "sampler.glsl"
+#include "lighting.glsl"
+#include "wavefront.glsl"
+
+void main() {
+    if (gl_GlobalInvocationID.x >= shadowQueueCounter.count) return;
+
+    ShadowRay shadowRay = shadowQueue[gl_GlobalInvocationID.x];
+
+    LightSample lightSample;
+    lightSample.direction = shadowRay.direction;
+    lightSample.type = shadowRay.lightType;
+    lightSample.idx = shadowRay.lightIdx;
+    lightSample.distance = shadowRay.lightDistance;
+
+    // A path has at most one shadow ray per iteration, no other invocation writes its radiance
+    if (isLightVisible(shadowRay.origin, lightSample)) paths[shadowRay.path].radiance += shadowRay.contribution;
+}
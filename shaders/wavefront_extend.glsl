@@ -0,0 +1,48 @@
+#version 430 core
+
+// Wavefront pipeline: closest hit of every ray in the ray queue
+// Hits go to the hit queue, missed rays gather the ambient light (with the MIS weight of the environment map) and end their path
+
+layout(local_size_x = 64) in;
+
+#include "scene.glsl"
+#include "lighting.glsl"
+#include "wavefront.glsl"
+#include "raster_primary.glsl"
+#include "cached_primary.glsl"
+
+void main() {
+    if (gl_GlobalInvocationID.x >= rayQueueCounter.count) return;
+
+    uint p = rayQueue[gl_GlobalInvocationID.x];
+    vec3 direction = paths[p].direction;
+
+    HitInfo hitInfo;
+    uint pixel = paths[p].pixel;
+    if (usePrimaryCache && paths[p].depth == 0) {
+        hitInfo = loadCachedHit(paths[p].origin, direction, ivec2(pixel & 0xffffu, pixel >> 16), int(paths[p].sampleIndex));
+    } else if (useRasterPrimary && paths[p].depth == 0) {
+        hitInfo = sendPrimaryRay(paths[p].origin, direction, loadRasterHit(ivec2(pixel & 0xffffu, pixel >> 16)));
+    } else {
+        hitInfo = sendRay(paths[p].origin, direction);
+    }
+
+    if (!hitInfo.hasHit) {
+        float envWeight = 1.0;
+        if (paths[p].sampledLights != 0) {
+            float pdf = dot(direction, paths[p].prevNormal) > 0.0 ? environmentLightPdf(direction) : 0.0;
+            if (pdf > 0.0) envWeight = useMIS ? powerHeuristic(paths[p].prevBsdfPdf, pdf) : 0.0;
+        }
+        paths[p].radiance += getAmbientLight(direction) * paths[p].throughput * envWeight;
+        return;
+    }
+
+    paths[p].hitPoint = hitInfo.nextOrigin;
+    paths[p].hitNormal = hitInfo.normal;
+    paths[p].objType = hitInfo.objType;
+    paths[p].objIdx = hitInfo.objIdx;
+    paths[p].triangleIdx = hitInfo.triangleIdx;
+    paths[p].hitDist = hitInfo.dist;
+
+    pushHit(p);
+}
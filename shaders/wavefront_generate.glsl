@@ -0,0 +1,75 @@
+#version 430 core
+
+// Wavefront pipeline: camera rays of one chunk of pixels, one path slot per pixel
+
+layout(local_size_x = 64) in;
+
+layout(rgba32f, binding = 2) uniform readonly image2D varianceImage; // z: sample index of the pixel
+
+// With adaptive sampling the pixels are those of the tiles listed by adaptive_tiles.glsl
+// The CPU reads listedTiles one pass late, the pixels of the tiles past it are left out like the border ones
+layout(std430, binding = 2) buffer TileList {
+    uint listedTiles;
+    uint tiles[];
+};
+
+uniform bool useTileList;
+uniform bool clearAccumulation;
+uniform int pixelOffset;  // first pixel of the chunk, in tile order
+uniform int pixelCount;   // pixels in the chunk
+
+#include "scene.glsl"
+#include "sampler.glsl"
+#include "wavefront.glsl"
+#include "raster_primary.glsl"
+#include "cached_primary.glsl"
+
+void main() {
+    uint slot = gl_GlobalInvocationID.x;
+    if (slot >= uint(pixelCount)) return;
+
+    // Pixels are numbered in tile order, like the work groups of compute_shader.glsl
+    uint idx = uint(pixelOffset) + slot;
+    uint tileIdx = idx / 256u;
+    uint local = idx % 256u;
+    ivec2 tileCoord;
+    if (useTileList) {
+        uint tile = tileIdx < listedTiles ? tiles[tileIdx] : uint((width + 15) / 16); // first tile right of the image
+        tileCoord = ivec2(tile & 0xffffu, tile >> 16);
+    } else {
+        int tilesX = (width + 15) / 16;
+        tileCoord = ivec2(int(tileIdx) % tilesX, int(tileIdx) / tilesX);
+    }
+    ivec2 pixelCoord = tileCoord * 16 + ivec2(local % 16u, local / 16u);
+
+    // Same samples as the megakernel: the sample index is the pixel's own
+    uint sampleIndex = clearAccumulation ? 0u : uint(imageLoad(varianceImage, pixelCoord).z);
+    Sampler sampler = initSampler(pixelCoord, int(sampleIndex));
+
+    vec2 jitter = sample4D(sampler, 0u).xy;
+    if (usePrimaryCache) {
+        Sampler cachedSampler = initSampler(pixelCoord, int(sampleIndex) % primaryCacheStrata);
+        jitter = sample4D(cachedSampler, 0u).xy;
+    } else if (useRasterPrimary) {
+        jitter = primaryJitter;
+    }
+
+    float aspect = float(width) / float(height);
+    vec3 rayDirection = getCameraRay(45.0, aspect, (vec2(pixelCoord) + jitter) / vec2(width, height));
+    rayDirection = (vec4(rayDirection, 1.0) * viewMatrix).xyz;
+
+    PathState path;
+    path.origin = cameraPosition;
+    path.pixel = uint(pixelCoord.x) | (uint(pixelCoord.y) << 16);
+    path.direction = rayDirection;
+    path.sampleIndex = sampleIndex;
+    path.throughput = vec3(1.0);
+    path.rngState = sampler.state;
+    path.radiance = vec3(0.0);
+    path.depth = 0;
+    path.sampledLights = 0;
+    paths[slot] = path;
+
+    // Pixels of the border tiles outside the image: nothing to trace, accumulate ignores them
+    if (pixelCoord.x < width && pixelCoord.y < height) pushRay(slot);
+}
@@ -0,0 +1,100 @@
+#version 430 core
+
+// Wavefront pipeline: one vertex of every path in the hit queue, same integrator as compute_shader.glsl
+// Emission, light sample (queued as a shadow ray for connect), next direction and russian roulette
+
+layout(local_size_x = 64) in;
+
+uniform int maxBounces;
+
+uniform bool useRussianRoulette;
+uniform int rrMinDepth;
+
+#include "scene.glsl"
+#include "sampler.glsl"
+#include "lighting.glsl"
+#include "wavefront.glsl"
+
+void main() {
+    if (gl_GlobalInvocationID.x >= hitQueueCounter.count) return;
+
+    uint p = hitQueue[gl_GlobalInvocationID.x];
+    PathState path = paths[p];
+    int m = path.depth;
+
+    Sampler sampler = initSampler(unpackPixel(path.pixel), int(path.sampleIndex));
+    sampler.state = path.rngState;
+
+    HitInfo hitInfo;
+    hitInfo.hasHit = true;
+    hitInfo.nextOrigin = path.hitPoint;
+    hitInfo.normal = path.hitNormal;
+    hitInfo.mat = getMaterial(path.objType, path.objIdx);
+    hitInfo.objType = path.objType;
+    hitInfo.objIdx = path.objIdx;
+    hitInfo.triangleIdx = path.triangleIdx;
+    hitInfo.dist = path.hitDist;
+
+    vec3 rayDirection = path.direction;
+    vec3 origin = hitInfo.nextOrigin;
+    vec3 normal = hitInfo.normal;
+    Material mat = hitInfo.mat;
+
+    float emiWeight = 1.0;
+    if (path.sampledLights != 0) {
+        float pdf = dot(rayDirection, path.prevNormal) > 0.0 ? lightPdf(path.prevOrigin, path.prevNormal, rayDirection, hitInfo) : 0.0;
+        if (pdf > 0.0) emiWeight = useMIS ? powerHeuristic(path.prevBsdfPdf, pdf) : 0.0;
+    }
+    path.radiance += mat.emissionColor * mat.emissionStrength * path.throughput * emiWeight;
+
+    vec4 u = sample4D(sampler, uint(2 * m + 1));
+    vec4 v = sample4D(sampler, uint(2 * m + 2));
+
+    vec3 diffuseDir = cosineHemisphere(u.xy, normal);
+    vec3 specularDir = rayDirection - 2.0*dot(rayDirection, normal) * normal;
+
+    int isReflexive = int(mat.reflexivity > u.z);
+
+    rayDirection = normalize(mix(diffuseDir, specularDir, mat.smoothness * isReflexive));
+
+    bool isMirror = isReflexive == 1 && mat.smoothness > 0.99;
+    bool sampledLights = useNEE && (useMIS ? !isMirror : isReflexive == 0) && m < maxBounces - 1;
+    path.sampledLights = int(sampledLights);
+    if (sampledLights) {
+        LightSample lightSample;
+        if (sampleLight(origin, normal, specularDir, mat, isReflexive, vec3(u.w, v.xy), lightSample)) {
+            ShadowRay shadowRay;
+            shadowRay.origin = origin;
+            shadowRay.path = p;
+            shadowRay.direction = lightSample.direction;
+            shadowRay.lightType = lightSample.type;
+            shadowRay.contribution = lightSample.contribution * path.throughput;
+            shadowRay.lightIdx = lightSample.idx;
+            shadowRay.lightDistance = lightSample.distance;
+            pushShadowRay(shadowRay);
+        }
+
+        path.prevOrigin = origin;
+        path.prevNormal = normal;
+        path.prevBsdfPdf = bsdfPdf(rayDirection, normal, specularDir, mat, isReflexive);
+    }
+
+    path.throughput *= mix(mat.color, vec3(1.0), isReflexive);
+
+    bool alive = m + 1 < maxBounces;
+    if (useRussianRoulette && m + 1 >= rrMinDepth) {
+        float survival = min(max(path.throughput.x, max(path.throughput.y, path.throughput.z)), 0.95);
+        if (v.z >= survival) alive = false;
+        else path.throughput /= survival;
+    } else if (!useRussianRoulette && max(path.throughput.x, max(path.throughput.y, path.throughput.z)) < 0.005) {
+        alive = false; // cut like the megakernel without roulette
+    }
+
+    path.origin = origin;
+    path.direction = rayDirection;
+    path.depth = m + 1;
+    path.rngState = sampler.state;
+    paths[p] = path;
+
+    if (alive) pushRay(p);
+}
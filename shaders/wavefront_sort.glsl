@@ -0,0 +1,141 @@
+#version 430 core
+
+// Wavefront pipeline: counting sort of the ray queue before extend, so that the lanes of a work group
+// trace rays going the same way from close origins and walk the same triangles
+// Key: direction octant, then Morton code of the origin in the bounding box of the queued origins
+// Run in 4 stages (sortStage): bounds of the origins, key histogram, prefix sum of the bins, scatter
+
+layout(local_size_x = 64) in;
+
+#define SORT_STAGE_BOUNDS 0
+#define SORT_STAGE_HISTOGRAM 1
+#define SORT_STAGE_SCAN 2
+#define SORT_STAGE_SCATTER 3
+
+#define MORTON_BITS 4u                              // bits per axis
+#define BIN_COUNT (8u << (3u * MORTON_BITS))        // 3 octant bits + 3 * MORTON_BITS
+
+uniform int sortStage;
+
+#include "wavefront.glsl"
+
+layout(std430, binding = 8) buffer SortedRayQueue {
+    uint sortedRayQueue[];
+};
+
+layout(std430, binding = 9) buffer SortKeys {
+    uint keys[];
+};
+
+// Bounds are stored as order preserving uints for atomicMin / atomicMax
+layout(std430, binding = 10) buffer SortBins {
+    uint boundsMin[3];
+    uint boundsMax[3];
+    uint bins[BIN_COUNT];
+};
+
+shared uint sharedMin[3];
+shared uint sharedMax[3];
+shared uint sharedSums[64];
+
+uint floatToOrdered(float f){
+    uint u = floatBitsToUint(f);
+    return (u & 0x80000000u) != 0u ? ~u : u | 0x80000000u;
+}
+
+float orderedToFloat(uint u){
+    return uintBitsToFloat((u & 0x80000000u) != 0u ? u & 0x7fffffffu : ~u);
+}
+
+// Spreads the MORTON_BITS low bits of x with two zero bits between them
+uint spreadBits(uint x){
+    uint r = 0u;
+    for (uint b = 0u; b < MORTON_BITS; b++) r |= ((x >> b) & 1u) << (3u * b);
+    return r;
+}
+
+uint sortKey(vec3 origin, vec3 direction){
+    vec3 lo = vec3(orderedToFloat(boundsMin[0]), orderedToFloat(boundsMin[1]), orderedToFloat(boundsMin[2]));
+    vec3 hi = vec3(orderedToFloat(boundsMax[0]), orderedToFloat(boundsMax[1]), orderedToFloat(boundsMax[2]));
+
+    float cells = float(1u << MORTON_BITS);
+    uvec3 cell = uvec3(clamp((origin - lo) / max(hi - lo, vec3(1e-6)) * cells, vec3(0.0), vec3(cells - 1.0)));
+    uint morton = spreadBits(cell.x) | (spreadBits(cell.y) << 1) | (spreadBits(cell.z) << 2);
+
+    uint octant = uint(direction.x < 0.0) | (uint(direction.y < 0.0) << 1) | (uint(direction.z < 0.0) << 2);
+
+    return (octant << (3u * MORTON_BITS)) | morton;
+}
+
+// Exclusive prefix sum of the bins by a single work group, each lane owns BIN_COUNT / 64 consecutive bins
+void scanBins(){
+    uint lane = gl_LocalInvocationIndex;
+    uint perLane = BIN_COUNT / 64u;
+    uint first = lane * perLane;
+
+    uint sum = 0u;
+    for (uint i = 0u; i < perLane; i++) sum += bins[first + i];
+    sharedSums[lane] = sum;
+    barrier();
+
+    // Hillis-Steele inclusive scan of the lane sums
+    for (uint offset = 1u; offset < 64u; offset *= 2u) {
+        uint value = lane >= offset ? sharedSums[lane - offset] : 0u;
+        barrier();
+        sharedSums[lane] += value;
+        barrier();
+    }
+
+    uint running = sharedSums[lane] - sum;
+    for (uint i = 0u; i < perLane; i++) {
+        uint count = bins[first + i];
+        bins[first + i] = running;
+        running += count;
+    }
+}
+
+void main() {
+    if (sortStage == SORT_STAGE_SCAN) {
+        scanBins();
+        return;
+    }
+
+    uint idx = gl_GlobalInvocationID.x;
+    bool queued = idx < rayQueueCounter.count;
+    uint p = queued ? rayQueue[idx] : 0u;
+
+    if (sortStage == SORT_STAGE_BOUNDS) {
+        // Reduced in shared memory first, a single global atomic per work group and axis
+        if (gl_LocalInvocationIndex < 3u) {
+            sharedMin[gl_LocalInvocationIndex] = 0xffffffffu;
+            sharedMax[gl_LocalInvocationIndex] = 0u;
+        }
+        barrier();
+
+        if (queued) {
+            vec3 origin = paths[p].origin;
+            for (int a = 0; a < 3; a++) {
+                atomicMin(sharedMin[a], floatToOrdered(origin[a]));
+                atomicMax(sharedMax[a], floatToOrdered(origin[a]));
+            }
+        }
+        barrier();
+
+        if (gl_LocalInvocationIndex < 3u) {
+            atomicMin(boundsMin[gl_LocalInvocationIndex], sharedMin[gl_LocalInvocationIndex]);
+            atomicMax(boundsMax[gl_LocalInvocationIndex], sharedMax[gl_LocalInvocationIndex]);
+        }
+        return;
+    }
+
+    if (!queued) return;
+
+    if (sortStage == SORT_STAGE_HISTOGRAM) {
+        uint key = sortKey(paths[p].origin, paths[p].direction);
+        keys[idx] = key;
+        atomicAdd(bins[key], 1u);
+    } else {
+        // The order inside a bin is not deterministic, paths do not depend on their queue position
+        sortedRayQueue[atomicAdd(bins[keys[idx]], 1u)] = p;
+    }
+}
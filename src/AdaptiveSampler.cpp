@@ -0,0 +1,95 @@
+#include "AdaptiveSampler.hpp"
+
+AdaptiveSampler::AdaptiveSampler(int width, int height)
+    : width(width), height(height),
+      tilesX((width + tileSize - 1) / tileSize), tilesY((height + tileSize - 1) / tileSize),
+      tilesProgram("shaders/adaptive_tiles.glsl"), activeTiles(tilesX * tilesY) {
+
+    glGenTextures(1, &varianceTexture);
+    glBindTexture(GL_TEXTURE_2D, varianceTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &tileBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (1 + tilesX * tilesY) * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &countBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, countBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), NULL, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+AdaptiveSampler::~AdaptiveSampler() {
+    glDeleteTextures(1, &varianceTexture);
+    glDeleteBuffers(1, &tileBuffer);
+    glDeleteBuffers(1, &countBuffer);
+    if (countFence) glDeleteSync(countFence);
+}
+
+void AdaptiveSampler::bind() {
+    glBindImageTexture(2, varianceTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, tileBuffer); // binding 2 in the compute shaders
+}
+
+void AdaptiveSampler::buildTileList(int minSamples, float errorThreshold) {
+    // Only the tile count is reset, the list is overwritten. Cleared by the GPU, in order with the dispatches
+    const GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileBuffer);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, tileBuffer);
+
+    // Previous frame writes to the images must be visible
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    tilesProgram.use();
+    tilesProgram.set("width", width);
+    tilesProgram.set("height", height);
+    tilesProgram.set("minSamples", minSamples);
+    tilesProgram.set("errorThreshold", errorThreshold);
+
+    glDispatchCompute(tilesX, tilesY, 1);
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    // Copy of the count for the CPU, unless the previous one is still in flight
+    if (!countFence) copyCount();
+}
+
+void AdaptiveSampler::copyCount() {
+    if (countFence) glDeleteSync(countFence);
+    glBindBuffer(GL_COPY_READ_BUFFER, tileBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, countBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    countFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+int AdaptiveSampler::getActiveTiles(bool wait) {
+    // The copy of the last list may have been skipped behind an older one still in flight
+    if (wait) copyCount();
+
+    const GLuint64 timeout = wait ? 1000000000 : 0; // ns
+    GLenum status = countFence ? glClientWaitSync(countFence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout) : GL_TIMEOUT_EXPIRED;
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+        GLuint count = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, countBuffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint), &count);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteSync(countFence);
+        countFence = 0;
+        activeTiles = (int)count;
+    }
+    return activeTiles;
+}
+
+void AdaptiveSampler::restart() {
+    if (countFence) glDeleteSync(countFence);
+    countFence = 0;
+    activeTiles = tilesX * tilesY;
+}
@@ -0,0 +1,54 @@
+#ifndef ADAPTIVE_SAMPLER_HPP
+#define ADAPTIVE_SAMPLER_HPP
+
+#include <glad/gl.h>
+
+#include "ComputeShader.hpp"
+
+// Spends the samples where the image is still noisy
+// The path tracer keeps a per pixel running variance, adaptive_tiles.glsl turns it into the list of the
+// tiles that did not converge, and only those tiles are rendered. The variance image also holds the sample index
+// of the pixels, apart from their sample count which a reprojection lowers
+// The tile count is copied to a readback buffer behind a fence and read once the GPU is done, a pass later:
+// the dispatches are sized from that count and the kernels skip the work groups past the current list
+class AdaptiveSampler {
+public:
+    AdaptiveSampler(int width, int height);
+    ~AdaptiveSampler();
+
+    // Binds the variance image and the tile list of the compute shaders
+    void bind();
+
+    // Fills the tile list from the accumulated image bound on image unit 0
+    void buildTileList(int minSamples, float errorThreshold);
+
+    // Number of tiles of the latest list the GPU has finished, a pass late. With wait, the count of the list built
+    // last (on wake up, or when its parameters changed). All the tiles until the first list of a render is read back
+    int getActiveTiles(bool wait = false);
+
+    // Forgets the count of the previous render (new scene or camera), whose lists no longer apply
+    void restart();
+
+    GLuint getVarianceTexture() const { return varianceTexture; }
+
+    static const int tileSize = 16; // local size of the compute shaders
+
+private:
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+
+    ComputeShader tilesProgram;
+
+    GLuint varianceTexture;
+    GLuint tileBuffer;  // count, then the list
+    GLuint countBuffer; // readback copy of the count
+    GLsync countFence = 0;
+    int activeTiles;
+
+    // Copies the count of the list built last to the readback buffer, behind a new fence
+    void copyCount();
+};
+
+#endif // ADAPTIVE_SAMPLER_HPP
@@ -0,0 +1,88 @@
+#include "Benchmark.hpp"
+
+#include <GLFW/glfw3.h>
+#include <cmath>
+#include <iostream>
+
+void Benchmark::restart() {
+    startTime = glfwGetTime();
+    pausedTime = 0.0;
+    nextCheck = checkInterval;
+    samples = 0;
+}
+
+void Benchmark::update(GLuint texture, int frameCount) {
+    lastTexture = texture;
+    samples = frameCount;
+
+    if (!running) return;
+
+    float elapsed = getElapsed();
+
+    if (targetRMSE > 0.0f && elapsed >= nextCheck) {
+        nextCheck = elapsed + checkInterval;
+
+        double before = glfwGetTime();
+        float rmse = computeRMSE();
+        pausedTime += glfwGetTime() - before;
+
+        if (rmse <= targetRMSE) {
+            running = false;
+            std::cout << "[benchmark] target rmse=" << targetRMSE << " reached: spp=" << samples << " time=" << elapsed << "s rmse=" << rmse << std::endl;
+            return;
+        }
+    }
+
+    if (elapsed >= runDuration) {
+        running = false;
+        float rmse = computeRMSE();
+        if (targetRMSE > 0.0f) std::cout << "[benchmark] target rmse=" << targetRMSE << " not reached: ";
+        else std::cout << "[benchmark] ";
+        std::cout << "spp=" << samples << " time=" << elapsed << "s rmse=" << rmse << std::endl;
+    }
+}
+
+float Benchmark::getElapsed() const {
+    return (float)(glfwGetTime() - startTime - pausedTime);
+}
+
+void Benchmark::readTexture(std::vector<float> &pixels) {
+    pixels.resize(width * height * 3);
+
+    // Image stores of the compute shader must be visible to glGetTexImage
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, lastTexture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, pixels.data());
+}
+
+void Benchmark::saveReference() {
+    if (lastTexture == 0) return;
+    readTexture(reference);
+    std::cout << "[benchmark] reference saved (" << samples << " spp)" << std::endl;
+}
+
+float Benchmark::computeRMSE() {
+    if (lastTexture == 0 || !hasReference()) return -1.0f;
+    readTexture(current);
+
+    double sum = 0.0;
+    for (size_t i = 0; i < current.size(); i++) {
+        double diff = current[i] - reference[i];
+        sum += diff * diff;
+    }
+
+    lastRMSE = (float)std::sqrt(sum / current.size());
+    return lastRMSE;
+}
+
+void Benchmark::startRun(float duration) {
+    runDuration = duration;
+    targetRMSE = -1.0f;
+    running = true;
+}
+
+void Benchmark::startTargetRun(float target, float maxDuration) {
+    runDuration = maxDuration;
+    targetRMSE = target;
+    running = true;
+}
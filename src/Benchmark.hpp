@@ -0,0 +1,53 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <glad/gl.h>
+#include <vector>
+
+// Measures the noise of the accumulated image against a reference render
+// Used to compare integrators: save a converged reference, then run each variant for the same duration
+// or until it reaches a target RMSE
+class Benchmark {
+public:
+    Benchmark(int width, int height) : width(width), height(height) {}
+
+    void restart();
+    void update(GLuint texture, int frameCount);
+
+    void saveReference();
+    bool hasReference() const { return !reference.empty(); }
+    float computeRMSE();
+
+    void startRun(float duration);
+    void startTargetRun(float target, float maxDuration);
+    bool isRunning() const { return running; }
+
+    int getSamples() const { return samples; }
+    float getElapsed() const;
+    float getLastRMSE() const { return lastRMSE; }
+
+private:
+    void readTexture(std::vector<float> &pixels);
+
+    int width;
+    int height;
+
+    GLuint lastTexture = 0;
+    int samples = 0;
+    double startTime = 0.0;
+
+    std::vector<float> reference;
+    std::vector<float> current;
+    float lastRMSE = -1.0f;
+
+    bool running = false;
+    float runDuration = 10.0f;
+
+    // RMSE is checked every checkInterval seconds, the readback time is not counted in the elapsed time
+    float targetRMSE = -1.0f;
+    float checkInterval = 0.5f;
+    float nextCheck = 0.0f;
+    double pausedTime = 0.0;
+};
+
+#endif // BENCHMARK_HPP
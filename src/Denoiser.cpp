@@ -0,0 +1,209 @@
+#include "Denoiser.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "AdaptiveSampler.hpp"
+
+// Constants of shaders/denoise_atrous.glsl
+const float sigmaLuminance = 4.0f;
+const float sigmaNormal = 128.0f;
+const float sigmaDepth = 0.02f;
+const float sigmaAlbedo = 0.1f;
+
+static GLuint genImage(int width, int height) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+Denoiser::Denoiser(int width, int height)
+    : width(width), height(height),
+      guidesProgram("shaders/aov.glsl"), atrousProgram("shaders/denoise_atrous.glsl") {
+
+    albedoTexture = genImage(width, height);
+    normalDepthTexture = genImage(width, height);
+    outputTextures[0] = genImage(width, height);
+    outputTextures[1] = genImage(width, height);
+}
+
+Denoiser::~Denoiser() {
+    glDeleteTextures(1, &albedoTexture);
+    glDeleteTextures(1, &normalDepthTexture);
+    glDeleteTextures(2, outputTextures);
+}
+
+void Denoiser::renderGuides(const std::function<void(ShaderProgram &)> &setUniforms) {
+    guidesProgram.use();
+    setUniforms(guidesProgram);
+
+    glBindImageTexture(3, albedoTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glBindImageTexture(4, normalDepthTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+    const int tileSize = AdaptiveSampler::tileSize;
+    glDispatchCompute((width + tileSize - 1) / tileSize, (height + tileSize - 1) / tileSize, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void Denoiser::denoise(int iterations, float exposure) {
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    atrousProgram.use();
+    atrousProgram.set("width", width);
+    atrousProgram.set("height", height);
+    atrousProgram.set("exposure", exposure);
+
+    glBindImageTexture(3, albedoTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(4, normalDepthTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+
+    const int tileSize = AdaptiveSampler::tileSize;
+    for (int i = 0; i < iterations; i++) {
+        int writeIndex = i % 2; // the last iteration writes the display image instead
+        atrousProgram.set("iteration", i);
+        atrousProgram.set("lastIteration", (int)(i == iterations - 1));
+
+        glBindImageTexture(5, outputTextures[1 - writeIndex], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(6, outputTextures[writeIndex], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+        glDispatchCompute((width + tileSize - 1) / tileSize, (height + tileSize - 1) / tileSize, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+}
+
+void Denoiser::readGuides(std::vector<float> &albedo, std::vector<float> &normalDepth) const {
+    albedo.resize(width * height * 4);
+    normalDepth.resize(width * height * 4);
+
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, albedoTexture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, albedo.data());
+    glBindTexture(GL_TEXTURE_2D, normalDepthTexture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, normalDepth.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+static float luminance(const float *color) {
+    return 0.2126f * color[0] + 0.7152f * color[1] + 0.0722f * color[2];
+}
+
+static float normalLength(const float *normalDepth) {
+    return std::max(std::sqrt(normalDepth[0] * normalDepth[0] + normalDepth[1] * normalDepth[1] + normalDepth[2] * normalDepth[2]), 1e-6f);
+}
+
+void Denoiser::denoiseOnCpu(int width, int height, const std::vector<float> &color, const std::vector<float> &variance,
+                            const std::vector<float> &albedo, const std::vector<float> &normalDepth, int iterations,
+                            std::vector<float> &output) {
+    const float kernel[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+    const float varianceKernel[2] = {0.5f, 0.25f};
+
+    // Iteration 0 input (fetch of the shader): color and variance of the pixel mean
+    std::vector<float> input(width * height * 4);
+    for (int i = 0; i < width * height; i++) {
+        float sampleCount = color[4 * i + 3];
+        float m2 = variance[4 * i + 1];
+        input[4 * i + 0] = color[4 * i + 0];
+        input[4 * i + 1] = color[4 * i + 1];
+        input[4 * i + 2] = color[4 * i + 2];
+        input[4 * i + 3] = sampleCount > 1.0f ? m2 / ((sampleCount - 1.0f) * sampleCount) : 1.0f;
+    }
+    output.resize(width * height * 4);
+
+    auto filterRows = [&](int iteration, int firstRow, int rowEnd) {
+        int stepWidth = 1 << iteration;
+
+        for (int y = firstRow; y < rowEnd; y++) {
+            for (int x = 0; x < width; x++) {
+                int p = y * width + x;
+                const float *center = &input[4 * p];
+                const float *normalDepthP = &normalDepth[4 * p];
+                const float *albedoP = &albedo[4 * p];
+
+                // filteredVariance
+                float varianceSum = 0.0f, varianceWeightSum = 0.0f;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int qx = x + dx, qy = y + dy;
+                        if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+
+                        float k = varianceKernel[std::abs(dx)] * varianceKernel[std::abs(dy)];
+                        varianceSum += k * input[4 * (qy * width + qx) + 3];
+                        varianceWeightSum += k;
+                    }
+                }
+
+                float centerLuminance = luminance(center);
+                float luminanceScale = sigmaLuminance * std::sqrt(std::max(varianceSum / varianceWeightSum, 0.0f)) + 1e-4f;
+                float centerNormalLength = normalLength(normalDepthP);
+
+                float centerWeight = kernel[0] * kernel[0];
+                float colorSum[3] = {centerWeight * center[0], centerWeight * center[1], centerWeight * center[2]};
+                float varianceSumOut = centerWeight * centerWeight * center[3];
+                float weightSum = centerWeight;
+
+                for (int dy = -2; dy <= 2; dy++) {
+                    for (int dx = -2; dx <= 2; dx++) {
+                        if (dx == 0 && dy == 0) continue;
+
+                        int qx = x + dx * stepWidth, qy = y + dy * stepWidth;
+                        if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+
+                        int q = qy * width + qx;
+                        const float *colorQ = &input[4 * q];
+                        const float *normalDepthQ = &normalDepth[4 * q];
+                        const float *albedoQ = &albedo[4 * q];
+
+                        float geometryWeight = 1.0f;
+                        if (normalDepthP[3] > 0.0f && normalDepthQ[3] > 0.0f) {
+                            float cosine = (normalDepthP[0] * normalDepthQ[0] + normalDepthP[1] * normalDepthQ[1] +
+                                            normalDepthP[2] * normalDepthQ[2]) / (centerNormalLength * normalLength(normalDepthQ));
+                            float normalWeight = std::pow(std::max(cosine, 0.0f), sigmaNormal);
+                            float depthScale = sigmaDepth * normalDepthP[3] * std::sqrt((float)(dx * dx + dy * dy)) * stepWidth + 1e-4f;
+                            float depthWeight = std::exp(-std::abs(normalDepthP[3] - normalDepthQ[3]) / depthScale);
+                            geometryWeight = normalWeight * depthWeight;
+                        } else if (normalDepthP[3] > 0.0f || normalDepthQ[3] > 0.0f) {
+                            geometryWeight = 0.0f;
+                        }
+
+                        float albedoDistance = 0.0f;
+                        for (int c = 0; c < 3; c++) albedoDistance += (albedoP[c] - albedoQ[c]) * (albedoP[c] - albedoQ[c]);
+                        float albedoWeight = std::exp(-albedoDistance / (sigmaAlbedo * sigmaAlbedo));
+                        float luminanceWeight = std::exp(-std::abs(centerLuminance - luminance(colorQ)) / luminanceScale);
+
+                        float weight = kernel[std::abs(dx)] * kernel[std::abs(dy)] * geometryWeight * albedoWeight * luminanceWeight;
+
+                        for (int c = 0; c < 3; c++) colorSum[c] += weight * colorQ[c];
+                        varianceSumOut += weight * weight * colorQ[3];
+                        weightSum += weight;
+                    }
+                }
+
+                for (int c = 0; c < 3; c++) output[4 * p + c] = colorSum[c] / weightSum;
+                output[4 * p + 3] = varianceSumOut / (weightSum * weightSum);
+            }
+        }
+    };
+
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < iterations; i++) {
+        // Every iteration reads the whole previous one, the threads are joined in between
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back(filterRows, i, height * t / threadCount, height * (t + 1) / threadCount);
+        }
+        for (std::thread &thread : threads) thread.join();
+
+        std::swap(input, output);
+    }
+    std::swap(input, output);
+
+    // Sample count in alpha, like the accumulated image
+    for (int i = 0; i < width * height; i++) output[4 * i + 3] = color[4 * i + 3];
+}
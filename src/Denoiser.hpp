@@ -0,0 +1,46 @@
+#ifndef DENOISER_HPP
+#define DENOISER_HPP
+
+#include <glad/gl.h>
+#include <functional>
+#include <vector>
+
+#include "ComputeShader.hpp"
+
+// Edge-avoiding a-trous wavelet denoiser of the accumulated image (shaders/denoise_atrous.glsl)
+// guided by first hit albedo, normal and depth buffers (shaders/aov.glsl) and by the per pixel variance
+// The result is only displayed or saved, the accumulation keeps the noisy samples
+class Denoiser {
+public:
+    Denoiser(int width, int height);
+    ~Denoiser();
+
+    // Renders the guide buffers for the current camera, setUniforms sends the scene and the camera
+    void renderGuides(const std::function<void(ShaderProgram &)> &setUniforms);
+
+    // Filters the accumulated image bound on image unit 0 with the variance image bound on unit 2,
+    // iterations passes of step 1, 2, 4..., the last one into the display image bound on unit 7, tone mapped with exposure
+    void denoise(int iterations, float exposure);
+
+    // Reads back the guide buffers, RGBA floats per pixel
+    void readGuides(std::vector<float> &albedo, std::vector<float> &normalDepth) const;
+
+    // Same filter on the CPU, rows shared between the hardware threads (Raytracing --check-denoiser compares them)
+    // color, variance and guides are RGBA floats per pixel (the accumulated, variance and guide images)
+    static void denoiseOnCpu(int width, int height, const std::vector<float> &color, const std::vector<float> &variance,
+                             const std::vector<float> &albedo, const std::vector<float> &normalDepth, int iterations,
+                             std::vector<float> &output);
+
+private:
+    int width;
+    int height;
+
+    ComputeShader guidesProgram;
+    ComputeShader atrousProgram;
+
+    GLuint albedoTexture;
+    GLuint normalDepthTexture;
+    GLuint outputTextures[2]; // ping-pong between the iterations
+};
+
+#endif // DENOISER_HPP
@@ -0,0 +1,330 @@
+#include "EnvironmentMap.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+const char cacheMagic[4] = {'E', 'N', 'V', '1'};
+
+static GLuint genTexture(int width, int height, GLint internalFormat, GLenum format, GLint filter, GLint wrapS, const float *data) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, data);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+EnvironmentMap::~EnvironmentMap() {
+    clear();
+}
+
+bool EnvironmentMap::load(const std::string &name) {
+    clear();
+    if (name.empty()) return true;
+
+    std::string path = "data/environments/" + name;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        std::cerr << "Failed to open environment map: " << path << std::endl;
+        return false;
+    }
+
+    std::string cachePath = path + ".cache";
+    if (!readCache(cachePath, info.st_size, info.st_mtime)) {
+        std::string extension = name.substr(std::min(name.find_last_of('.'), name.size()));
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        bool ok;
+        if (extension == ".pfm") {
+            ok = readPfm(path, width, height, pixels);
+        } else if (extension == ".hdr") {
+            ok = readHdr(path, width, height, pixels);
+        } else {
+            std::cerr << "Unsupported environment map format (PFM or Radiance .hdr): " << path << std::endl;
+            ok = false;
+        }
+        if (!ok) return false;
+
+        buildDistribution();
+        writeCache(cachePath, info.st_size, info.st_mtime);
+    }
+
+    filename = name;
+    return true;
+}
+
+void EnvironmentMap::clear() {
+    if (mapTexture != 0) {
+        glDeleteTextures(1, &mapTexture);
+        glDeleteTextures(1, &conditionalTexture);
+        glDeleteTextures(1, &marginalTexture);
+        mapTexture = conditionalTexture = marginalTexture = 0;
+    }
+    width = height = 0;
+    std::vector<float>().swap(pixels);
+    std::vector<float>().swap(conditionalCdf);
+    std::vector<float>().swap(marginalCdf);
+    filename.clear();
+}
+
+glm::vec3 EnvironmentMap::radiance(glm::vec3 direction) const {
+    if (pixels.empty()) return glm::vec3(0.0f);
+
+    // Texel coordinates of directionToEnvironment, the longitude wraps around and the latitude is clamped
+    float u = std::atan2(direction.z, direction.x) / (2.0f * 3.14159265359f) + 0.5f;
+    float v = std::acos(std::min(std::max(direction.y, -1.0f), 1.0f)) / 3.14159265359f;
+    float x = u * width - 0.5f;
+    float y = std::min(std::max(v * height - 0.5f, 0.0f), height - 1.0f);
+
+    int x0 = (int)std::floor(x);
+    int y0 = (int)y;
+    float fx = x - x0;
+    float fy = y - y0;
+    int y1 = std::min(y0 + 1, height - 1);
+    x0 = (x0 % width + width) % width;
+    int x1 = (x0 + 1) % width;
+
+    auto texel = [&](int tx, int ty) { return glm::vec3(pixels[3 * (ty * width + tx)], pixels[3 * (ty * width + tx) + 1], pixels[3 * (ty * width + tx) + 2]); };
+    glm::vec3 top = glm::mix(texel(x0, y0), texel(x1, y0), fx);
+    glm::vec3 bottom = glm::mix(texel(x0, y1), texel(x1, y1), fx);
+    return glm::mix(top, bottom, fy) * strength;
+}
+
+void EnvironmentMap::setUniforms(ShaderProgram &shaderProgram) {
+    shaderProgram.set("useEnvironmentMap", (int)isLoaded());
+    shaderProgram.set("environmentStrength", strength);
+    shaderProgram.set("environmentMap", 3);
+    shaderProgram.set("environmentConditionalCdf", 4);
+    shaderProgram.set("environmentMarginalCdf", 5);
+
+    if (!isLoaded()) return;
+    if (mapTexture == 0) upload();
+
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, mapTexture);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, conditionalTexture);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, marginalTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// Portable float map: "PF" (RGB) or "Pf" (gray), size, scale whose sign gives the byte order, rows from the bottom
+bool EnvironmentMap::readPfm(const std::string &path, int &width, int &height, std::vector<float> &pixels) {
+    std::ifstream infile(path, std::ios::binary);
+    std::string magic;
+    float scale;
+    infile >> magic >> width >> height >> scale;
+    infile.get();
+
+    int channels = magic == "PF" ? 3 : (magic == "Pf" ? 1 : 0);
+    if (!infile || channels == 0 || width <= 0 || height <= 0 || scale == 0.0f) {
+        std::cerr << "Invalid PFM file: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<float> data(width * height * channels);
+    if (!infile.read((char *)data.data(), data.size() * sizeof(float))) {
+        std::cerr << "Truncated PFM file: " << path << std::endl;
+        return false;
+    }
+
+    const unsigned short one = 1;
+    bool littleEndian = *(const unsigned char *)&one == 1;
+    if ((scale < 0.0f) != littleEndian) {
+        for (float &value : data) {
+            unsigned char *bytes = (unsigned char *)&value;
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+        }
+    }
+
+    pixels.resize(width * height * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const float *src = &data[((height - 1 - y) * width + x) * channels];
+            for (int c = 0; c < 3; c++) pixels[(y * width + x) * 3 + c] = src[channels == 3 ? c : 0];
+        }
+    }
+    return true;
+}
+
+// Radiance RGBE picture, flat or run-length encoded scanlines, "-Y height +X width" orientation only
+bool EnvironmentMap::readHdr(const std::string &path, int &width, int &height, std::vector<float> &pixels) {
+    std::ifstream infile(path, std::ios::binary);
+    std::string line;
+    std::getline(infile, line);
+    if (line.compare(0, 2, "#?") != 0) {
+        std::cerr << "Invalid Radiance file: " << path << std::endl;
+        return false;
+    }
+
+    while (std::getline(infile, line) && !line.empty()) {
+        if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+            std::cerr << "Unsupported Radiance format " << line.substr(7) << ": " << path << std::endl;
+            return false;
+        }
+    }
+
+    std::getline(infile, line);
+    if (std::sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0) {
+        std::cerr << "Unsupported Radiance orientation " << line << ": " << path << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> scanline(width * 4);
+    pixels.resize(width * height * 3);
+
+    for (int y = 0; y < height; y++) {
+        unsigned char header[4];
+        if (!infile.read((char *)header, 4)) break;
+
+        bool encoded = width >= 8 && width < 32768 && header[0] == 2 && header[1] == 2 && ((header[2] << 8) | header[3]) == width;
+        if (!encoded) {
+            std::memcpy(scanline.data(), header, 4);
+            if (!infile.read((char *)scanline.data() + 4, (width - 1) * 4)) break;
+        } else {
+            // One channel after the other, runs (count > 128) or literal bytes
+            for (int c = 0; c < 4 && infile; c++) {
+                int x = 0;
+                while (x < width) {
+                    int count = infile.get();
+                    if (count == EOF) break;
+
+                    if (count > 128) {
+                        count -= 128;
+                        int value = infile.get();
+                        if (value == EOF || x + count > width) break;
+                        for (int i = 0; i < count; i++) scanline[(x++) * 4 + c] = (unsigned char)value;
+                    } else {
+                        if (count == 0 || x + count > width) break;
+                        for (int i = 0; i < count; i++) scanline[(x++) * 4 + c] = (unsigned char)infile.get();
+                    }
+                }
+                if (x != width) infile.setstate(std::ios::failbit);
+            }
+            if (!infile) break;
+        }
+
+        for (int x = 0; x < width; x++) {
+            const unsigned char *rgbe = &scanline[x * 4];
+            float f = rgbe[3] == 0 ? 0.0f : std::ldexp(1.0f, rgbe[3] - (128 + 8));
+            for (int c = 0; c < 3; c++) pixels[(y * width + x) * 3 + c] = rgbe[c] * f;
+        }
+    }
+
+    if (!infile) {
+        std::cerr << "Truncated or corrupted Radiance file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void EnvironmentMap::buildDistribution() {
+    // Largest luminance of the 3x3 texels around each pixel, the support of the bilinear lookups inside the pixel,
+    // so that every direction with some radiance can be light sampled
+    std::vector<float> luminance(width * height);
+    for (int i = 0; i < width * height; i++) {
+        luminance[i] = 0.2126f * pixels[3 * i] + 0.7152f * pixels[3 * i + 1] + 0.0722f * pixels[3 * i + 2];
+    }
+
+    conditionalCdf.resize((width + 1) * height);
+    marginalCdf.resize(height + 1);
+
+    std::vector<double> rowIntegrals(height);
+    for (int y = 0; y < height; y++) {
+        // Solid angle of the pixels of the row
+        float sinTheta = std::sin(3.14159265359f * (y + 0.5f) / height);
+
+        float *cdf = &conditionalCdf[y * (width + 1)];
+        double sum = 0.0;
+        cdf[0] = 0.0f;
+        for (int x = 0; x < width; x++) {
+            float value = 0.0f;
+            for (int dy = -1; dy <= 1; dy++) {
+                int row = std::min(std::max(y + dy, 0), height - 1);
+                for (int dx = -1; dx <= 1; dx++) {
+                    value = std::max(value, luminance[row * width + (x + dx + width) % width]);
+                }
+            }
+            sum += value * sinTheta;
+            cdf[x + 1] = (float)sum;
+        }
+
+        rowIntegrals[y] = sum;
+        for (int x = 1; x <= width; x++) cdf[x] = sum > 0.0 ? (float)(cdf[x] / sum) : (float)x / width;
+        cdf[width] = 1.0f;
+    }
+
+    double sum = 0.0;
+    marginalCdf[0] = 0.0f;
+    for (int y = 0; y < height; y++) {
+        sum += rowIntegrals[y];
+        marginalCdf[y + 1] = (float)sum;
+    }
+    for (int y = 1; y <= height; y++) marginalCdf[y] = sum > 0.0 ? (float)(marginalCdf[y] / sum) : (float)y / height;
+    marginalCdf[height] = 1.0f;
+}
+
+// The cache matches the source file when its size and modification time are the ones it was built from
+bool EnvironmentMap::readCache(const std::string &path, long long sourceSize, long long sourceTime) {
+    std::ifstream infile(path, std::ios::binary);
+    if (!infile) return false;
+
+    char magic[4];
+    long long size, time;
+    infile.read(magic, 4);
+    infile.read((char *)&size, sizeof(size));
+    infile.read((char *)&time, sizeof(time));
+    infile.read((char *)&width, sizeof(width));
+    infile.read((char *)&height, sizeof(height));
+    if (!infile || std::memcmp(magic, cacheMagic, 4) != 0 || size != sourceSize || time != sourceTime ||
+        width <= 0 || height <= 0) {
+        return false;
+    }
+
+    pixels.resize(width * height * 3);
+    conditionalCdf.resize((width + 1) * height);
+    marginalCdf.resize(height + 1);
+    infile.read((char *)pixels.data(), pixels.size() * sizeof(float));
+    infile.read((char *)conditionalCdf.data(), conditionalCdf.size() * sizeof(float));
+    infile.read((char *)marginalCdf.data(), marginalCdf.size() * sizeof(float));
+    return (bool)infile;
+}
+
+void EnvironmentMap::writeCache(const std::string &path, long long sourceSize, long long sourceTime) const {
+    std::ofstream outfile(path, std::ios::binary);
+    outfile.write(cacheMagic, 4);
+    outfile.write((const char *)&sourceSize, sizeof(sourceSize));
+    outfile.write((const char *)&sourceTime, sizeof(sourceTime));
+    outfile.write((const char *)&width, sizeof(width));
+    outfile.write((const char *)&height, sizeof(height));
+    outfile.write((const char *)pixels.data(), pixels.size() * sizeof(float));
+    outfile.write((const char *)conditionalCdf.data(), conditionalCdf.size() * sizeof(float));
+    outfile.write((const char *)marginalCdf.data(), marginalCdf.size() * sizeof(float));
+
+    if (!outfile) std::cerr << "Failed to write environment map cache: " << path << std::endl;
+}
+
+// Only the textures are kept once uploaded
+void EnvironmentMap::upload() {
+    // The longitude wraps around
+    mapTexture = genTexture(width, height, GL_RGB32F, GL_RGB, GL_LINEAR, GL_REPEAT, pixels.data());
+    conditionalTexture = genTexture(width + 1, height, GL_R32F, GL_RED, GL_NEAREST, GL_CLAMP_TO_EDGE, conditionalCdf.data());
+    marginalTexture = genTexture(height + 1, 1, GL_R32F, GL_RED, GL_NEAREST, GL_CLAMP_TO_EDGE, marginalCdf.data());
+
+    std::vector<float>().swap(pixels);
+    std::vector<float>().swap(conditionalCdf);
+    std::vector<float>().swap(marginalCdf);
+}
@@ -0,0 +1,61 @@
+#ifndef ENVIRONMENT_MAP_HPP
+#define ENVIRONMENT_MAP_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "ShaderProgram.hpp"
+
+// Equirectangular HDR environment map lighting the scene (shaders/environment.glsl), loaded from a PFM
+// or a Radiance .hdr file of data/environments and importance sampled as a light of the light list
+// The distribution is a marginal-conditional CDF of the luminance weighted by sin(theta): a row is picked
+// from the marginal CDF, then a column from the CDF of that row
+// The decoded pixels and the CDFs are cached next to the file (.cache), rebuilt when the file changes
+class EnvironmentMap {
+public:
+    EnvironmentMap() {};
+    ~EnvironmentMap();
+
+    // Replaces the current map, an empty name removes it, returns false when the file cannot be read
+    bool load(const std::string &filename);
+    void clear();
+
+    bool isLoaded() const { return !filename.empty(); }
+    const std::string &getFilename() const { return filename; }
+
+    float getStrength() const { return strength; }
+    void setStrength(float value) { strength = value; }
+
+    // Sends the uniforms of environment.glsl and binds the map and its CDFs on texture units 3 to 5,
+    // the first call uploads them
+    void setUniforms(ShaderProgram &shaderProgram);
+
+    // Bilinear lookup of environmentRadiance on the CPU, only until the map is uploaded
+    glm::vec3 radiance(glm::vec3 direction) const;
+
+private:
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;         // RGB, first row at the top (+y)
+    std::vector<float> conditionalCdf; // (width + 1) per row
+    std::vector<float> marginalCdf;    // height + 1
+
+    std::string filename;
+    float strength = 1.0f;
+
+    GLuint mapTexture = 0;
+    GLuint conditionalTexture = 0;
+    GLuint marginalTexture = 0;
+
+    static bool readPfm(const std::string &path, int &width, int &height, std::vector<float> &pixels);
+    static bool readHdr(const std::string &path, int &width, int &height, std::vector<float> &pixels);
+
+    void buildDistribution();
+    bool readCache(const std::string &path, long long sourceSize, long long sourceTime);
+    void writeCache(const std::string &path, long long sourceSize, long long sourceTime) const;
+    void upload();
+};
+
+#endif // ENVIRONMENT_MAP_HPP
@@ -0,0 +1,83 @@
+#include "GBuffer.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+
+GBuffer::GBuffer(int width, int height) : program("shaders/vert_shader_gbuffer.glsl", "shaders/frag_shader_gbuffer.glsl") {
+    glGenTextures(1, &hitTexture);
+    glBindTexture(GL_TEXTURE_2D, hitTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32I, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hitTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Incomplete G-buffer framebuffer" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GBuffer::~GBuffer() {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteTextures(1, &hitTexture);
+}
+
+void GBuffer::render(ObjectManager &objManager, const glm::vec3 &cameraPosition, const glm::mat4 &viewMatrix,
+                     int width, int height, const glm::vec2 &jitter) {
+    GLint viewport[4];
+    GLint polygonMode[2];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    // Depth clamping instead of near and far clipping: the camera rays have no range limit
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_DEPTH_CLAMP);
+
+    const GLint noHit[4] = {-1, -1, 0, 0};
+    glClearBufferiv(GL_COLOR, 0, noHit);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    // Projection of getCameraRay, shifted so that the pixel centers land on the jittered positions
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.01f, 1000.0f);
+    glm::mat4 shift = glm::translate(glm::mat4(1.0f), glm::vec3(2.0f * (0.5f - jitter.x) / width, 2.0f * (0.5f - jitter.y) / height, 0.0f));
+
+    program.use();
+    program.set("viewProjection", shift * projection * viewMatrix);
+    program.set("cameraPosition", cameraPosition);
+    objManager.drawTriangleMeshes(program);
+
+    glDisable(GL_DEPTH_CLAMP);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+
+    glBindImageTexture(1, hitTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG32I);
+}
+
+glm::vec2 GBuffer::getJitter(int pass) {
+    glm::vec2 jitter(0.0f);
+    glm::vec2 scale(1.0f);
+    for (int b = 0; b < 2; b++) {
+        int base = b == 0 ? 2 : 3;
+        for (int i = pass + 1; i > 0; i /= base) {
+            scale[b] /= base;
+            jitter[b] += scale[b] * (i % base);
+        }
+    }
+    return jitter;
+}
@@ -0,0 +1,33 @@
+#ifndef GBUFFER_HPP
+#define GBUFFER_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "ShaderProgram.hpp"
+#include "ObjectsManager.hpp"
+
+// Hybrid primary visibility (shaders/raster_primary.glsl): the triangle meshes are rasterized with the path tracer
+// camera into an integer image holding the triangle seen through each pixel, bound on image unit 1
+// The camera rays then skip the loop over every triangle of the scene
+class GBuffer {
+public:
+    GBuffer(int width, int height);
+    ~GBuffer();
+
+    // Rasterizes the first width x height pixels, the samples being at jitter in the pixels instead of their center
+    void render(ObjectManager &objManager, const glm::vec3 &cameraPosition, const glm::mat4 &viewMatrix,
+                int width, int height, const glm::vec2 &jitter);
+
+    // Sub-pixel position of the samples of a pass, Halton sequence in bases 2 and 3
+    static glm::vec2 getJitter(int pass);
+
+private:
+    ShaderProgram program;
+
+    GLuint framebuffer;
+    GLuint hitTexture;
+    GLuint depthBuffer;
+};
+
+#endif // GBUFFER_HPP
@@ -0,0 +1,59 @@
+#include "GpuTimer.hpp"
+
+#include <algorithm>
+
+GpuTimer::GpuTimer() {
+    glGenQueries(2 * queryCount, &queries[0][0]);
+}
+
+GpuTimer::~GpuTimer() {
+    glDeleteQueries(2 * queryCount, &queries[0][0]);
+}
+
+void GpuTimer::collectResults() {
+    // Queries complete in order, starting from the oldest one which is the next to be reused
+    for (int i = 0; i < queryCount; i++) {
+        int idx = (current + i) % queryCount;
+        if (!pending[idx]) continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[idx][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(queries[idx][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[idx][1], GL_QUERY_RESULT, &end);
+        pending[idx] = false;
+
+        // Exponential average, the cost of a tile depends on the part of the scene it covers
+        double time = (end - start) / 1e6 / std::max(queryWork[idx], 1);
+        tileSampleTime = tileSampleTime == 0.0 ? time : 0.7 * tileSampleTime + 0.3 * time;
+    }
+}
+
+void GpuTimer::begin() {
+    collectResults();
+
+    // All the queries still in flight: this frame is not measured
+    measuring = !pending[current];
+    if (measuring) glQueryCounter(queries[current][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::end(int work) {
+    lastWork = work;
+    if (!measuring) return;
+
+    glQueryCounter(queries[current][1], GL_TIMESTAMP);
+    queryWork[current] = work;
+    pending[current] = true;
+    current = (current + 1) % queryCount;
+    measuring = false;
+}
+
+int GpuTimer::getWorkForBudget(float budget) const {
+    // Small first dispatch until the cost is known
+    if (tileSampleTime == 0.0) return 16;
+
+    double work = budget / tileSampleTime;
+    return (int)std::max(1.0, std::min(work, 2.0 * std::max(lastWork, 16)));
+}
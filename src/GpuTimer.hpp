@@ -0,0 +1,40 @@
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+#include <glad/gl.h>
+
+// GPU duration of the path tracing dispatches, measured with a pair of GL_TIMESTAMP queries
+// (some drivers leave compute work out of GL_TIME_ELAPSED)
+// Results are read a few frames later, when available, so the CPU never waits for the GPU
+// The cost is tracked per unit of work (one sample on one tile) to size the next dispatches
+class GpuTimer {
+public:
+    GpuTimer();
+    ~GpuTimer();
+
+    // Brackets the dispatches of a frame, work being the number of tile samples dispatched
+    void begin();
+    void end(int work);
+
+    // Tile samples that fit in budget milliseconds, at most twice the previous work so that cheap tiles
+    // do not lead to an oversized dispatch
+    int getWorkForBudget(float budget) const;
+
+    // Average GPU time of one tile sample (ms), 0 until the first query result
+    double getTileSampleTime() const { return tileSampleTime; }
+
+private:
+    void collectResults();
+
+    static const int queryCount = 4;
+    GLuint queries[queryCount][2]; // start and end timestamps
+    int queryWork[queryCount];
+    bool pending[queryCount] = {};
+    int current = 0;
+    bool measuring = false;
+
+    double tileSampleTime = 0.0;
+    int lastWork = 0;
+};
+
+#endif // GPU_TIMER_HPP
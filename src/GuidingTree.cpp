@@ -0,0 +1,175 @@
+#include "GuidingTree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+const float spatialThreshold = 12000.0f; // vertices of a leaf over the first iteration before it is split
+const float energyFraction = 0.01f;      // quadrants holding more than this fraction of the leaf energy are subdivided
+const int maxSpatialDepth = 24;
+const int maxQuadDepth = 16;
+const size_t maxQuadNodes = 1 << 20; // the leaves stop splitting beyond
+const double recordScale = 65536.0;  // GUIDE_RECORD_SCALE of shaders/guiding.glsl
+
+GuidingTree::~GuidingTree() {
+    glDeleteBuffers(1, &spatialBuffer);
+    glDeleteBuffers(1, &quadBuffer);
+    glDeleteBuffers(1, &recordBuffer);
+}
+
+void GuidingTree::clear() {
+    spatialNodes.assign(1, glm::ivec2(-1, 0));
+    quadNodes.assign(1, GuideQuadNode(glm::vec4(0.0f)));
+    iteration = 0;
+    iterationPasses = 0;
+    uploaded = false;
+}
+
+void GuidingTree::setBounds(glm::vec3 sceneMin, glm::vec3 sceneMax) {
+    // A cube, so that the halves along x, y, z in turn stay cubes, slightly larger than the scene
+    glm::vec3 center = 0.5f * (sceneMin + sceneMax);
+    float halfSize = 0.5f * std::max(sceneMax.x - sceneMin.x, std::max(sceneMax.y - sceneMin.y, sceneMax.z - sceneMin.z));
+    halfSize = halfSize * 1.01f + 1e-3f;
+
+    boundsMin = center - halfSize;
+    boundsMax = center + halfSize;
+    clear();
+}
+
+void GuidingTree::bind(ShaderProgram &shaderProgram, bool useGuiding) {
+    shaderProgram.set("useGuiding", (int)useGuiding);
+    shaderProgram.set("recordGuiding", (int)(useGuiding && isTraining()));
+    if (!useGuiding) return;
+
+    if (!uploaded) upload();
+    shaderProgram.set("guideBoundsMin", boundsMin);
+    shaderProgram.set("guideBoundsMax", boundsMax);
+    shaderProgram.set("guideCountOffset", (int)quadNodes.size() * 8);
+
+    // bindings 15 to 17 in shaders/guiding.glsl
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, spatialBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, quadBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, recordBuffer);
+}
+
+void GuidingTree::endPass() {
+    if (!isTraining()) return;
+
+    iterationPasses++;
+    if (iterationPasses < (1 << iteration)) return;
+
+    refine();
+    iteration++;
+    iterationPasses = 0;
+}
+
+void GuidingTree::refine() {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    std::vector<GLuint> records(quadNodes.size() * 8 + spatialNodes.size());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, recordBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, records.size() * sizeof(GLuint), records.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Energies of the iteration, summed from the leaf quadrants up, the children follow their parent
+    std::vector<GuideQuadNode> learned = quadNodes;
+    for (int i = (int)learned.size() - 1; i >= 0; i--) {
+        for (int q = 0; q < 4; q++) {
+            int child = learned[i].child[q];
+            if (child >= 0) {
+                const glm::vec4 &e = learned[child].energy;
+                learned[i].energy[q] = e.x + e.y + e.z + e.w;
+            } else {
+                uint64_t fixedPoint = (uint64_t)records[8 * i + 2 * q + 1] << 32 | records[8 * i + 2 * q];
+                learned[i].energy[q] = float(fixedPoint / recordScale);
+            }
+        }
+    }
+
+    std::vector<glm::ivec2> spatial;
+    std::vector<GuideQuadNode> quads;
+    const GLuint *counts = records.data() + quadNodes.size() * 8;
+    float threshold = spatialThreshold * std::sqrt(float(1 << iteration));
+
+    // Rebuilt breadth first, so that the two children of a node are next to each other. A node is a node of the
+    // previous tree, or one half of a leaf that was split, with the quadtree and half of the vertices of the leaf
+    struct Pending {
+        int old;
+        bool isHalf;
+        float vertexCount;
+        int depth;
+    };
+    std::vector<Pending> pending = {{0, false, (float)counts[0], 0}};
+    spatial.emplace_back(-1, 0);
+
+    for (size_t n = 0; n < pending.size(); n++) {
+        Pending node = pending[n];
+        bool isInterior = !node.isHalf && spatialNodes[node.old].x >= 0;
+
+        int axis = isInterior ? spatialNodes[node.old].x : -1;
+        if (!isInterior && node.vertexCount > threshold && node.depth < maxSpatialDepth && quads.size() < maxQuadNodes) {
+            axis = node.depth % 3;
+        }
+
+        if (axis >= 0) {
+            spatial[n] = glm::ivec2(axis, spatial.size());
+            for (int c = 0; c < 2; c++) {
+                if (isInterior) {
+                    int child = spatialNodes[node.old].y + c;
+                    pending.push_back({child, false, (float)counts[child], node.depth + 1});
+                } else {
+                    pending.push_back({node.old, true, 0.5f * node.vertexCount, node.depth + 1});
+                }
+                spatial.emplace_back(-1, 0);
+            }
+            continue;
+        }
+
+        // Leaf: its quadtree is rebuilt from the energies learned by the old leaf
+        int root = spatialNodes[node.old].y;
+        const glm::vec4 &e = learned[root].energy;
+        spatial[n] = glm::ivec2(-1, buildQuad(learned, root, e, e.x + e.y + e.z + e.w, 0, quads));
+    }
+
+    spatialNodes = spatial;
+    quadNodes = quads;
+    upload();
+}
+
+int GuidingTree::buildQuad(const std::vector<GuideQuadNode> &learned, int node, glm::vec4 energy, float total, int depth,
+                           std::vector<GuideQuadNode> &quads) const {
+    int index = quads.size();
+    quads.emplace_back(energy);
+
+    for (int q = 0; q < 4; q++) {
+        if (total <= 0.0f || energy[q] <= energyFraction * total || depth + 1 >= maxQuadDepth) continue;
+
+        // A quadrant that was a leaf spreads its energy evenly over its new children
+        int child = node >= 0 ? learned[node].child[q] : -1;
+        glm::vec4 childEnergy = child >= 0 ? learned[child].energy : glm::vec4(0.25f * energy[q]);
+        int childIndex = buildQuad(learned, child, childEnergy, total, depth + 1, quads);
+        quads[index].child[q] = childIndex;
+    }
+    return index;
+}
+
+void GuidingTree::upload() {
+    if (spatialBuffer == 0) glGenBuffers(1, &spatialBuffer);
+    if (quadBuffer == 0) glGenBuffers(1, &quadBuffer);
+    if (recordBuffer == 0) glGenBuffers(1, &recordBuffer);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, spatialBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, spatialNodes.size() * sizeof(glm::ivec2), spatialNodes.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, quadBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, quadNodes.size() * sizeof(GuideQuadNode), quadNodes.data(), GL_STATIC_DRAW);
+
+    // Radiance of each quadrant, then the vertex count of each spatial node
+    const GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, recordBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (quadNodes.size() * 8 + spatialNodes.size()) * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    uploaded = true;
+}
@@ -0,0 +1,69 @@
+#ifndef GUIDING_TREE_HPP
+#define GUIDING_TREE_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "ShaderProgram.hpp"
+
+// Node of a directional quadtree, std430 layout of shaders/guiding.glsl
+// Quadrant i covers x >= 0.5 when i & 1 and y >= 0.5 when i & 2 of the square of the node
+struct GuideQuadNode {
+    glm::vec4 energy; // learned by the previous iteration, used to draw the directions
+    glm::ivec4 child; // -1 for a leaf quadrant
+
+    GuideQuadNode(glm::vec4 energy) : energy(energy), child(-1) {}
+};
+
+// Spatial-directional tree of the path guiding (practical path guiding, Müller et al. 2017)
+// A binary tree splits the scene bounds in halves along x, y, z in turn, each leaf holds a quadtree over the
+// directions (cylindrical coordinates, shaders/guiding.glsl) with the radiance incident in each quadrant
+// The training passes record the radiance reaching the diffuse vertices of their paths, iteration k lasting 2^k
+// passes. At the end of an iteration the recorded radiance replaces the energies of the quadtrees, the leaves that
+// received many vertices are split, and the quadrants holding more than a fraction of the energy are subdivided
+class GuidingTree {
+public:
+    GuidingTree() { clear(); };
+    ~GuidingTree();
+
+    // Back to a single empty leaf, after a change of the scene
+    void clear();
+
+    // Cube around the scene, the tree is cleared when it changes
+    void setBounds(glm::vec3 boundsMin, glm::vec3 boundsMax);
+
+    // Sends useGuiding and recordGuiding, and when guiding binds the tree and the records on bindings 15 to 17
+    void bind(ShaderProgram &shaderProgram, bool useGuiding);
+
+    // Counts a pass recorded with recordGuiding, the tree is refined when it ends an iteration
+    void endPass();
+
+    // Passes still record the paths
+    bool isTraining() const { return iteration < trainingIterations; }
+    int getIteration() const { return iteration; }
+
+    static const int trainingIterations = 9; // 511 training passes
+
+private:
+    std::vector<glm::ivec2> spatialNodes; // x: split axis or -1 for a leaf, y: first child or quadtree root
+    std::vector<GuideQuadNode> quadNodes;
+
+    glm::vec3 boundsMin = glm::vec3(-1.0f);
+    glm::vec3 boundsMax = glm::vec3(1.0f);
+
+    int iteration = 0;
+    int iterationPasses = 0; // passes recorded in the current iteration
+
+    GLuint spatialBuffer = 0;
+    GLuint quadBuffer = 0;
+    GLuint recordBuffer = 0;
+    bool uploaded = false;
+
+    void refine();
+    int buildQuad(const std::vector<GuideQuadNode> &learned, int node, glm::vec4 energy, float total, int depth,
+                  std::vector<GuideQuadNode> &quads) const;
+    void upload();
+};
+
+#endif // GUIDING_TREE_HPP
@@ -0,0 +1,46 @@
+#include "LightReservoirs.hpp"
+
+LightReservoirs::~LightReservoirs() {
+    glDeleteBuffers(2, buffers);
+}
+
+void LightReservoirs::bind(ShaderProgram &shaderProgram, int passWidth, int passHeight) {
+    if (buffers[0] == 0) {
+        glGenBuffers(2, buffers);
+        for (GLuint buffer : buffers) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)width * height * reservoirSize, NULL, GL_DYNAMIC_COPY);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        clear();
+    }
+
+    shaderProgram.set("reservoirHistory", (int)(passWidth == historyWidth && passHeight == historyHeight));
+
+    // bindings 13 and 14 in shaders/restir.glsl
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, buffers[1 - current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, buffers[current]);
+}
+
+void LightReservoirs::endPass(int passWidth, int passHeight) {
+    if (buffers[0] == 0) return;
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    current = 1 - current;
+    historyWidth = passWidth;
+    historyHeight = passHeight;
+}
+
+void LightReservoirs::clear() {
+    historyWidth = 0;
+    historyHeight = 0;
+    if (buffers[0] == 0) return;
+
+    // Empty reservoirs (no candidate) in both buffers, never reused
+    const GLuint zero = 0;
+    for (GLuint buffer : buffers) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
@@ -0,0 +1,40 @@
+#ifndef LIGHT_RESERVOIRS_HPP
+#define LIGHT_RESERVOIRS_HPP
+
+#include <glad/gl.h>
+
+#include "ShaderProgram.hpp"
+
+// Per pixel reservoirs of the ReSTIR direct light (shaders/restir.glsl)
+// Every pass of the path tracer reads the reservoirs of the previous pass, at the pixel and around it,
+// and writes its own ones in the second buffer, the two buffers are swapped at the end of the pass
+// The buffers are only allocated once ReSTIR is used
+class LightReservoirs {
+public:
+    LightReservoirs(int width, int height) : width(width), height(height) {};
+    ~LightReservoirs();
+
+    // Binds the reservoirs of the previous pass on binding 13 and the ones of the pass on binding 14,
+    // and sends reservoirHistory, false when the previous pass had another image size
+    void bind(ShaderProgram &shaderProgram, int passWidth, int passHeight);
+
+    // The reservoirs written by the pass become the history of the next one
+    void endPass(int passWidth, int passHeight);
+
+    // Forgets the history, after a change of the scene
+    void clear();
+
+    static const int reservoirSize = 48; // std430 size of Reservoir
+
+private:
+    int width;
+    int height;
+
+    GLuint buffers[2] = {0, 0}; // previous and current pass
+    int current = 0;
+
+    int historyWidth = 0; // image size of the previous pass, 0 without history
+    int historyHeight = 0;
+};
+
+#endif // LIGHT_RESERVOIRS_HPP
@@ -0,0 +1,48 @@
+#include "LightSplats.hpp"
+
+LightSplats::~LightSplats() {
+    glDeleteBuffers(2, buffers);
+}
+
+void LightSplats::bind(ShaderProgram &shaderProgram, int passWidth, int passHeight) {
+    if (buffers[0] == 0) {
+        glGenBuffers(2, buffers);
+        for (GLuint buffer : buffers) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)width * height * 3 * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        clear();
+    }
+
+    shaderProgram.set("splatHistory", (int)(passWidth == historyWidth && passHeight == historyHeight));
+
+    // bindings 18 and 19 in shaders/bdpt.glsl
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, buffers[current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, buffers[1 - current]);
+}
+
+void LightSplats::endPass(int passWidth, int passHeight) {
+    if (buffers[0] == 0) return;
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    current = 1 - current;
+    clearBuffer(buffers[current]);
+    historyWidth = passWidth;
+    historyHeight = passHeight;
+}
+
+void LightSplats::clear() {
+    historyWidth = 0;
+    historyHeight = 0;
+    if (buffers[0] == 0) return;
+
+    for (GLuint buffer : buffers) clearBuffer(buffer);
+}
+
+void LightSplats::clearBuffer(GLuint buffer) {
+    const GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
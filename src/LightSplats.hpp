@@ -0,0 +1,41 @@
+#ifndef LIGHT_SPLATS_HPP
+#define LIGHT_SPLATS_HPP
+
+#include <glad/gl.h>
+
+#include "ShaderProgram.hpp"
+
+// Per pixel sums of the light tracing strategies of the bidirectional path tracer (shaders/bdpt.glsl)
+// The light subpaths of a pass splat their contributions on any pixel of the image, so they can only be added once
+// every pixel is done: the pixels of a pass add the splats of the previous pass, and write their own ones in the
+// second buffer, the two buffers are swapped and the new write buffer emptied at the end of the pass
+// The buffers are only allocated once the bidirectional path tracer is used
+class LightSplats {
+public:
+    LightSplats(int width, int height) : width(width), height(height) {};
+    ~LightSplats();
+
+    // Binds the splats of the pass on binding 18 and the ones of the previous pass on binding 19,
+    // and sends splatHistory, false when the previous pass had another image size
+    void bind(ShaderProgram &shaderProgram, int passWidth, int passHeight);
+
+    // The splats written by the pass are added by the next one
+    void endPass(int passWidth, int passHeight);
+
+    // Forgets the splats, after a change of the scene or of the camera
+    void clear();
+
+private:
+    int width;
+    int height;
+
+    GLuint buffers[2] = {0, 0}; // previous and current pass
+    int current = 0;
+
+    int historyWidth = 0; // image size of the previous pass, 0 without history
+    int historyHeight = 0;
+
+    void clearBuffer(GLuint buffer);
+};
+
+#endif // LIGHT_SPLATS_HPP
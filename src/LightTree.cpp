@@ -0,0 +1,200 @@
+#include "LightTree.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+const int bucketCount = 12;
+const float pi = 3.14159265359f;
+
+LightTree::~LightTree() {
+    if (nodeBuffer == 0) return;
+    glDeleteBuffers(1, &nodeBuffer);
+    glDeleteBuffers(1, &trailBuffer);
+}
+
+int LightTree::trailIndex(int type, int idx, int triangleIdx) {
+    if (type == 0) return idx;
+    if (type == 1) return 10 + idx;
+    return 20 + triangleIdx;
+}
+
+static glm::vec3 center(const LightNode &node) { return 0.5f * (node.boundsMin + node.boundsMax); }
+
+static float surfaceArea(const LightNode &node) {
+    glm::vec3 d = node.boundsMax - node.boundsMin;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// Smallest cone containing the cones a and b (DirectionCone::Union of PBRT v4)
+static void coneUnion(glm::vec3 axisA, float cosA, glm::vec3 axisB, float cosB, glm::vec3 &axis, float &cosTheta) {
+    float thetaA = std::acos(glm::clamp(cosA, -1.0f, 1.0f));
+    float thetaB = std::acos(glm::clamp(cosB, -1.0f, 1.0f));
+    float thetaD = std::acos(glm::clamp(glm::dot(axisA, axisB), -1.0f, 1.0f));
+
+    if (std::min(thetaD + thetaB, pi) <= thetaA) {
+        axis = axisA;
+        cosTheta = cosA;
+        return;
+    }
+    if (std::min(thetaD + thetaA, pi) <= thetaB) {
+        axis = axisB;
+        cosTheta = cosB;
+        return;
+    }
+
+    // Rotates axisA toward axisB until the new cone reaches the far side of both
+    float thetaO = 0.5f * (thetaA + thetaD + thetaB);
+    glm::vec3 rotationAxis = glm::cross(axisA, axisB);
+    if (thetaO >= pi || glm::dot(rotationAxis, rotationAxis) < 1e-12f) {
+        axis = axisA;
+        cosTheta = -1.0f;
+        return;
+    }
+
+    float thetaR = thetaO - thetaA;
+    axis = axisA * std::cos(thetaR) + glm::cross(glm::normalize(rotationAxis), axisA) * std::sin(thetaR);
+    cosTheta = std::cos(thetaO);
+}
+
+// Bounds of the emitters of two nodes, a node without power is empty
+static LightNode merge(const LightNode &a, const LightNode &b) {
+    if (a.power <= 0.0f) return b;
+    if (b.power <= 0.0f) return a;
+
+    glm::vec3 axis;
+    float cosThetaO;
+    coneUnion(a.axis, a.cosThetaO, b.axis, b.cosThetaO, axis, cosThetaO);
+
+    return LightNode(glm::min(a.boundsMin, b.boundsMin), glm::max(a.boundsMax, b.boundsMax), a.power + b.power, axis, cosThetaO,
+                     std::min(a.cosThetaE, b.cosThetaE), -1, -1, -1);
+}
+
+// Cost of a child in the surface area orientation heuristic: power, spread of the emission directions,
+// and surface area of the bounds stretched along the split axis (Kr) to avoid thin nodes
+static float cost(const LightNode &node, const LightNode &parent, int dim) {
+    float thetaO = std::acos(glm::clamp(node.cosThetaO, -1.0f, 1.0f));
+    float thetaE = std::acos(glm::clamp(node.cosThetaE, -1.0f, 1.0f));
+    float thetaW = std::min(thetaO + thetaE, pi);
+    float sinThetaO = std::sqrt(std::max(0.0f, 1.0f - node.cosThetaO * node.cosThetaO));
+    float orientation = 2.0f * pi * (1.0f - node.cosThetaO) +
+                        0.5f * pi * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + node.cosThetaO);
+
+    glm::vec3 diagonal = parent.boundsMax - parent.boundsMin;
+    float kr = std::max(diagonal.x, std::max(diagonal.y, diagonal.z)) / diagonal[dim];
+
+    return node.power * orientation * kr * surfaceArea(node);
+}
+
+void LightTree::build(std::vector<LightNode> emitters, int triangleCount) {
+    nodes.clear();
+    trails.assign(20 + triangleCount, GLuint(noTrail));
+
+    if (!emitters.empty()) buildNode(emitters, 0, emitters.size(), 0, 0);
+
+    uploaded = false;
+}
+
+void LightTree::buildNode(std::vector<LightNode> &emitters, int start, int end, GLuint trail, int depth) {
+    if (end - start == 1) {
+        const LightNode &leaf = emitters[start];
+        trails[trailIndex(leaf.type, leaf.idx, leaf.triangleIdx)] = trail;
+        nodes.push_back(leaf);
+        return;
+    }
+
+    LightNode bounds = emitters[start];
+    glm::vec3 centerMin = center(bounds);
+    glm::vec3 centerMax = centerMin;
+    for (int i = start + 1; i < end; i++) {
+        bounds = merge(bounds, emitters[i]);
+        centerMin = glm::min(centerMin, center(emitters[i]));
+        centerMax = glm::max(centerMax, center(emitters[i]));
+    }
+
+    // The worst split leaves all but one emitter on a side, which must still fit in the trail bits with median splits
+    int medianLevels = 0;
+    while ((1 << medianLevels) < end - start - 1) medianLevels++;
+    bool useHeuristic = depth + 1 + medianLevels <= maxDepth;
+
+    const LightNode empty(glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, glm::vec3(0.0f, 0.0f, 1.0f), 1.0f, 1.0f, -1, -1, -1);
+
+    int bestDim = -1;
+    int bestSplit = 0;
+    float bestCost = INFINITY;
+
+    for (int dim = 0; dim < 3 && useHeuristic; dim++) {
+        float extent = centerMax[dim] - centerMin[dim];
+        if (extent <= 0.0f) continue;
+
+        std::vector<LightNode> buckets(bucketCount, empty);
+        for (int i = start; i < end; i++) {
+            int b = std::min(int(bucketCount * (center(emitters[i])[dim] - centerMin[dim]) / extent), bucketCount - 1);
+            buckets[b] = merge(buckets[b], emitters[i]);
+        }
+
+        // Costs of the emitters below and above each split between buckets
+        std::vector<LightNode> above(bucketCount, empty);
+        for (int b = bucketCount - 1; b > 0; b--) above[b - 1] = merge(b < bucketCount - 1 ? above[b] : empty, buckets[b]);
+
+        LightNode below = empty;
+        for (int split = 1; split < bucketCount; split++) {
+            below = merge(below, buckets[split - 1]);
+            if (below.power <= 0.0f || above[split - 1].power <= 0.0f) continue;
+
+            float splitCost = cost(below, bounds, dim) + cost(above[split - 1], bounds, dim);
+            if (splitCost < bestCost) {
+                bestCost = splitCost;
+                bestDim = dim;
+                bestSplit = split;
+            }
+        }
+    }
+
+    int middle = start;
+    if (bestDim >= 0) {
+        float extent = centerMax[bestDim] - centerMin[bestDim];
+        middle = std::partition(emitters.begin() + start, emitters.begin() + end, [&](const LightNode &e) {
+                     return std::min(int(bucketCount * (center(e)[bestDim] - centerMin[bestDim]) / extent), bucketCount - 1) < bestSplit;
+                 }) - emitters.begin();
+    }
+
+    // Emitters at the same place, or too deep for the heuristic: median of the largest extent
+    if (middle == start || middle == end) {
+        glm::vec3 extent = centerMax - centerMin;
+        int dim = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        middle = (start + end) / 2;
+        std::nth_element(emitters.begin() + start, emitters.begin() + middle, emitters.begin() + end,
+                         [dim](const LightNode &a, const LightNode &b) { return center(a)[dim] < center(b)[dim]; });
+    }
+
+    int nodeIdx = nodes.size();
+    nodes.push_back(bounds);
+
+    buildNode(emitters, start, middle, trail, depth + 1);
+    nodes[nodeIdx].secondChild = nodes.size();
+    buildNode(emitters, middle, end, trail | (1u << depth), depth + 1);
+}
+
+void LightTree::upload() {
+    if (nodeBuffer == 0) glGenBuffers(1, &nodeBuffer);
+    if (trailBuffer == 0) glGenBuffers(1, &trailBuffer);
+
+    // Never empty, the buffers are bound even without emitters
+    const LightNode empty(glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, glm::vec3(0.0f, 0.0f, 1.0f), 1.0f, 1.0f, -1, -1, -1);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, nodeBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(nodes.size(), 1) * sizeof(LightNode), nodes.empty() ? &empty : nodes.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, trailBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, trails.size() * sizeof(GLuint), trails.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    uploaded = true;
+}
+
+void LightTree::setUniforms(ShaderProgram &shaderProgram) {
+    if (!uploaded) upload();
+    shaderProgram.set("lightTreeSize", (int)nodes.size());
+
+    // bindings 11 and 12 in shaders/light_tree.glsl
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, nodeBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, trailBuffer);
+}
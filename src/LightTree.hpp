@@ -0,0 +1,68 @@
+#ifndef LIGHT_TREE_HPP
+#define LIGHT_TREE_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "ShaderProgram.hpp"
+
+// Node of the light BVH, std430 layout of shaders/light_tree.glsl
+// The normals of the emitters below the node are within acos(cosThetaO) of axis,
+// and they emit up to acos(cosThetaE) away from their normal
+struct LightNode {
+    glm::vec3 boundsMin;
+    float power;
+    glm::vec3 boundsMax;
+    float cosThetaO;
+    glm::vec3 axis;
+    float cosThetaE;
+    int secondChild; // -1 for a leaf, the first child of an interior node follows it
+    int type;        // emitter of a leaf, as the lights of scene.glsl
+    int idx;
+    int triangleIdx; // emissive triangles are leaves of their own
+
+    LightNode(glm::vec3 boundsMin, glm::vec3 boundsMax, float power, glm::vec3 axis, float cosThetaO, float cosThetaE, int type, int idx, int triangleIdx)
+        : boundsMin(boundsMin), power(power), boundsMax(boundsMax), cosThetaO(cosThetaO), axis(axis), cosThetaE(cosThetaE), secondChild(-1), type(type), idx(idx),
+          triangleIdx(triangleIdx) {}
+};
+
+// Bounding volume hierarchy over the emitters, traversed by the light sampling of the shaders
+// A light is picked by walking down from the root, each child being chosen in proportion to its importance
+// (power, distance and orientation bounds seen from the shaded point), so scenes with many emitters spend their
+// shadow rays on the ones that matter
+// The nodes are split by the surface area orientation heuristic of PBRT v4 (Conty Estevez and Kulla 2018)
+// The trail of an emitter records the branches taken from the root (bit i: second child at depth i),
+// the shaders use it to find the probability of a light hit by a BSDF ray
+class LightTree {
+public:
+    LightTree() {};
+    ~LightTree();
+
+    // Builds the tree over the emitters, given as leaves, it is uploaded with the trails by the next setUniforms
+    void build(std::vector<LightNode> emitters, int triangleCount);
+
+    int getSize() const { return (int)nodes.size(); }
+
+    // Sends lightTreeSize and binds the nodes and the trails on bindings 11 and 12
+    void setUniforms(ShaderProgram &shaderProgram);
+
+    // Index of the trail of an emitter: 10 spheres, 10 tores, then the triangles
+    static int trailIndex(int type, int idx, int triangleIdx);
+
+    static const unsigned int noTrail = 0xFFFFFFFF; // not an emitter
+    static const int maxDepth = 32;
+
+private:
+    std::vector<LightNode> nodes;
+    std::vector<GLuint> trails;
+
+    GLuint nodeBuffer = 0;
+    GLuint trailBuffer = 0;
+    bool uploaded = false;
+
+    void buildNode(std::vector<LightNode> &emitters, int start, int end, GLuint trail, int depth);
+    void upload();
+};
+
+#endif // LIGHT_TREE_HPP
@@ -9,40 +9,27 @@
 #define PI 3.14159265359
 
 // Constructeur de la classe Mesh
+// The vertex buffers are created by the first draw, so that the scenes can be loaded without OpenGL context
 Mesh::Mesh(const std::vector<glm::vec3> &vertices, const std::vector<glm::vec3> &normals, const std::vector<unsigned int> &indices, std::string name)
     : vertices(vertices), normals(normals), indices(indices), indexCount(indices.size()), name(name) {
 
     hasTextures = false;
-
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &NBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, NBO);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(1);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-    glBindVertexArray(0);
+    hasNormals = true;
 }
 
 Mesh::Mesh(const std::vector<glm::vec3> &vertices, const std::vector<glm::vec3> &normals, const std::vector<glm::vec2> &textures, const std::vector<unsigned int> &indices, std::string name)
-    : vertices(vertices), normals(normals), indices(indices), indexCount(indices.size()), name(name) {
+    : vertices(vertices), normals(normals), textures(textures), indices(indices), indexCount(indices.size()), name(name) {
 
     hasTextures = (textures.size() != 0);
     hasNormals = (normals.size() != 0);
+}
 
+unsigned int Mesh::getVAO() {
+    if (!uploaded) upload();
+    return VAO;
+}
+
+void Mesh::upload() {
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &NBO);
@@ -74,6 +61,7 @@ Mesh::Mesh(const std::vector<glm::vec3> &vertices, const std::vector<glm::vec3>
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
     glBindVertexArray(0);
+    uploaded = true;
 }
 
 // Fonction pour dessiner le maillage
@@ -86,18 +74,19 @@ void Mesh::draw(unsigned int shaderProgram, glm::vec3 &color, glm::mat4 &modelMa
     unsigned int modelLoc = glGetUniformLocation(shaderProgram, "model");
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelMat));
 
-    glBindVertexArray(VAO);
+    glBindVertexArray(getVAO());
     glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
 }
 
 // Destructeur de la classe Mesh
 Mesh::~Mesh() {
+    if (!uploaded) return;
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &NBO);
+    glDeleteBuffers(1, &TBO);
     glDeleteBuffers(1, &EBO);
-    if (hasNormals) glDeleteBuffers(1, &NBO);
-    if (hasTextures) glDeleteBuffers(1, &TBO);
 }
 
 // Fonction statique pour créer un cube
@@ -181,8 +170,6 @@ std::shared_ptr<Mesh> Mesh::createCube() {
 
 std::shared_ptr<Mesh> Mesh::createSphere(int resolution) {
 
-    int total = resolution * resolution;
-
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
     std::vector<unsigned int> indices;
@@ -190,8 +177,6 @@ std::shared_ptr<Mesh> Mesh::createSphere(int resolution) {
     glm::vec3 pos;
     float phi, theta;
 
-    int triShift[6][2] = {{0, 0}, {1, 1}, {0, 1}, {0, 0}, {1, 0}, {1, 1}};
-
     for (int i = 0; i <= resolution; i++) {
         for (int j = 0; j <= resolution; j++) {
             phi = -i * 2 * PI / resolution; // col
@@ -354,8 +339,6 @@ std::shared_ptr<Mesh> Mesh::createBox() {
 
 std::shared_ptr<Mesh> Mesh::createTore(int resolution) {
 
-    int total = resolution * resolution;
-
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
     std::vector<unsigned int> indices;
@@ -363,8 +346,6 @@ std::shared_ptr<Mesh> Mesh::createTore(int resolution) {
     glm::vec3 pos;
     float phi, theta;
 
-    int triShift[6][2] = {{0, 0}, {1, 1}, {0, 1}, {0, 0}, {1, 0}, {1, 1}};
-
     for (int i = 0; i <= resolution; i++) {
         for (int j = 0; j <= resolution; j++) {
             phi = -i * 2 * PI / resolution; // col
@@ -23,7 +23,7 @@ public:
     static std::shared_ptr<Mesh> createQuad();
     static std::shared_ptr<Mesh> createTore(int resolution = 16);
 
-    const unsigned int getVAO() const { return VAO; }
+    unsigned int getVAO(); // creates the vertex buffers on the first call
     const unsigned int getIndexCount() const { return indexCount; }
 
     void setName(std::string newName) { name = newName; }
@@ -36,12 +36,16 @@ public:
 private:
     unsigned int VAO, VBO, NBO, TBO, EBO;
     bool hasNormals, hasTextures;
+    bool uploaded = false;
     size_t indexCount;
     std::string name;
 
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> textures;
     std::vector<unsigned int> indices;
+
+    void upload();
 };
 
 #endif // MESH_HPP
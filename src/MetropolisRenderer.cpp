@@ -0,0 +1,169 @@
+#include "MetropolisRenderer.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+const int chainSize = 32;    // std430 size of MltChain in shaders/compute_shader_mlt.glsl
+const int primarySampler = 3; // SAMPLER_PRIMARY of shaders/sampler.glsl
+const int tileSize = 16;      // local size of the kernel
+
+// Stages of shaders/compute_shader_mlt.glsl
+enum MltStage {
+    MLT_BOOTSTRAP = 0,
+    MLT_START = 1,
+    MLT_MUTATE = 2,
+    MLT_RESOLVE = 3
+};
+
+MetropolisRenderer::~MetropolisRenderer() {
+    glDeleteBuffers(1, &vectorBuffer);
+    glDeleteBuffers(1, &chainBuffer);
+    glDeleteBuffers(1, &candidateBuffer);
+    glDeleteBuffers(1, &startBuffer);
+    glDeleteBuffers(1, &splatBuffer);
+    glDeleteBuffers(1, &statsBuffer);
+}
+
+void MetropolisRenderer::allocate(int vectorDimensions) {
+    if (splatBuffer == 0) {
+        GLuint *buffers[] = {&chainBuffer, &candidateBuffer, &startBuffer, &splatBuffer, &statsBuffer};
+        GLsizeiptr sizes[] = {chainCount * chainSize, 2 * chainCount * chainSize, chainCount * sizeof(GLuint),
+                              (GLsizeiptr)(width * height * 3 * sizeof(GLuint)), 4 * sizeof(GLuint)};
+        for (int i = 0; i < 5; i++) {
+            glGenBuffers(1, buffers[i]);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffers[i]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[i], NULL, GL_DYNAMIC_COPY);
+        }
+    }
+
+    // The vectors follow the maximum bounces of the scene
+    if (vectorDimensions != dimensions) {
+        glDeleteBuffers(1, &vectorBuffer);
+        glGenBuffers(1, &vectorBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, vectorBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)2 * chainCount * vectorDimensions * 4 * sizeof(GLfloat), NULL, GL_DYNAMIC_COPY);
+        dimensions = vectorDimensions;
+    }
+
+    const GLuint zero = 0;
+    for (GLuint buffer : {splatBuffer, statsBuffer}) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MetropolisRenderer::bindBuffers() {
+    // binding 20 in shaders/sampler.glsl, 21 to 25 in shaders/compute_shader_mlt.glsl
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 20, vectorBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 21, chainBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, candidateBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, startBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, splatBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 25, statsBuffer);
+}
+
+void MetropolisRenderer::bootstrap() {
+    program.set("mltStage", MLT_BOOTSTRAP);
+    program.set("tileOffset", 0);
+    glDispatchCompute(2 * chainGroups, 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    std::vector<GLfloat> candidates(2 * chainCount * chainSize / sizeof(GLfloat));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, candidateBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, candidates.size() * sizeof(GLfloat), candidates.data());
+
+    // Luminance of each candidate (contribution.w), summed into a CDF
+    const int stride = chainSize / sizeof(GLfloat);
+    std::vector<double> cdf(2 * chainCount);
+    double sum = 0.0;
+    for (int i = 0; i < 2 * chainCount; i++) {
+        sum += std::max(candidates[i * stride + 3], 0.0f);
+        cdf[i] = sum;
+    }
+    normalization = (float)(sum / (2 * chainCount));
+
+    // A black image leaves the chains on any candidate, their splats are all scaled by 0
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> uniform(0.0, sum);
+    std::vector<GLuint> starts(chainCount);
+    for (int c = 0; c < chainCount; c++) {
+        if (sum > 0.0) starts[c] = (GLuint)std::min<size_t>(std::upper_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin(), 2 * chainCount - 1);
+        else starts[c] = c;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, startBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, starts.size() * sizeof(GLuint), starts.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    program.set("mltStage", MLT_START);
+    glDispatchCompute(chainGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    mutationsPerPixel = 0.0f;
+    smallProposed = smallAccepted = largeProposed = largeAccepted = 0.0;
+    std::cout << "[mlt] bootstrap: " << 2 * chainCount << " candidates, normalization=" << normalization << std::endl;
+}
+
+void MetropolisRenderer::render(int firstGroup, int groups, int pass, int spp, int maxBounces,
+                                const std::function<void(ShaderProgram &)> &setUniforms) {
+    // u, v per bounce, the camera pattern and the emission of the last vertex
+    int vectorDimensions = std::min(2 * maxBounces + 3, maxDimensions);
+    if (pass == 0 && firstGroup == 0) allocate(vectorDimensions);
+
+    program.use();
+    setUniforms(program);
+    program.set("samplerType", primarySampler);
+    program.set("useRasterPrimary", 0);
+    program.set("usePrimaryCache", 0);
+    program.set("useReSTIR", 0);
+    program.set("useGuiding", 0);
+    program.set("recordGuiding", 0);
+    program.set("useTileList", 0);
+    program.set("frameCount", pass);
+    program.set("spp", spp);
+    program.set("maxBounces", maxBounces);
+    program.set("mltDimensions", dimensions);
+    bindBuffers();
+
+    if (pass == 0 && firstGroup == 0) bootstrap();
+
+    program.set("mltStage", MLT_MUTATE);
+    program.set("tileOffset", firstGroup);
+    glDispatchCompute(groups, 1, 1);
+}
+
+void MetropolisRenderer::resolve(int pass, int spp, const std::function<void(ShaderProgram &)> &setUniforms) {
+    if (splatBuffer == 0) return;
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    float passMutations = (float)chainCount * spp / ((float)width * height);
+    mutationsPerPixel += passMutations;
+
+    program.use();
+    setUniforms(program);
+    program.set("useTileList", 0);
+    program.set("frameCount", pass);
+    program.set("mltStage", MLT_RESOLVE);
+    program.set("mltNormalization", normalization);
+    program.set("mltMutationsPerPixel", passMutations);
+    program.set("tileOffset", 0);
+    bindBuffers();
+
+    int tiles = ((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+    glDispatchCompute(tiles, 1, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    GLuint stats[4];
+    const GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), stats);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    smallProposed += stats[0];
+    smallAccepted += stats[1];
+    largeProposed += stats[2];
+    largeAccepted += stats[3];
+}
@@ -0,0 +1,64 @@
+#ifndef METROPOLIS_RENDERER_HPP
+#define METROPOLIS_RENDERER_HPP
+
+#include <glad/gl.h>
+#include <functional>
+
+#include "ComputeShader.hpp"
+
+// Primary sample space Metropolis light transport (shaders/compute_shader_mlt.glsl): chainCount Markov chains mutate
+// the random numbers of the path tracer and splat their samples on the image. A pass runs spp mutations per chain,
+// dispatched by groups of 256 chains, which take the place of the tiles of the path tracer in the frame time budget
+// The first pass of a render bootstraps the chains: the mean luminance of random candidates normalizes the image,
+// and the chains start on candidates picked proportionally to their luminance
+// The buffers are only allocated once the Metropolis mode is used
+class MetropolisRenderer {
+public:
+    MetropolisRenderer(int width, int height) : program("shaders/compute_shader_mlt.glsl"), width(width), height(height) {};
+    ~MetropolisRenderer();
+
+    // Runs spp mutations on the chain groups [firstGroup, firstGroup + groups), bootstrapping the chains at the start
+    // of pass 0. setUniforms sends the scene, camera and render settings to the kernel
+    void render(int firstGroup, int groups, int pass, int spp, int maxBounces, const std::function<void(ShaderProgram &)> &setUniforms);
+
+    // Adds the splats of the pass to the image bound on image unit 0, each pixel weighted by the mutations per pixel
+    // of the pass, and collects the acceptance counters
+    void resolve(int pass, int spp, const std::function<void(ShaderProgram &)> &setUniforms);
+
+    // Since the bootstrap, the acceptance rates are -1 before any mutation
+    float getSmallStepAcceptance() const { return smallProposed > 0 ? (float)smallAccepted / smallProposed : -1.0f; }
+    float getLargeStepAcceptance() const { return largeProposed > 0 ? (float)largeAccepted / largeProposed : -1.0f; }
+    float getMutationsPerPixel() const { return mutationsPerPixel; }
+
+    static const int chainGroups = 256;
+    static const int chainCount = chainGroups * 256;
+    static const int maxDimensions = 32; // 4D patterns per vector, the path tracer draws 2 per bounce
+
+private:
+    void allocate(int dimensions);
+    void bootstrap();
+    void bindBuffers();
+
+    ComputeShader program;
+
+    int width;
+    int height;
+    int dimensions = 0;
+
+    GLuint vectorBuffer = 0;    // two primary sample vectors per chain
+    GLuint chainBuffer = 0;
+    GLuint candidateBuffer = 0; // two per chain
+    GLuint startBuffer = 0;
+    GLuint splatBuffer = 0;
+    GLuint statsBuffer = 0;
+
+    float normalization = 0.0f;
+    float mutationsPerPixel = 0.0f; // since the bootstrap
+
+    double smallProposed = 0.0;
+    double smallAccepted = 0.0;
+    double largeProposed = 0.0;
+    double largeAccepted = 0.0;
+};
+
+#endif // METROPOLIS_RENDERER_HPP
@@ -2,6 +2,8 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -62,7 +64,7 @@ const std::vector<int> &ObjectManager::getObjectsPerMesh(const std::string &mesh
 
 void ObjectManager::drawAll(ShaderProgram &shaderProgram) {
     shaderProgram.use();
-    for (int i = 0; i < meshes.size(); i++) {
+    for (size_t i = 0; i < meshes.size(); i++) {
         glBindVertexArray(meshes[i]->getVAO());
 
         for (int matIdx : objectsPerMesh[i]) {
@@ -77,16 +79,97 @@ void ObjectManager::drawAll(ShaderProgram &shaderProgram) {
     }
 }
 
+// Draws the objects of the triangle buffer built by genAllTriangles, in the same order, with the index
+// of their entry in triangleMeshes and of their first triangle
+void ObjectManager::drawTriangleMeshes(ShaderProgram &shaderProgram) {
+    shaderProgram.use();
+    for (size_t i = 0; i < triangleToMat.size(); i++) {
+        const std::shared_ptr<Mesh> &mesh = meshes[idxToMesh[triangleToMat[i].matIdx].first];
+        glBindVertexArray(mesh->getVAO());
+
+        shaderProgram.set("model", objects[triangleToMat[i].matIdx].getModel());
+        shaderProgram.set("triangleMeshIdx", (int)i);
+        shaderProgram.set("firstTriangle", triangleToMat[i].startIdx);
+
+        glDrawElements(GL_TRIANGLES, mesh->getIndexCount(), GL_UNSIGNED_INT, 0);
+    }
+    glBindVertexArray(0);
+}
+
+void ObjectManager::setUniforms(ShaderProgram &shaderProgram) {
+    lights.clear();
+
+    const std::vector<int> &spheres = getObjectsPerMesh("Sphere");
+    for (size_t i = 0; i < spheres.size(); i++) {
+        const Material &obj = objects[spheres[i]];
+        shaderProgram.setArray("spheres", i, "pos", obj.getPos());
+        shaderProgram.setArray("spheres", i, "r", obj.getSize()[0]);
+        shaderProgram.setArray("spheres", i, "mat.color", obj.getColor());
+        shaderProgram.setArray("spheres", i, "mat.emissionColor", obj.getEmiColor());
+        shaderProgram.setArray("spheres", i, "mat.emissionStrength", obj.getEmissionStrength());
+        shaderProgram.setArray("spheres", i, "mat.smoothness", obj.getSmoothness());
+        shaderProgram.setArray("spheres", i, "mat.reflexivity", obj.getReflexivity());
+
+        if (obj.getEmissionStrength() > 0) lights.emplace_back(0, i);
+    }
+
+    shaderProgram.set("sphereCount", (int)spheres.size());
+
+    const std::vector<int> &tores = getObjectsPerMesh("Tore");
+    for (size_t i = 0; i < tores.size(); i++) {
+        const Material &obj = objects[tores[i]];
+        shaderProgram.setArray("tores", i, "pos", obj.getPos());
+        shaderProgram.setArray("tores", i, "R", obj.getSize()[0]);
+        shaderProgram.setArray("tores", i, "r", 0.1f);
+        shaderProgram.setArray("tores", i, "mat.color", obj.getColor());
+        shaderProgram.setArray("tores", i, "mat.emissionColor", obj.getEmiColor());
+        shaderProgram.setArray("tores", i, "mat.emissionStrength", obj.getEmissionStrength());
+        shaderProgram.setArray("tores", i, "mat.smoothness", obj.getSmoothness());
+        shaderProgram.setArray("tores", i, "mat.reflexivity", obj.getReflexivity());
+
+        if (obj.getEmissionStrength() > 0) lights.emplace_back(1, i);
+    }
+
+    shaderProgram.set("toreCount", (int)tores.size());
+
+    for (size_t i = 0; i < triangleToMat.size(); i++) {
+        const Material &obj = objects[triangleToMat[i].matIdx];
+        shaderProgram.setArray("triangleMeshes", i, "startIdx", triangleToMat[i].startIdx);
+        shaderProgram.setArray("triangleMeshes", i, "endIdx", triangleToMat[i].endIdx);
+        shaderProgram.setArray("triangleMeshes", i, "mat.color", obj.getColor());
+        shaderProgram.setArray("triangleMeshes", i, "mat.emissionColor", obj.getEmiColor());
+        shaderProgram.setArray("triangleMeshes", i, "mat.emissionStrength", obj.getEmissionStrength());
+        shaderProgram.setArray("triangleMeshes", i, "mat.smoothness", obj.getSmoothness());
+        shaderProgram.setArray("triangleMeshes", i, "mat.reflexivity", obj.getReflexivity());
+
+        if (obj.getEmissionStrength() > 0) lights.emplace_back(2, i);
+    }
+
+    shaderProgram.set("triangleMeshCount", (int)triangleToMat.size());
+
+    environment.setUniforms(shaderProgram);
+    if (environment.isLoaded()) lights.emplace_back(3, 0);
+
+    lightTree.setUniforms(shaderProgram);
+
+    for (size_t i = 0; i < lights.size(); i++) {
+        shaderProgram.setArray("lights", i, "type", lights[i].type);
+        shaderProgram.setArray("lights", i, "idx", lights[i].idx);
+    }
+
+    shaderProgram.set("lightCount", (int)lights.size());
+}
+
 void ObjectManager::genNames() {
     names.clear();
-    for (int i = 0; i < objects.size(); i++) {
+    for (size_t i = 0; i < objects.size(); i++) {
         names.push_back(meshes[idxToMesh[i].first]->getName() + " " + std::to_string(idxToMesh[i].second));
     }
 }
 
 void ObjectManager::genMeshNames() {
     meshNames.clear();
-    for (int i = 0; i < meshes.size(); i++) {
+    for (size_t i = 0; i < meshes.size(); i++) {
         meshNames.push_back(meshes[i]->getName());
     }
 }
@@ -98,13 +181,13 @@ void ObjectManager::removeObject(int idx) {
 
     objects.erase(objects.begin() + idx);
 
-    for (int i = idx + 1; i < idxToMesh.size(); i++) {
+    for (size_t i = idx + 1; i < idxToMesh.size(); i++) {
         objectsPerMesh[idxToMesh[i].first][idxToMesh[i].second]--;
     }
 
     objectsPerMesh[meshIdx].erase(objectsPerMesh[meshIdx].begin() + objIdxInMesh);
 
-    for (int i = 0; i < idxToMesh.size(); i++) {
+    for (size_t i = 0; i < idxToMesh.size(); i++) {
 
         if (idxToMesh[i].first == meshIdx && idxToMesh[i].second > objIdxInMesh)
             idxToMesh[i].second--;
@@ -122,7 +205,7 @@ void ObjectManager::saveScene(const std::string &filename) {
         std::cerr << "Erreur lors de l'ouverture du fichier pour l'écriture.\n";
         return;
     }
-    for (int i = 0; i < objects.size(); i++) {
+    for (size_t i = 0; i < objects.size(); i++) {
         outfile << "MESH " << meshNames[idxToMesh[i].first] << "\n";
         outfile << "COLOR " << objects[i].getColor().r << " " << objects[i].getColor().g << " " << objects[i].getColor().b << "\n";
         outfile << "EMICOLOR " << objects[i].getEmiColor().r << " " << objects[i].getEmiColor().g << " " << objects[i].getEmiColor().b << "\n";
@@ -134,6 +217,9 @@ void ObjectManager::saveScene(const std::string &filename) {
         outfile << "ROTATION " << objects[i].getRotation().x << " " << objects[i].getRotation().y << " " << objects[i].getRotation().z << "\n";
         outfile << ".\n";
     }
+    if (environment.isLoaded()) {
+        outfile << "ENVIRONMENT " << environment.getFilename() << " " << environment.getStrength() << "\n";
+    }
     outfile.close();
 }
 
@@ -152,6 +238,9 @@ void ObjectManager::loadScene(const std::string &filename) {
     float reflexivity = 0.0f;
     float emissionStrength = 0.0f;
 
+    std::string environmentFile;
+    float environmentStrength = 1.0f;
+
     while (infile >> word) {
         if (word == "MESH") {
             infile >> mesh;
@@ -173,10 +262,16 @@ void ObjectManager::loadScene(const std::string &filename) {
             infile >> rotation.x >> rotation.y >> rotation.z;
         } else if (word == ".") {
             addObject(Material(color, emiColor, emissionStrength, smoothness, reflexivity, Transformation(pos, size, rotation)), mesh);
+        } else if (word == "ENVIRONMENT") {
+            infile >> environmentFile >> environmentStrength;
         }
     }
 
     infile.close();
+
+    // Without an environment map the scene keeps the sky gradient of getAmbientLight
+    environment.load(environmentFile);
+    environment.setStrength(environmentStrength);
 }
 
 void ObjectManager::genAllTriangles() {
@@ -205,15 +300,145 @@ void ObjectManager::genAllTriangles() {
             const glm::mat4 &model = objects[idx].getModel();
             glm::mat3 modelNorm = glm::mat3(transpose(inverse(model)));
 
-            for (int i = 0; i < vertices.size(); i++) {
+            for (size_t i = 0; i < vertices.size(); i++) {
                 transVertices[i] = glm::vec3(model * glm::vec4(vertices[i], 1.0));
                 // TODO: one normal per vertex
                 transNormals[i] = normalize(glm::vec3(modelNorm * normals[i]));
             }
-            for (int i = 0; i < indices.size(); i += 3) {
+            for (size_t i = 0; i < indices.size(); i += 3) {
                 // TODO: one normal per vertex
                 trianglesBuffer.emplace_back(transVertices[indices[i]], transVertices[indices[i + 1]], transVertices[indices[i + 2]], transNormals[indices[i]]);
             }
         }
     }
+
+    buildLightTree();
+}
+
+void ObjectManager::getBounds(glm::vec3 &boundsMin, glm::vec3 &boundsMax) {
+    boundsMin = glm::vec3(INFINITY);
+    boundsMax = glm::vec3(-INFINITY);
+
+    for (int idx : getObjectsPerMesh("Sphere")) {
+        boundsMin = glm::min(boundsMin, objects[idx].getPos() - objects[idx].getSize()[0]);
+        boundsMax = glm::max(boundsMax, objects[idx].getPos() + objects[idx].getSize()[0]);
+    }
+
+    for (int idx : getObjectsPerMesh("Tore")) {
+        float extent = objects[idx].getSize()[0] + 0.1f; // r of setUniforms
+        boundsMin = glm::min(boundsMin, objects[idx].getPos() - extent);
+        boundsMax = glm::max(boundsMax, objects[idx].getPos() + extent);
+    }
+
+    for (const Triangle &tri : trianglesBuffer) {
+        boundsMin = glm::min(boundsMin, glm::min(tri.v0, glm::min(tri.v1, tri.v2)));
+        boundsMax = glm::max(boundsMax, glm::max(tri.v0, glm::max(tri.v1, tri.v2)));
+    }
+
+    if (boundsMin.x > boundsMax.x) {
+        boundsMin = glm::vec3(-1.0f);
+        boundsMax = glm::vec3(1.0f);
+    }
+}
+
+void ObjectManager::getObjectBounds(int idx, glm::vec3 &boundsMin, glm::vec3 &boundsMax) {
+    const std::string &meshName = meshes[idxToMesh[idx].first]->getName();
+    if (meshName == "Sphere" || meshName == "Tore") {
+        float extent = objects[idx].getSize()[0] + (meshName == "Tore" ? 0.1f : 0.0f);
+        boundsMin = objects[idx].getPos() - extent;
+        boundsMax = objects[idx].getPos() + extent;
+        return;
+    }
+
+    boundsMin = glm::vec3(INFINITY);
+    boundsMax = glm::vec3(-INFINITY);
+    for (const TriangleMeshInfo &info : triangleToMat) {
+        if (info.matIdx != idx) continue;
+        for (int i = info.startIdx; i < info.endIdx; i++) {
+            const Triangle &tri = trianglesBuffer[i];
+            boundsMin = glm::min(boundsMin, glm::min(tri.v0, glm::min(tri.v1, tri.v2)));
+            boundsMax = glm::max(boundsMax, glm::max(tri.v0, glm::max(tri.v1, tri.v2)));
+        }
+    }
+}
+
+bool ObjectManager::isEmissive(int idx) const {
+    return objects[idx].getEmissionStrength() > 0.0f && glm::dot(objects[idx].getEmiColor(), glm::vec3(1.0f)) > 0.0f;
+}
+
+void ObjectManager::markDirty(int idx) {
+    if (isEmissive(idx)) allDirty = true;
+
+    glm::vec3 objMin, objMax;
+    getObjectBounds(idx, objMin, objMax);
+    dirtyMin = glm::min(dirtyMin, objMin);
+    dirtyMax = glm::max(dirtyMax, objMax);
+
+    if (std::find(dirtyObjects.begin(), dirtyObjects.end(), idx) == dirtyObjects.end()) dirtyObjects.push_back(idx);
+}
+
+bool ObjectManager::takeDirtyBounds(glm::vec3 &boundsMin, glm::vec3 &boundsMax, bool &all) {
+    for (int idx : dirtyObjects) {
+        if (idx >= (int)objects.size()) continue;
+        if (isEmissive(idx)) allDirty = true;
+
+        glm::vec3 objMin, objMax;
+        getObjectBounds(idx, objMin, objMax);
+        dirtyMin = glm::min(dirtyMin, objMin);
+        dirtyMax = glm::max(dirtyMax, objMax);
+    }
+
+    bool dirty = allDirty || dirtyMin.x <= dirtyMax.x;
+    boundsMin = dirtyMin;
+    boundsMax = dirtyMax;
+    all = allDirty;
+
+    dirtyObjects.clear();
+    dirtyMin = glm::vec3(INFINITY);
+    dirtyMax = glm::vec3(-INFINITY);
+    allDirty = false;
+    return dirty;
+}
+
+void ObjectManager::buildLightTree() {
+    std::vector<LightNode> emitters;
+
+    // Power emitted on the hemisphere of each surface point, times the area
+    auto power = [](const Material &obj, float area) {
+        glm::vec3 emission = obj.getEmiColor() * obj.getEmissionStrength();
+        return glm::dot(emission, glm::vec3(0.2126f, 0.7152f, 0.0722f)) * area * 3.14159265359f;
+    };
+
+    // Spheres and tores emit in every direction
+    const std::vector<int> &spheres = getObjectsPerMesh("Sphere");
+    for (size_t i = 0; i < spheres.size(); i++) {
+        const Material &obj = objects[spheres[i]];
+        float r = obj.getSize()[0];
+        float phi = power(obj, 4.0f * 3.14159265359f * r * r);
+        if (phi > 0) emitters.emplace_back(obj.getPos() - r, obj.getPos() + r, phi, glm::vec3(0.0f, 0.0f, 1.0f), -1.0f, 0.0f, 0, i, -1);
+    }
+
+    const std::vector<int> &tores = getObjectsPerMesh("Tore");
+    for (size_t i = 0; i < tores.size(); i++) {
+        const Material &obj = objects[tores[i]];
+        float R = obj.getSize()[0];
+        float r = 0.1f; // as in setUniforms
+        glm::vec3 extent(R + r, R + r, r);
+        float phi = power(obj, 4.0f * 3.14159265359f * 3.14159265359f * R * r);
+        if (phi > 0) emitters.emplace_back(obj.getPos() - extent, obj.getPos() + extent, phi, glm::vec3(0.0f, 0.0f, 1.0f), -1.0f, 0.0f, 1, i, -1);
+    }
+
+    // Triangles are one-sided, they emit on the hemisphere of their normal
+    for (size_t m = 0; m < triangleToMat.size(); m++) {
+        const Material &obj = objects[triangleToMat[m].matIdx];
+        if (obj.getEmissionStrength() <= 0) continue;
+
+        for (int t = triangleToMat[m].startIdx; t < triangleToMat[m].endIdx; t++) {
+            const Triangle &tri = trianglesBuffer[t];
+            float phi = power(obj, 0.5f * glm::length(glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0)));
+            if (phi > 0) emitters.emplace_back(glm::min(tri.v0, glm::min(tri.v1, tri.v2)), glm::max(tri.v0, glm::max(tri.v1, tri.v2)), phi, tri.normal, 1.0f, 0.0f, 2, m, t);
+        }
+    }
+
+    lightTree.build(emitters, trianglesBuffer.size());
 }
@@ -1,9 +1,12 @@
 #ifndef OBJECT_MANAGER_HPP
 #define OBJECT_MANAGER_HPP
 
+#include <cmath>
 #include <utility>
 #include <unordered_map>
 
+#include "EnvironmentMap.hpp"
+#include "LightTree.hpp"
 #include "Material.hpp"
 #include "ShaderProgram.hpp"
 
@@ -29,6 +32,16 @@ struct TriangleMeshInfo {
     TriangleMeshInfo(int matIdx, int startIdx, int endIdx) : matIdx(matIdx), startIdx(startIdx), endIdx(endIdx) {}
 };
 
+// Emissive object sampled explicitly by the compute shader
+// type matches the hit types of sendRay (0: sphere, 1: tore, 2: triangle mesh), idx is the index in the matching uniform array
+// The environment map is the light of type 3, reached by the rays that leave the scene
+struct LightInfo {
+    int type;
+    int idx;
+
+    LightInfo(int type, int idx) : type(type), idx(idx) {}
+};
+
 class ObjectManager {
 public:
     void addMesh(std::shared_ptr<Mesh>);
@@ -37,6 +50,8 @@ public:
     int addObject(unsigned int meshIdx);
     int addObject(const std::string &meshName);
     void drawAll(ShaderProgram &shaderProgram);
+    void drawTriangleMeshes(ShaderProgram &shaderProgram);
+    void setUniforms(ShaderProgram &shaderProgram);
     void genNames();
     void genMeshNames();
     std::vector<std::string> &getNames() { return names; };
@@ -57,6 +72,23 @@ public:
     void genAllTriangles();
     const std::vector<Triangle> &getTriangles() const { return trianglesBuffer; };
     const std::vector<TriangleMeshInfo> &getTriangleToObject() const { return triangleToMat; };
+    const std::vector<LightInfo> &getLights() const { return lights; };
+
+    // Box around the spheres, the tores and the triangles
+    void getBounds(glm::vec3 &boundsMin, glm::vec3 &boundsMax);
+
+    // Edited objects: the UI flags an object before changing it, which keeps the box it covered, takeDirtyBounds adds
+    // the box it covers after the edit once the triangles are regenerated. Edits of emitters or of the environment
+    // change the lighting of the whole scene
+    void markDirty(int idx);
+    void markAllDirty() { allDirty = true; }
+
+    // Union of the boxes of the objects flagged since the last call, false when nothing was flagged
+    // all is set when the whole scene is dirty
+    bool takeDirtyBounds(glm::vec3 &boundsMin, glm::vec3 &boundsMax, bool &all);
+
+    EnvironmentMap &getEnvironment() { return environment; }
+    const LightTree &getLightTree() const { return lightTree; }
 
 private:
     std::vector<std::shared_ptr<Mesh>> meshes;
@@ -67,10 +99,23 @@ private:
     std::vector<std::string> meshNames;
     std::unordered_map<std::string, int> meshNamesMap;
 
-    int maxBounces = 5;
+    int maxBounces = 5; // without russian roulette (RenderSettings::rrMaxBounces caps the paths with it)
 
     std::vector<Triangle> trianglesBuffer;
     std::vector<TriangleMeshInfo> triangleToMat;
+    std::vector<LightInfo> lights;
+
+    EnvironmentMap environment; // ENVIRONMENT line of the scene files
+    LightTree lightTree;        // emissive spheres, tores and triangles, rebuilt with the triangles
+
+    std::vector<int> dirtyObjects;
+    glm::vec3 dirtyMin = glm::vec3(INFINITY);
+    glm::vec3 dirtyMax = glm::vec3(-INFINITY);
+    bool allDirty = false;
+
+    void buildLightTree();
+    void getObjectBounds(int idx, glm::vec3 &boundsMin, glm::vec3 &boundsMax);
+    bool isEmissive(int idx) const;
 };
 
 #endif // OBJECT_MANAGER_HPP
\ No newline at end of file
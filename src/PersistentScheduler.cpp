@@ -0,0 +1,32 @@
+#include "PersistentScheduler.hpp"
+
+#include <algorithm>
+
+#include "AdaptiveSampler.hpp"
+
+PersistentScheduler::PersistentScheduler() {
+    const GLuint zero = 0;
+    glGenBuffers(1, &counterBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+PersistentScheduler::~PersistentScheduler() {
+    glDeleteBuffers(1, &counterBuffer);
+}
+
+void PersistentScheduler::dispatch(int firstItem, int itemEnd, int workGroups) {
+    // The counter is reset between frames, after the lanes of the previous dispatch stopped fetching
+    const GLuint first = firstItem;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &first);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, counterBuffer); // binding 3 in compute_shader_persistent.glsl
+
+    // No more groups than needed to give every lane a pixel
+    int groupSize = AdaptiveSampler::tileSize * AdaptiveSampler::tileSize;
+    int workItems = itemEnd - firstItem;
+    glDispatchCompute(std::max(1, std::min(workGroups, (workItems + groupSize - 1) / groupSize)), 1, 1);
+}
@@ -0,0 +1,21 @@
+#ifndef PERSISTENT_SCHEDULER_HPP
+#define PERSISTENT_SCHEDULER_HPP
+
+#include <glad/gl.h>
+
+// Persistent threads launch of compute_shader_persistent.glsl: a fixed number of work groups sized to fill the GPU,
+// whose lanes fetch pixels from a global atomic counter until the frame is done
+// A lane whose path ended starts the next one instead of waiting for the longest path of its SIMD group
+class PersistentScheduler {
+public:
+    PersistentScheduler();
+    ~PersistentScheduler();
+
+    // Renders the pixels firstItem to itemEnd - 1, in tile order, with workGroups work groups of the current program
+    void dispatch(int firstItem, int itemEnd, int workGroups);
+
+private:
+    GLuint counterBuffer;
+};
+
+#endif // PERSISTENT_SCHEDULER_HPP
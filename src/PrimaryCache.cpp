@@ -0,0 +1,34 @@
+#include "PrimaryCache.hpp"
+
+#include "AdaptiveSampler.hpp"
+
+PrimaryCache::PrimaryCache(int width, int height)
+    : width(width), height(height), buildProgram("shaders/primary_cache.glsl") {
+
+    glGenTextures(1, &cacheTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cacheTexture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RG32UI, width, height, strata);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+PrimaryCache::~PrimaryCache() {
+    glDeleteTextures(1, &cacheTexture);
+}
+
+void PrimaryCache::build(const std::function<void(ShaderProgram &)> &setUniforms) {
+    buildProgram.use();
+    setUniforms(buildProgram);
+    buildProgram.set("primaryCacheStrata", strata);
+
+    bind();
+
+    const int tileSize = AdaptiveSampler::tileSize;
+    glDispatchCompute((width + tileSize - 1) / tileSize, (height + tileSize - 1) / tileSize, strata);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void PrimaryCache::bind() {
+    glBindImageTexture(3, cacheTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RG32UI);
+}
@@ -0,0 +1,34 @@
+#ifndef PRIMARY_CACHE_HPP
+#define PRIMARY_CACHE_HPP
+
+#include <glad/gl.h>
+#include <functional>
+
+#include "ComputeShader.hpp"
+
+// First hits of the camera rays of the strata first sample indices of every pixel (shaders/primary_cache.glsl),
+// traced once per camera: the later samples reuse them in turn and only trace their bounces
+// The pixels are then antialiased with strata sub-pixel positions
+class PrimaryCache {
+public:
+    static const int strata = 4;
+
+    PrimaryCache(int width, int height);
+    ~PrimaryCache();
+
+    // Traces the first hits for the current camera, setUniforms sends the scene and the camera
+    void build(const std::function<void(ShaderProgram &)> &setUniforms);
+
+    // Binds the cache on image unit 3 for the path tracers
+    void bind();
+
+private:
+    int width;
+    int height;
+
+    ComputeShader buildProgram;
+
+    GLuint cacheTexture; // one RG32UI layer per stratum
+};
+
+#endif // PRIMARY_CACHE_HPP
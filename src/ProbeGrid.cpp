@@ -0,0 +1,147 @@
+#include "ProbeGrid.hpp"
+#include "RenderSettings.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+const int probeSize = 64; // std430 size of IrradianceProbe in shaders/probe_cache.glsl
+
+ProbeGrid::~ProbeGrid() {
+    glDeleteBuffers(1, &probeBuffer);
+    glDeleteBuffers(1, &queueBuffer);
+}
+
+void ProbeGrid::setBounds(glm::vec3 sceneMin, glm::vec3 sceneMax) {
+    glm::vec3 extent = glm::max(sceneMax - sceneMin, glm::vec3(1e-3f));
+    float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+    if (!std::isfinite(maxExtent)) return; // empty scene, the grid stays where it was
+
+    spacing = maxExtent / resolution;
+    counts = glm::max(glm::ivec3(glm::ceil(extent / spacing)), glm::ivec3(2));
+    // Centers the grid on the scene, the probes of the border cells sit half a cell inside the box
+    gridMin = 0.5f * (sceneMin + sceneMax) - 0.5f * glm::vec3(counts) * spacing;
+
+    int probeCount = counts.x * counts.y * counts.z;
+    samples.assign(probeCount, 0);
+    restarted.assign(probeCount, true);
+    cursor = 0;
+
+    if (probeBuffer != 0) allocate();
+}
+
+void ProbeGrid::allocate() {
+    int probeCount = (int)samples.size();
+    if (probeCount != allocatedProbes) {
+        glDeleteBuffers(1, &probeBuffer);
+        glGenBuffers(1, &probeBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, probeBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)probeCount * probeSize, NULL, GL_DYNAMIC_COPY);
+        allocatedProbes = probeCount;
+    }
+    if (queueBuffer == 0) {
+        glGenBuffers(1, &queueBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, queueBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, probesPerFrame * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    }
+
+    // An empty probe (no sample) is skipped by the interpolation
+    const GLfloat zero = 0.0f;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, probeBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void ProbeGrid::invalidate(glm::vec3 boundsMin, glm::vec3 boundsMax) {
+    if (samples.empty()) return;
+
+    glm::ivec3 lo = glm::max(glm::ivec3(glm::floor((boundsMin - gridMin) / spacing - 0.5f)) - 1, glm::ivec3(0));
+    glm::ivec3 hi = glm::min(glm::ivec3(glm::ceil((boundsMax - gridMin) / spacing - 0.5f)) + 1, counts - 1);
+
+    int restartedProbes = 0;
+    for (int z = lo.z; z <= hi.z; z++)
+        for (int y = lo.y; y <= hi.y; y++)
+            for (int x = lo.x; x <= hi.x; x++) {
+                int idx = x + counts.x * (y + counts.y * z);
+                samples[idx] = 0;
+                restarted[idx] = true;
+                restartedProbes++;
+            }
+    if (restartedProbes > 0) std::cout << "[probes] " << restartedProbes << " probes restarted" << std::endl;
+}
+
+void ProbeGrid::invalidateAll() {
+    std::fill(samples.begin(), samples.end(), 0);
+    std::fill(restarted.begin(), restarted.end(), true);
+}
+
+void ProbeGrid::update(int maxBounces, const std::function<void(ShaderProgram &)> &setUniforms) {
+    if (samples.empty()) return;
+    if (probeBuffer == 0) allocate();
+
+    int fewest = *std::min_element(samples.begin(), samples.end());
+    if (fewest >= targetSamples) return;
+
+    // The probes with the fewest samples first, from where the previous frame stopped, then the other unfinished ones
+    std::vector<GLuint> queue;
+    size_t probeCount = samples.size();
+    for (int pass = 0; pass < 2 && (int)queue.size() < probesPerFrame; pass++) {
+        for (size_t i = 0; i < probeCount && (int)queue.size() < probesPerFrame; i++) {
+            size_t idx = (cursor + i) % probeCount;
+            bool selected = pass == 0 ? samples[idx] == fewest : samples[idx] > fewest && samples[idx] < targetSamples;
+            if (!selected) continue;
+            queue.push_back((GLuint)idx | (restarted[idx] ? 0x80000000u : 0u));
+            if (pass == 0) cursor = idx + 1;
+        }
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, queueBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, queue.size() * sizeof(GLuint), queue.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    program.use();
+    setUniforms(program);
+    // Plain random paths, the probes hold the full light transport behind their first bounce
+    program.set("samplerType", SAMPLER_RANDOM);
+    program.set("useProbeCache", 0);
+    program.set("useRasterPrimary", 0);
+    program.set("usePrimaryCache", 0);
+    program.set("useReSTIR", 0);
+    program.set("useGuiding", 0);
+    program.set("recordGuiding", 0);
+    program.set("spp", raysPerUpdate);
+    program.set("maxBounces", maxBounces);
+    program.set("probeGridMin", gridMin);
+    program.set("probeSpacing", spacing);
+    program.set("probeCounts", counts);
+
+    // binding 26 in shaders/probe_cache.glsl, 27 in shaders/compute_shader_probes.glsl
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 26, probeBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 27, queueBuffer);
+    glDispatchCompute((GLuint)queue.size(), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    for (GLuint entry : queue) {
+        GLuint idx = entry & 0x7fffffffu;
+        samples[idx] += raysPerUpdate;
+        restarted[idx] = false;
+    }
+}
+
+void ProbeGrid::bind(ShaderProgram &shaderProgram, bool useProbes) {
+    useProbes = useProbes && probeBuffer != 0;
+    shaderProgram.set("useProbeCache", useProbes ? 1 : 0);
+    if (!useProbes) return;
+
+    shaderProgram.set("probeGridMin", gridMin);
+    shaderProgram.set("probeSpacing", spacing);
+    shaderProgram.set("probeCounts", counts);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 26, probeBuffer);
+}
+
+float ProbeGrid::getProgress() const {
+    if (samples.empty()) return 0.0f;
+    double traced = 0.0;
+    for (int s : samples) traced += std::min(s, targetSamples);
+    return (float)(traced / ((double)samples.size() * targetSamples));
+}
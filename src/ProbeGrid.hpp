@@ -0,0 +1,62 @@
+#ifndef PROBE_GRID_HPP
+#define PROBE_GRID_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <functional>
+#include <vector>
+
+#include "ComputeShader.hpp"
+
+// Irradiance probes of the preview integrator (shaders/probe_cache.glsl): one probe at the center of each cell of a
+// grid over the scene, resolution cells along its largest side, holding the incident radiance in L1 spherical harmonics
+// The probes are path traced in the background (shaders/compute_shader_probes.glsl), probesPerFrame per frame, the
+// ones with the fewest samples first, until they reach targetSamples. An edit only restarts the probes around the
+// edited objects, which keep their previous value until they are traced again
+// The buffers are only allocated once the probes are used
+class ProbeGrid {
+public:
+    ProbeGrid() : program("shaders/compute_shader_probes.glsl") {};
+    ~ProbeGrid();
+
+    // Places the grid over the scene box, every probe restarts
+    void setBounds(glm::vec3 sceneMin, glm::vec3 sceneMax);
+
+    // Restarts the probes of the box grown by one cell
+    void invalidate(glm::vec3 boundsMin, glm::vec3 boundsMax);
+    void invalidateAll();
+
+    // Traces raysPerUpdate paths from each probe of the frame, nothing once they all have targetSamples
+    // setUniforms sends the scene and render settings to the kernel
+    void update(int maxBounces, const std::function<void(ShaderProgram &)> &setUniforms);
+
+    // Sends useProbeCache, and binds the probes on binding 26 when they are used
+    void bind(ShaderProgram &shaderProgram, bool useProbes);
+
+    // Fraction of the samples of the grid already traced
+    float getProgress() const;
+
+    static const int resolution = 16;
+    static const int targetSamples = 1024;
+    static const int raysPerUpdate = 256; // local size of the kernel
+    static const int probesPerFrame = 64;
+
+private:
+    void allocate();
+
+    ComputeShader program;
+
+    glm::vec3 gridMin = glm::vec3(-1.0f);
+    float spacing = 1.0f;
+    glm::ivec3 counts = glm::ivec3(1);
+
+    std::vector<int> samples;    // traced by the GPU, once the queued updates are done
+    std::vector<bool> restarted; // the next update of the probe discards its mean
+    size_t cursor = 0;           // round robin among the probes with the fewest samples
+
+    GLuint probeBuffer = 0;
+    GLuint queueBuffer = 0;
+    int allocatedProbes = 0;
+};
+
+#endif // PROBE_GRID_HPP
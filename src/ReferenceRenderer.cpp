@@ -0,0 +1,719 @@
+#include "ReferenceRenderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+const float PI = 3.14159265359f;
+const float cameraFocalLength = 2.41421356237f; // getCameraRay with a 45 degrees field of view
+const float toreTubeRadius = 0.1f;              // r of ObjectManager::setUniforms
+const float surfaceOffset = 0.001f;             // hit points are moved off the surfaces, as in getHitInfo
+
+enum VertexType {
+    CAMERA_VERTEX = 0,
+    LIGHT_VERTEX = 1,
+    SURFACE_VERTEX = 2
+};
+
+static float random(std::mt19937 &rng) {
+    return std::min(std::uniform_real_distribution<float>(0.0f, 1.0f)(rng), 0.99999994f);
+}
+
+static float maxComponent(glm::vec3 v) {
+    return std::max(v.x, std::max(v.y, v.z));
+}
+
+// Cosine weighted direction around normal, as cosineHemisphere of sampler.glsl
+static glm::vec3 cosineHemisphere(float u0, float u1, glm::vec3 normal) {
+    float r = std::sqrt(u0);
+    float phi = 2.0f * PI * u1;
+
+    glm::vec3 t = glm::normalize(glm::cross(std::abs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), normal));
+    glm::vec3 b = glm::cross(normal, t);
+    return glm::normalize(t * (r * std::cos(phi)) + b * (r * std::sin(phi)) + normal * std::sqrt(std::max(0.0f, 1.0f - u0)));
+}
+
+// glossyPdf of lighting.glsl
+static float glossyPdf(glm::vec3 direction, glm::vec3 normal, glm::vec3 specularDir, float s) {
+    float c = glm::dot(direction, specularDir);
+    float disc = s * s * c * c - s * s + (1.0f - s) * (1.0f - s);
+    if (disc < 0.0f) return 0.0f;
+
+    float pdf = 0.0f;
+    for (int i = -1; i <= 1; i += 2) {
+        float k = s * c + i * std::sqrt(disc);
+        if (k <= 0.0f) continue;
+
+        glm::vec3 diffuseDir = (k * direction - s * specularDir) / (1.0f - s);
+        float cosDiffuse = glm::dot(diffuseDir, normal);
+        if (cosDiffuse <= 0.0f) continue;
+
+        pdf += cosDiffuse / PI * k * k / ((1.0f - s) * (1.0f - s) * std::max(std::abs(glm::dot(diffuseDir, direction)), 1e-4f));
+    }
+    return pdf;
+}
+
+static glm::vec3 reflect(glm::vec3 d, glm::vec3 n) {
+    return d - 2.0f * glm::dot(d, n) * n;
+}
+
+// bdptBsdf and bdptDirectionPdf of shaders/bdpt.glsl
+glm::vec3 ReferenceRenderer::bsdf(const Surface &mat, glm::vec3 normal, glm::vec3 toCamera, glm::vec3 toLight) {
+    float cosLight = glm::dot(toLight, normal);
+    if (cosLight <= 0.0f || glm::dot(toCamera, normal) <= 0.0f) return glm::vec3(0.0f);
+
+    glm::vec3 f = (1.0f - mat.reflexivity) * mat.color / PI;
+    if (mat.smoothness <= 0.99f) f += mat.reflexivity * glossyPdf(toLight, normal, reflect(-toCamera, normal), mat.smoothness) / cosLight;
+    return f;
+}
+
+float ReferenceRenderer::directionPdf(const Surface &mat, glm::vec3 normal, glm::vec3 prev, glm::vec3 next) {
+    float cosNext = glm::dot(next, normal);
+    if (cosNext <= 0.0f) return 0.0f;
+
+    float pdf = (1.0f - mat.reflexivity) * cosNext / PI;
+    if (mat.smoothness <= 0.99f) pdf += mat.reflexivity * glossyPdf(next, normal, reflect(-prev, normal), mat.smoothness);
+    return pdf;
+}
+
+float ReferenceRenderer::convertDensity(float pdf, glm::vec3 from, const Vertex &to) {
+    glm::vec3 d = to.position - from;
+    float dist2 = glm::dot(d, d);
+    if (dist2 <= 0.0f) return 0.0f;
+    if (to.type != CAMERA_VERTEX) pdf *= std::abs(glm::dot(to.normal, d)) / std::sqrt(dist2);
+    return pdf / dist2;
+}
+
+float ReferenceRenderer::lightPdf(const Vertex &v, const Vertex &next) {
+    glm::vec3 toNext = glm::normalize(next.position - v.position);
+    return convertDensity(std::max(glm::dot(toNext, v.normal), 0.0f) / PI, v.position, next);
+}
+
+static float remap0(float pdf) {
+    return pdf != 0.0f ? pdf : 1.0f;
+}
+
+// solveQuartic of scene.glsl, in float like the shader
+static int solveQuartic(float b, float c, float d, float e, float roots[4]) {
+    auto cbrt = [](float x) { return x < 0.0f ? -std::pow(-x, 1.0f / 3.0f) : std::pow(x, 1.0f / 3.0f); };
+
+    float bb = b * b;
+    float p = (8.0f * c - 3.0f * bb) / 8.0f;
+    float q = (8.0f * d - 4.0f * c * b + bb * b) / 8.0f;
+    float r = (256.0f * e - 64.0f * d * b + 16.0f * c * bb - 3.0f * bb * bb) / 256.0f;
+    int n = 0;
+
+    float ra = 2.0f * p;
+    float rb = p * p - 4.0f * r;
+    float rc = -q * q;
+
+    float ru = ra / 3.0f;
+    float rp = rb - ra * ru;
+    float rq = rc - (rb - 2.0f * ra * ra / 9.0f) * ru;
+
+    float lambda;
+    float rh = 0.25f * rq * rq + rp * rp * rp / 27.0f;
+    if (rh > 0.0f) {
+        rh = std::sqrt(rh);
+        float ro = -0.5f * rq;
+        lambda = cbrt(ro - rh) + cbrt(ro + rh) - ru;
+    } else {
+        float rm = std::sqrt(-rp / 3.0f);
+        lambda = -2.0f * rm * std::sin(std::asin(1.5f * rq / (rp * rm)) / 3.0f) - ru;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        float a_2 = ra + lambda;
+        float a_1 = rb + lambda * a_2;
+        float b_2 = a_2 + lambda;
+        float f = rc + lambda * a_1;
+        float f1 = a_1 + lambda * b_2;
+        lambda -= f / f1;
+    }
+
+    if (lambda < 0.0f) return n;
+    float t = std::sqrt(lambda);
+    float alpha = 2.0f * q / t, beta = lambda + ra;
+
+    float u = 0.25f * b;
+    t *= 0.5f;
+
+    float z = -alpha - beta;
+    if (z > 0.0f) {
+        z = std::sqrt(z) * 0.5f;
+        float h = t - u;
+        roots[0] = h + z;
+        roots[1] = h - z;
+        n += 2;
+    }
+
+    float w = alpha - beta;
+    if (w > 0.0f) {
+        w = std::sqrt(w) * 0.5f;
+        float h = -t - u;
+        roots[n] = h + w;
+        roots[n + 1] = h - w;
+        n += 2;
+    }
+    return n;
+}
+
+ReferenceRenderer::ReferenceRenderer(ObjectManager &objManager, glm::vec3 cameraPosition, const glm::mat4 &viewMatrix, int width, int height)
+    : width(width), height(height), cameraPosition(cameraPosition), viewMatrix(viewMatrix), maxBounces(objManager.getMaxBounces()),
+      environment(objManager.getEnvironment()) {
+
+    auto surface = [](const Material &obj) {
+        return Surface{obj.getColor(), obj.getEmiColor() * obj.getEmissionStrength(), obj.getSmoothness(), obj.getReflexivity()};
+    };
+
+    // Same order as the uniforms of ObjectManager::setUniforms
+    for (int idx : objManager.getObjectsPerMesh("Sphere")) {
+        const Material &obj = objManager.getObject(idx);
+        if (obj.getEmissionStrength() > 0) lights.emplace_back(0, (int)spheres.size());
+        spheres.push_back({obj.getPos(), obj.getSize()[0], surface(obj)});
+    }
+
+    for (int idx : objManager.getObjectsPerMesh("Tore")) {
+        const Material &obj = objManager.getObject(idx);
+        if (obj.getEmissionStrength() > 0) lights.emplace_back(1, (int)tores.size());
+        tores.push_back({obj.getPos(), obj.getSize()[0], toreTubeRadius, surface(obj)});
+    }
+
+    triangles = objManager.getTriangles();
+    for (const TriangleMeshInfo &info : objManager.getTriangleToObject()) {
+        const Material &obj = objManager.getObject(info.matIdx);
+        if (obj.getEmissionStrength() > 0) lights.emplace_back(2, (int)meshes.size());
+        meshes.push_back({info.startIdx, info.endIdx, surface(obj)});
+    }
+
+    image.assign(width * height, glm::vec3(0.0f));
+    splats.assign(width * height, glm::vec3(0.0f));
+}
+
+// sendRay of scene.glsl
+ReferenceRenderer::Hit ReferenceRenderer::intersect(glm::vec3 origin, glm::vec3 direction) const {
+    Hit hit;
+    hit.hasHit = false;
+    hit.dist = INFINITY;
+
+    for (int i = 0; i < (int)spheres.size(); i++) {
+        glm::vec3 pc = spheres[i].pos - origin;
+        float proj = glm::dot(pc, direction);
+        float det = proj * proj - (glm::dot(pc, pc) - spheres[i].r * spheres[i].r);
+        if (det < 0.0f) continue;
+
+        float t = proj - std::sqrt(det);
+        if (t > 0.0f && t < hit.dist) {
+            hit.dist = t;
+            hit.objType = 0;
+            hit.objIdx = i;
+        }
+    }
+
+    for (int i = 0; i < (int)tores.size(); i++) {
+        glm::vec3 o = origin - tores[i].pos;
+        float cu = glm::dot(o, direction);
+        float R = tores[i].R;
+        float r = tores[i].r;
+
+        float C = R * R - r * r + glm::dot(o, o);
+        float a = 4.0f * cu;
+        float b = 4.0f * cu * cu + 2.0f * C - 4.0f * R * R * (direction.x * direction.x + direction.y * direction.y);
+        float c = 4.0f * C * cu - 8.0f * R * R * (o.x * direction.x + o.y * direction.y);
+        float d = C * C - 4.0f * R * R * (o.x * o.x + o.y * o.y);
+
+        float roots[4];
+        int count = solveQuartic(a, b, c, d, roots);
+        for (int j = 0; j < count; j++) {
+            if (roots[j] > 0.0f && roots[j] < hit.dist) {
+                hit.dist = roots[j];
+                hit.objType = 1;
+                hit.objIdx = i;
+            }
+        }
+    }
+
+    for (int i = 0; i < (int)meshes.size(); i++) {
+        for (int j = meshes[i].startIdx; j < meshes[i].endIdx; j++) {
+            const Triangle &tri = triangles[j];
+            float dirNormal = glm::dot(direction, tri.normal);
+            if (dirNormal >= 0.0f) continue;
+
+            float t = glm::dot(tri.v0 - origin, tri.normal) / dirNormal;
+            if (t <= 0.0f || t >= hit.dist) continue;
+
+            glm::vec3 p = origin + t * direction;
+            glm::vec3 n1 = glm::cross(tri.v1 - tri.v0, p - tri.v0);
+            glm::vec3 n2 = glm::cross(tri.v2 - tri.v1, p - tri.v1);
+            glm::vec3 n3 = glm::cross(tri.v0 - tri.v2, p - tri.v2);
+            if (glm::dot(n1, n2) >= -0.01f && glm::dot(n2, n3) >= -0.01f && glm::dot(n3, n1) >= -0.01f) {
+                hit.dist = t;
+                hit.objType = 2;
+                hit.objIdx = i;
+                hit.triangleIdx = j;
+            }
+        }
+    }
+
+    if (hit.dist == INFINITY) return hit;
+
+    hit.hasHit = true;
+    hit.position = origin + hit.dist * direction;
+    if (hit.objType == 0) {
+        hit.normal = glm::normalize(hit.position - spheres[hit.objIdx].pos);
+        hit.triangleIdx = -1;
+    } else if (hit.objType == 1) {
+        const Tore &tore = tores[hit.objIdx];
+        glm::vec3 p = hit.position - tore.pos;
+        float commonTerm = glm::dot(p, p) - tore.r * tore.r;
+        float R2 = tore.R * tore.R;
+        hit.normal = glm::normalize(glm::vec3(p.x * (commonTerm - R2), p.y * (commonTerm - R2), p.z * (commonTerm + R2)));
+        hit.triangleIdx = -1;
+    } else {
+        hit.normal = triangles[hit.triangleIdx].normal;
+    }
+    hit.position += hit.normal * surfaceOffset;
+    return hit;
+}
+
+bool ReferenceRenderer::isVisible(glm::vec3 from, glm::vec3 to) const {
+    glm::vec3 d = to - from;
+    float dist = glm::length(d);
+    Hit hit = intersect(from, d / dist);
+    return !hit.hasHit || hit.dist > dist * 0.999f - 1e-3f;
+}
+
+const ReferenceRenderer::Surface &ReferenceRenderer::getSurface(int objType, int objIdx) const {
+    if (objType == 0) return spheres[objIdx].mat;
+    if (objType == 1) return tores[objIdx].mat;
+    return meshes[objIdx].mat;
+}
+
+glm::vec3 ReferenceRenderer::getAmbientLight(glm::vec3 direction) const {
+    if (environment.isLoaded()) return environment.radiance(direction);
+
+    glm::vec3 sky(0.47f, 0.65f, 1.0f);
+    glm::vec3 bottom(0.2f, 0.3f, 0.3f);
+    if (direction.y > 0.1f) return sky;
+    if (direction.y < -0.1f) return bottom;
+
+    float t = glm::clamp((direction.y + 0.1f) / 0.2f, 0.0f, 1.0f);
+    return glm::mix(bottom, sky, t * t * (3.0f - 2.0f * t));
+}
+
+float ReferenceRenderer::cameraDirectionPdf(glm::vec3 direction, glm::vec2 &raster) const {
+    glm::vec3 local = glm::mat3(viewMatrix) * direction;
+    if (local.z >= 0.0f) return 0.0f;
+
+    float aspect = float(width) / float(height);
+    glm::vec2 pos = glm::vec2(local.x, local.y) / -local.z * cameraFocalLength / glm::vec2(aspect, 1.0f);
+    if (std::abs(pos.x) >= 1.0f || std::abs(pos.y) >= 1.0f) return 0.0f;
+    raster = (pos * 0.5f + 0.5f) * glm::vec2(width, height);
+
+    float filmArea = 4.0f * aspect / (cameraFocalLength * cameraFocalLength);
+    float cosTheta = -local.z;
+    return 1.0f / (filmArea * cosTheta * cosTheta * cosTheta);
+}
+
+float ReferenceRenderer::lightOriginPdf(const Vertex &v) const {
+    float pmf = 1.0f / float(lights.size());
+
+    if (v.objType == 0) {
+        float r = spheres[v.objIdx].r;
+        return pmf / (4.0f * PI * r * r);
+    }
+    if (v.objType == 1) {
+        const Tore &tore = tores[v.objIdx];
+        float rho = std::max(glm::length(glm::vec2(v.position - tore.pos)), 1e-4f);
+        return pmf / (4.0f * PI * PI * tore.r * rho);
+    }
+
+    const TriangleMesh &mesh = meshes[v.objIdx];
+    const Triangle &tri = triangles[v.triangleIdx];
+    float area = 0.5f * glm::length(glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+    return pmf / (float(mesh.endIdx - mesh.startIdx) * area);
+}
+
+float ReferenceRenderer::vertexPdf(const Vertex &v, const Vertex &prev, const Vertex &next) const {
+    if (v.type == LIGHT_VERTEX) return lightPdf(v, next);
+
+    glm::vec3 toNext = glm::normalize(next.position - v.position);
+    float pdf;
+    if (v.type == CAMERA_VERTEX) {
+        glm::vec2 raster;
+        pdf = cameraDirectionPdf(toNext, raster);
+    } else {
+        pdf = directionPdf(getSurface(v.objType, v.objIdx), v.normal, glm::normalize(prev.position - v.position), toNext);
+    }
+    return convertDensity(pdf, v.position, next);
+}
+
+int ReferenceRenderer::randomWalk(std::mt19937 &rng, Vertex *path, bool isCamera, int count, int maxCount, glm::vec3 origin,
+                                  glm::vec3 direction, glm::vec3 beta, float pdf, glm::vec3 &escaped) const {
+    while (count < maxCount) {
+        Hit hit = intersect(origin, direction);
+        if (!hit.hasHit) {
+            if (isCamera) escaped += beta * getAmbientLight(direction);
+            break;
+        }
+        // The triangles are one-sided: a light ray also stops on the back faces that the camera ray going the other
+        // way would hit
+        if (!isCamera && !isVisible(hit.position, origin)) break;
+
+        Vertex &prev = path[count - 1];
+        Vertex &v = path[count];
+        v.position = hit.position;
+        v.type = SURFACE_VERTEX;
+        v.normal = hit.normal;
+        v.beta = beta;
+        v.pdfFwd = convertDensity(pdf, prev.position, v);
+        v.pdfRev = 0.0f;
+        v.objType = hit.objType;
+        v.objIdx = hit.objIdx;
+        v.triangleIdx = hit.triangleIdx;
+        v.delta = false;
+
+        count++;
+        if (count == maxCount) break;
+
+        // Next direction, drawn like the path tracer does
+        const Surface &mat = getSurface(v.objType, v.objIdx);
+        float u0 = random(rng), u1 = random(rng), u2 = random(rng);
+        glm::vec3 toPrev = -direction;
+        glm::vec3 diffuseDir = cosineHemisphere(u0, u1, v.normal);
+        glm::vec3 specularDir = reflect(direction, v.normal);
+        bool isReflexive = mat.reflexivity > u2;
+        direction = glm::normalize(glm::mix(diffuseDir, specularDir, isReflexive ? mat.smoothness : 0.0f));
+
+        float pdfRev;
+        if (isReflexive && mat.smoothness > 0.99f) {
+            v.delta = true;
+            pdf = 0.0f;
+            pdfRev = 0.0f;
+        } else {
+            pdf = directionPdf(mat, v.normal, toPrev, direction);
+            pdfRev = directionPdf(mat, v.normal, direction, toPrev);
+            glm::vec3 f = isCamera ? bsdf(mat, v.normal, toPrev, direction) : bsdf(mat, v.normal, direction, toPrev);
+            beta *= pdf > 0.0f ? f * std::abs(glm::dot(direction, v.normal)) / pdf : glm::vec3(0.0f);
+        }
+        prev.pdfRev = convertDensity(pdfRev, v.position, prev);
+
+        if (maxComponent(beta) <= 0.0f) break;
+        origin = v.position;
+    }
+    return count;
+}
+
+int ReferenceRenderer::cameraSubpath(std::mt19937 &rng, Subpaths &paths, int x, int y, int maxCount, glm::vec3 &escaped) const {
+    float aspect = float(width) / float(height);
+    glm::vec2 point = (glm::vec2(x, y) + glm::vec2(random(rng), random(rng))) / glm::vec2(width, height);
+    glm::vec2 pos = 2.0f * (point - 0.5f);
+    glm::vec3 direction = glm::normalize(glm::vec3(pos.x * aspect, pos.y, -cameraFocalLength));
+    direction = glm::normalize(glm::vec3(glm::vec4(direction, 1.0f) * viewMatrix));
+
+    Vertex &camera = paths.camera[0];
+    camera.position = cameraPosition;
+    camera.type = CAMERA_VERTEX;
+    camera.normal = glm::vec3(0.0f);
+    camera.beta = glm::vec3(1.0f);
+    camera.pdfFwd = 1.0f;
+    camera.pdfRev = 0.0f;
+    camera.delta = false;
+
+    glm::vec2 raster;
+    float pdf = cameraDirectionPdf(direction, raster);
+    return randomWalk(rng, paths.camera, true, 1, maxCount, cameraPosition, direction, glm::vec3(1.0f), pdf, escaped);
+}
+
+int ReferenceRenderer::lightSubpath(std::mt19937 &rng, Subpaths &paths, int maxCount) const {
+    if (lights.empty()) return 0;
+
+    int l = std::min(int(random(rng) * lights.size()), (int)lights.size() - 1);
+    Vertex &light = paths.light[0];
+    light.type = LIGHT_VERTEX;
+    light.objType = lights[l].type;
+    light.objIdx = lights[l].idx;
+    light.triangleIdx = -1;
+    light.pdfRev = 0.0f;
+    light.delta = false;
+
+    float u0 = random(rng), u1 = random(rng);
+    glm::vec3 position;
+    if (light.objType == 0) {
+        const Sphere &sphere = spheres[light.objIdx];
+        float z = 1.0f - 2.0f * u0;
+        float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        light.normal = glm::vec3(r * std::cos(2.0f * PI * u1), r * std::sin(2.0f * PI * u1), z);
+        position = sphere.pos + sphere.r * light.normal;
+    } else if (light.objType == 1) {
+        const Tore &tore = tores[light.objIdx];
+        float theta = 2.0f * PI * u0;
+        float phi = 2.0f * PI * u1;
+        float rho = tore.R + tore.r * std::cos(phi);
+        light.normal = glm::vec3(std::cos(phi) * std::cos(theta), std::cos(phi) * std::sin(theta), std::sin(phi));
+        position = tore.pos + glm::vec3(rho * std::cos(theta), rho * std::sin(theta), tore.r * std::sin(phi));
+    } else {
+        const TriangleMesh &mesh = meshes[light.objIdx];
+        int triCount = mesh.endIdx - mesh.startIdx;
+        light.triangleIdx = mesh.startIdx + std::min(int(random(rng) * triCount), triCount - 1);
+
+        const Triangle &tri = triangles[light.triangleIdx];
+        float su = std::sqrt(u0);
+        float b1 = u1 * su;
+        position = (1.0f - su) * tri.v0 + b1 * tri.v1 + (su - b1) * tri.v2;
+        light.normal = tri.normal;
+    }
+
+    light.position = position + light.normal * surfaceOffset;
+    light.beta = getSurface(light.objType, light.objIdx).emission;
+    light.pdfFwd = lightOriginPdf(light);
+    if (maxCount == 1) return 1;
+
+    glm::vec3 direction = cosineHemisphere(random(rng), random(rng), light.normal);
+    float pdfDir = std::max(glm::dot(direction, light.normal), 0.0f) / PI;
+    glm::vec3 beta = light.beta * PI / light.pdfFwd;
+
+    glm::vec3 unused(0.0f);
+    return randomWalk(rng, paths.light, false, 1, maxCount, light.position, direction, beta, pdfDir, unused);
+}
+
+// sampleLightPoint of lighting.glsl with the uniform light list, the environment map is not sampled
+bool ReferenceRenderer::sampleLightPoint(std::mt19937 &rng, const Vertex &pt, Vertex &light, glm::vec3 &direction) const {
+    if (lights.empty()) return false;
+
+    int l = std::min(int(random(rng) * lights.size()), (int)lights.size() - 1);
+    float pmf = 1.0f / lights.size();
+    float u0 = random(rng), u1 = random(rng);
+
+    light.type = LIGHT_VERTEX;
+    light.objType = lights[l].type;
+    light.objIdx = lights[l].idx;
+    light.triangleIdx = -1;
+    light.pdfRev = 0.0f;
+    light.delta = false;
+
+    glm::vec3 position;
+    float pdf;
+    if (light.objType == 0) {  // in the cone of the sphere
+        const Sphere &sphere = spheres[light.objIdx];
+        glm::vec3 toCenter = sphere.pos - pt.position;
+        float dist2 = glm::dot(toCenter, toCenter);
+        float sinMax2 = sphere.r * sphere.r / dist2;
+        if (sinMax2 >= 1.0f) return false;
+
+        float cosMax = std::sqrt(1.0f - sinMax2);
+        float cosTheta = glm::mix(cosMax, 1.0f, u0);
+        float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        float phi = 2.0f * PI * u1;
+
+        glm::vec3 w = toCenter / std::sqrt(dist2);
+        glm::vec3 u = glm::normalize(glm::cross(std::abs(w.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), w));
+        glm::vec3 v = glm::cross(w, u);
+        direction = (u * std::cos(phi) + v * std::sin(phi)) * sinTheta + w * cosTheta;
+        pdf = 1.0f / (2.0f * PI * (1.0f - cosMax));
+
+        float b = glm::dot(toCenter, direction);
+        position = pt.position + direction * (b - std::sqrt(std::max(0.0f, sphere.r * sphere.r - dist2 + b * b)));
+        light.normal = glm::normalize(position - sphere.pos);
+    } else {  // uniform angles on the tores, uniform on the area of the triangles
+        float area;
+        if (light.objType == 1) {
+            const Tore &tore = tores[light.objIdx];
+            float theta = 2.0f * PI * u0;
+            float phi = 2.0f * PI * u1;
+            float rho = tore.R + tore.r * std::cos(phi);
+            light.normal = glm::vec3(std::cos(phi) * std::cos(theta), std::cos(phi) * std::sin(theta), std::sin(phi));
+            position = tore.pos + glm::vec3(rho * std::cos(theta), rho * std::sin(theta), tore.r * std::sin(phi));
+            area = 4.0f * PI * PI * tore.r * rho;
+        } else {
+            const TriangleMesh &mesh = meshes[light.objIdx];
+            int triCount = mesh.endIdx - mesh.startIdx;
+            light.triangleIdx = mesh.startIdx + std::min(int(random(rng) * triCount), triCount - 1);
+            pmf /= triCount;
+
+            const Triangle &tri = triangles[light.triangleIdx];
+            float su = std::sqrt(u0);
+            float b1 = u1 * su;
+            position = (1.0f - su) * tri.v0 + b1 * tri.v1 + (su - b1) * tri.v2;
+            light.normal = tri.normal;
+            area = 0.5f * glm::length(glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+        }
+
+        glm::vec3 toLight = position - pt.position;
+        float dist2 = glm::dot(toLight, toLight);
+        direction = toLight / std::sqrt(dist2);
+        float cosLight = -glm::dot(direction, light.normal);
+        if (cosLight <= 0.0f) return false;
+        pdf = dist2 / (cosLight * area);
+    }
+
+    light.position = position + light.normal * surfaceOffset;
+    light.beta = getSurface(light.objType, light.objIdx).emission / (pdf * pmf);
+    light.pdfFwd = lightOriginPdf(light);
+    return true;
+}
+
+// bdptMisWeight of shaders/bdpt.glsl
+float ReferenceRenderer::misWeight(const Subpaths &paths, int s, int t, const Vertex &sampled) const {
+    if (s + t == 2) return 1.0f;
+
+    const Vertex *camera = paths.camera;
+    const Vertex *light = paths.light;
+
+    const Vertex &pt = t == 1 ? sampled : camera[t - 1];
+    const Vertex &qs = s == 1 ? sampled : light[std::max(s - 1, 0)];
+
+    float ptPdfRev = s > 0 ? vertexPdf(qs, s > 1 ? light[s - 2] : qs, pt) : lightOriginPdf(pt);
+    float ptMinusPdfRev = 0.0f;
+    if (t > 1) ptMinusPdfRev = s > 0 ? vertexPdf(pt, qs, camera[t - 2]) : lightPdf(pt, camera[t - 2]);
+    float qsPdfRev = 0.0f;
+    float qsMinusPdfRev = 0.0f;
+    if (s > 0) qsPdfRev = vertexPdf(pt, t > 1 ? camera[t - 2] : pt, qs);
+    if (s > 1) qsMinusPdfRev = vertexPdf(qs, pt, light[s - 2]);
+
+    float sumRi = 0.0f;
+    float ri = 1.0f;
+    for (int i = t - 1; i > 0; i--) {
+        float pdfRev = i == t - 1 ? ptPdfRev : (i == t - 2 ? ptMinusPdfRev : camera[i].pdfRev);
+        ri *= remap0(pdfRev) / remap0(camera[i].pdfFwd);
+        if ((i == t - 1 || !camera[i].delta) && !camera[i - 1].delta) sumRi += ri;
+    }
+
+    ri = 1.0f;
+    for (int i = s - 1; i >= 0; i--) {
+        float pdfRev = i == s - 1 ? qsPdfRev : (i == s - 2 ? qsMinusPdfRev : light[i].pdfRev);
+        float pdfFwd = i == s - 1 ? qs.pdfFwd : light[i].pdfFwd;
+        ri *= remap0(pdfRev) / remap0(pdfFwd);
+        if ((i == s - 1 || !light[i].delta) && (i == 0 || !light[i - 1].delta)) sumRi += ri;
+    }
+
+    return 1.0f / (1.0f + sumRi);
+}
+
+// bdptConnect of shaders/bdpt.glsl, the light tracing strategies are added to the splats of the thread
+glm::vec3 ReferenceRenderer::connect(std::mt19937 &rng, const Subpaths &paths, int s, int t, std::vector<glm::vec3> &threadSplats) const {
+    const Vertex &pt = paths.camera[t - 1];
+    Vertex sampled = Vertex();
+    glm::vec3 L(0.0f);
+    glm::vec2 raster;
+
+    if (s == 0) {
+        if (pt.type != SURFACE_VERTEX) return glm::vec3(0.0f);
+        const Surface &mat = getSurface(pt.objType, pt.objIdx);
+        if (maxComponent(mat.emission) <= 0.0f || glm::dot(paths.camera[t - 2].position - pt.position, pt.normal) <= 0.0f) return glm::vec3(0.0f);
+        L = pt.beta * mat.emission;
+
+    } else if (t == 1) {
+        const Vertex &qs = paths.light[s - 1];
+        glm::vec3 toCamera = cameraPosition - qs.position;
+        float dist2 = glm::dot(toCamera, toCamera);
+        toCamera /= std::sqrt(dist2);
+
+        float pdf = cameraDirectionPdf(-toCamera, raster);
+        if (pdf <= 0.0f) return glm::vec3(0.0f);
+
+        glm::vec3 toLight = glm::normalize(paths.light[s - 2].position - qs.position);
+        L = qs.beta * bsdf(getSurface(qs.objType, qs.objIdx), qs.normal, toCamera, toLight) * std::abs(glm::dot(toCamera, qs.normal)) * pdf / dist2;
+
+        sampled = paths.camera[0];
+        sampled.beta = glm::vec3(pdf / dist2);
+        if (maxComponent(L) <= 0.0f || !isVisible(cameraPosition, qs.position)) return glm::vec3(0.0f);
+
+    } else if (s == 1) {
+        glm::vec3 direction;
+        if (!sampleLightPoint(rng, pt, sampled, direction)) return glm::vec3(0.0f);
+
+        glm::vec3 toCamera = glm::normalize(paths.camera[t - 2].position - pt.position);
+        L = pt.beta * bsdf(getSurface(pt.objType, pt.objIdx), pt.normal, toCamera, direction) * std::abs(glm::dot(direction, pt.normal)) * sampled.beta;
+        if (maxComponent(L) <= 0.0f || !isVisible(pt.position, sampled.position)) return glm::vec3(0.0f);
+
+    } else {
+        const Vertex &qs = paths.light[s - 1];
+        glm::vec3 d = pt.position - qs.position;
+        float dist2 = glm::dot(d, d);
+        d /= std::sqrt(dist2);
+
+        glm::vec3 qsF = bsdf(getSurface(qs.objType, qs.objIdx), qs.normal, d, glm::normalize(paths.light[s - 2].position - qs.position));
+        glm::vec3 ptF = bsdf(getSurface(pt.objType, pt.objIdx), pt.normal, glm::normalize(paths.camera[t - 2].position - pt.position), -d);
+
+        float G = std::abs(glm::dot(qs.normal, d)) * std::abs(glm::dot(pt.normal, d)) / dist2;
+        L = qs.beta * qsF * ptF * pt.beta * G;
+        if (maxComponent(L) <= 0.0f || !isVisible(pt.position, qs.position)) return glm::vec3(0.0f);
+    }
+
+    L *= misWeight(paths, s, t, sampled);
+    if (t == 1) {
+        int x = std::min(std::max((int)raster.x, 0), width - 1);
+        int y = std::min(std::max((int)raster.y, 0), height - 1);
+        threadSplats[y * width + x] += L;
+        return glm::vec3(0.0f);
+    }
+    return L;
+}
+
+glm::vec3 ReferenceRenderer::sample(std::mt19937 &rng, int x, int y, std::vector<glm::vec3> &threadSplats) const {
+    Subpaths paths;
+    int depth = std::min(maxBounces - 1, maxDepth);
+
+    glm::vec3 L(0.0f);
+    int cameraCount = cameraSubpath(rng, paths, x, y, depth + 2, L);
+    int lightCount = lightSubpath(rng, paths, depth + 1);
+
+    for (int t = 1; t <= cameraCount; t++) {
+        for (int s = 0; s <= lightCount; s++) {
+            int pathDepth = s + t - 2;
+            if ((s == 1 && t == 1) || pathDepth < 0 || pathDepth > depth) continue;
+            L += connect(rng, paths, s, t, threadSplats);
+        }
+    }
+    return L;
+}
+
+void ReferenceRenderer::render(int spp) {
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::vector<glm::vec3>> threadSplats(threadCount, std::vector<glm::vec3>(width * height, glm::vec3(0.0f)));
+    int previousCount = sampleCount;
+
+    // Interleaved rows, the cost of a row depends on what it sees. One generator per row and per call
+    auto renderRows = [&](int thread) {
+        for (int y = thread; y < height; y += threadCount) {
+            std::mt19937 rng(previousCount * height + y);
+            for (int x = 0; x < width; x++) {
+                glm::vec3 sum(0.0f);
+                for (int i = 0; i < spp; i++) sum += sample(rng, x, y, threadSplats[thread]);
+                image[y * width + x] = (image[y * width + x] * float(previousCount) + sum) / float(previousCount + spp);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++) threads.emplace_back(renderRows, t);
+    for (std::thread &thread : threads) thread.join();
+
+    for (const std::vector<glm::vec3> &s : threadSplats) {
+        for (int i = 0; i < width * height; i++) splats[i] += s[i];
+    }
+    sampleCount += spp;
+}
+
+bool ReferenceRenderer::savePfm(const std::string &filename) const {
+    std::ofstream outfile(filename, std::ios::binary);
+    if (!outfile) {
+        std::cerr << "Failed to write reference image: " << filename << std::endl;
+        return false;
+    }
+
+    // Little endian, the rows of the image already start from the bottom
+    outfile << "PF\n" << width << " " << height << "\n-1.0\n";
+    std::vector<float> pixels(3 * width * height);
+    for (int i = 0; i < width * height; i++) {
+        glm::vec3 color = image[i] + splats[i] / float(std::max(sampleCount, 1));
+        pixels[3 * i] = color.r;
+        pixels[3 * i + 1] = color.g;
+        pixels[3 * i + 2] = color.b;
+    }
+    outfile.write((const char *)pixels.data(), pixels.size() * sizeof(float));
+    return (bool)outfile;
+}
@@ -0,0 +1,126 @@
+#ifndef REFERENCE_RENDERER_HPP
+#define REFERENCE_RENDERER_HPP
+
+#include <glm/glm.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ObjectsManager.hpp"
+
+// Bidirectional path tracer on the CPU, the integrator of shaders/bdpt.glsl on a copy of the scene, for reference
+// images rendered without OpenGL context (Raytracing --reference, see main.cpp)
+// The differences with the GPU are the random numbers (one Mersenne twister per row), the light samples of the
+// s = 1 strategies (uniform in the light list, the GPU can walk the light BVH) and the splats, added at the end
+// The triangles are tested one by one like sendRay does, the rows are shared between the cores
+class ReferenceRenderer {
+public:
+    ReferenceRenderer(ObjectManager &objManager, glm::vec3 cameraPosition, const glm::mat4 &viewMatrix, int width, int height);
+
+    // Adds spp samples per pixel to the image
+    void render(int spp);
+
+    // RGB portable float map, rows from the bottom
+    bool savePfm(const std::string &filename) const;
+
+    static const int maxDepth = 8; // BDPT_MAX_DEPTH
+
+private:
+    struct Surface {
+        glm::vec3 color;
+        glm::vec3 emission; // color times strength
+        float smoothness;
+        float reflexivity;
+    };
+
+    struct Sphere {
+        glm::vec3 pos;
+        float r;
+        Surface mat;
+    };
+
+    struct Tore {
+        glm::vec3 pos;
+        float R;
+        float r;
+        Surface mat;
+    };
+
+    struct TriangleMesh {
+        int startIdx;
+        int endIdx;
+        Surface mat;
+    };
+
+    struct Hit {
+        bool hasHit;
+        glm::vec3 position; // moved off the surface along the normal
+        glm::vec3 normal;   // facing the ray
+        int objType;
+        int objIdx;
+        int triangleIdx;
+        float dist;
+    };
+
+    // BdptVertex of shaders/bdpt.glsl
+    struct Vertex {
+        glm::vec3 position;
+        int type;
+        glm::vec3 normal;
+        float pdfFwd;
+        glm::vec3 beta;
+        float pdfRev;
+        int objType;
+        int objIdx;
+        int triangleIdx;
+        bool delta;
+    };
+
+    struct Subpaths {
+        Vertex camera[maxDepth + 2];
+        Vertex light[maxDepth + 1];
+    };
+
+    int width;
+    int height;
+    glm::vec3 cameraPosition;
+    glm::mat4 viewMatrix;
+    int maxBounces;
+
+    std::vector<Sphere> spheres;
+    std::vector<Tore> tores;
+    std::vector<TriangleMesh> meshes;
+    std::vector<Triangle> triangles;
+    std::vector<LightInfo> lights; // emitters, without the environment map
+    const EnvironmentMap &environment;
+
+    std::vector<glm::vec3> image;   // mean of the camera strategies
+    std::vector<glm::vec3> splats;  // sum of the light tracing strategies
+    int sampleCount = 0;
+
+    static glm::vec3 bsdf(const Surface &mat, glm::vec3 normal, glm::vec3 toCamera, glm::vec3 toLight);
+    static float directionPdf(const Surface &mat, glm::vec3 normal, glm::vec3 prev, glm::vec3 next);
+    static float convertDensity(float pdf, glm::vec3 from, const Vertex &to);
+    static float lightPdf(const Vertex &v, const Vertex &next);
+
+    Hit intersect(glm::vec3 origin, glm::vec3 direction) const;
+    bool isVisible(glm::vec3 from, glm::vec3 to) const;
+    const Surface &getSurface(int objType, int objIdx) const;
+    glm::vec3 getAmbientLight(glm::vec3 direction) const;
+
+    float cameraDirectionPdf(glm::vec3 direction, glm::vec2 &raster) const;
+    float lightOriginPdf(const Vertex &v) const;
+    float vertexPdf(const Vertex &v, const Vertex &prev, const Vertex &next) const;
+
+    int randomWalk(std::mt19937 &rng, Vertex *path, bool isCamera, int count, int maxCount, glm::vec3 origin, glm::vec3 direction,
+                   glm::vec3 beta, float pdf, glm::vec3 &escaped) const;
+    int cameraSubpath(std::mt19937 &rng, Subpaths &paths, int x, int y, int maxCount, glm::vec3 &escaped) const;
+    int lightSubpath(std::mt19937 &rng, Subpaths &paths, int maxCount) const;
+    bool sampleLightPoint(std::mt19937 &rng, const Vertex &pt, Vertex &light, glm::vec3 &direction) const;
+
+    float misWeight(const Subpaths &paths, int s, int t, const Vertex &sampled) const;
+    glm::vec3 connect(std::mt19937 &rng, const Subpaths &paths, int s, int t, std::vector<glm::vec3> &threadSplats) const;
+    glm::vec3 sample(std::mt19937 &rng, int x, int y, std::vector<glm::vec3> &threadSplats) const;
+};
+
+#endif // REFERENCE_RENDERER_HPP
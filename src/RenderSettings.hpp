@@ -0,0 +1,105 @@
+#ifndef RENDER_SETTINGS_HPP
+#define RENDER_SETTINGS_HPP
+
+// Matches the SAMPLER_* defines of sampler.glsl
+enum SamplerType {
+    SAMPLER_RANDOM = 0,
+    SAMPLER_SOBOL = 1,
+    SAMPLER_BLUE_NOISE = 2
+};
+
+// Path tracing implementations, with the same integrator
+enum Pipeline {
+    PIPELINE_MEGAKERNEL = 0, // compute_shader.glsl
+    PIPELINE_WAVEFRONT = 1   // wavefront_*.glsl, see WavefrontRenderer
+};
+
+// Integrator options edited in the "Edit render" page and sent to the compute shader
+struct RenderSettings {
+    int pipeline = PIPELINE_MEGAKERNEL;
+    bool sortRays = false; // wavefront only, secondary rays sorted by direction and origin before tracing
+
+    // Megakernel only: persistentWorkGroups work groups of 256 lanes that fetch pixels until the frame is done,
+    // enough to fill every compute unit of the GPU (a few per unit)
+    bool usePersistentThreads = false;
+    int persistentWorkGroups = 128;
+
+    // Hybrid primary visibility: the camera rays start from the triangles rasterized by GBuffer, with one sub-pixel
+    // position per pass instead of one per sample, so the edges need more passes to be antialiased
+    bool useRasterPrimary = false;
+
+    // While the camera holds still, the paths start from cached first hits (PrimaryCache) and only trace their bounces
+    // The pixels are antialiased with PrimaryCache::strata sub-pixel positions
+    bool usePrimaryCache = false;
+
+    bool useNEE = true;
+    bool useMIS = true;
+
+    // Next event estimation picks the emitters by walking down the light BVH (LightTree) instead of uniformly
+    bool useLightTree = true;
+
+    // Megakernel only: the first diffuse vertex of the paths takes its direct light from per pixel reservoirs
+    // reused across passes and neighbor pixels (LightReservoirs), each path resampling restirCandidates light samples
+    bool useReSTIR = false;
+    int restirCandidates = 8;
+
+    // Megakernel only: the diffuse bounces draw half of their directions from the incident radiance learned by the
+    // first passes (GuidingTree), the training passes run without persistent threads
+    bool usePathGuiding = false;
+
+    // Megakernel only: bidirectional path tracer (compute_shader_bdpt.glsl) instead of the path tracer, the light
+    // subpaths reaching the camera are added one pass later (LightSplats). Its camera rays ignore the rasterized
+    // primary rays and the cache, the light samples ReSTIR and the guiding, and every pass covers the whole image
+    bool useBDPT = false;
+
+    // Megakernel only: primary sample space Metropolis (MetropolisRenderer), Markov chains mutating the random numbers
+    // of the path tracer, for the lighting that few random paths find. The passes run mutations of the chains instead of
+    // samples per pixel, the camera moves are previewed by the path tracer, and reprojection and adaptive sampling are off
+    bool useMLT = false;
+
+    // Megakernel only: the preview frames of camera moves and scene edits end their paths into irradiance probes after
+    // one bounce (ProbeGrid), traced in the background and restarted only around the edited objects. The converged
+    // image is still the full path tracer
+    bool useProbeCache = false;
+
+    bool useRussianRoulette = true;
+    int rrMinDepth = 3;     // bounces always traced before the roulette starts
+    int rrMaxBounces = 16;  // safety cap of the roulette paths, the scene's maxBounces applies without roulette
+
+    // Tiles stop receiving samples once all their pixels have adaptiveMinSamples samples
+    // and a standard error below adaptiveThreshold (relative to the pixel luminance)
+    bool useAdaptiveSampling = true;
+    int adaptiveMinSamples = 32;
+    float adaptiveThreshold = 0.01f;
+
+    // With autoSpp, the GPU time of a frame is kept under targetFrameTime (ms), measured by timer queries:
+    // several samples per pixel when a whole pass fits, otherwise the pass is split in ranges of tiles over several frames
+    bool autoSpp = true;
+    int spp = 1;
+    float targetFrameTime = 12.0f;
+
+    // While the camera moves, frames are rendered at 1 / resolutionDivisor of the resolution and upscaled,
+    // the divisor is picked by the render loop so that a whole frame fits in targetFrameTime
+    bool useDynamicResolution = true;
+    int resolutionDivisor = 1;
+
+    // Camera moves warp the accumulated image into the new view (TemporalReprojection) instead of discarding it
+    bool useReprojection = true;
+
+    // The displayed and saved images are filtered by denoiserIterations passes of the a-trous denoiser (Denoiser),
+    // the accumulation itself stays unbiased
+    bool useDenoiser = true;
+    int denoiserIterations = 5;
+
+    // Scale of the radiance before the ACES tone map of the displayed and saved images (shaders/tone_map.glsl)
+    float exposure = 1.0f;
+
+    // Rendering stops once every tile is under adaptiveThreshold or after autoStopSamples samples,
+    // the main loop then waits for events instead of polling
+    bool useAutoStop = true;
+    int autoStopSamples = 4096;
+    // Blue noise gives the least visible error in the first frames, it falls back to Sobol when the texture is missing
+    int samplerType = SAMPLER_BLUE_NOISE;
+};
+
+#endif // RENDER_SETTINGS_HPP
@@ -30,9 +30,31 @@ ShaderProgram::~ShaderProgram() {
 }
 
 std::string ShaderProgram::loadShaderSource(const std::string &filePath) {
+    std::set<std::string> included;
+    return loadShaderSource(filePath, included);
+}
+
+std::string ShaderProgram::loadShaderSource(const std::string &filePath, std::set<std::string> &included) {
+    // GLSL has no include: #include "file" lines are replaced by the file, relative to the including shader
+    // A file already included is skipped, like a header behind its guard, so that files can include what they use
+    if (!included.insert(filePath).second) return "";
+
     std::ifstream file(filePath);
+    if (!file) std::cerr << "Failed to open shader: " << filePath << std::endl;
+
+    std::string directory = filePath.substr(0, filePath.find_last_of("/\\") + 1);
+
     std::stringstream buffer;
-    buffer << file.rdbuf();
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t first = line.find('"');
+        size_t last = line.rfind('"');
+        if (line.compare(0, 8, "#include") == 0 && first != last) {
+            buffer << loadShaderSource(directory + line.substr(first + 1, last - first - 1), included);
+        } else {
+            buffer << line << "\n";
+        }
+    }
     return buffer.str();
 }
 
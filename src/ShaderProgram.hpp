@@ -4,6 +4,7 @@
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <set>
 #include <string>
 #include <fstream>
 #include <iostream>
@@ -22,7 +23,9 @@ public:
 
     void set(const GLchar *name, int i) { glUniform1i(glGetUniformLocation(programID, name), i); };
     void set(const GLchar *name, float val) { glUniform1f(glGetUniformLocation(programID, name), val); };
+    void set(const GLchar *name, const glm::vec2 &vec) { glUniform2fv(glGetUniformLocation(programID, name), 1, glm::value_ptr(vec)); };
     void set(const GLchar *name, const glm::vec3 &vec) { glUniform3fv(glGetUniformLocation(programID, name), 1, glm::value_ptr(vec)); };
+    void set(const GLchar *name, const glm::ivec3 &vec) { glUniform3iv(glGetUniformLocation(programID, name), 1, glm::value_ptr(vec)); };
     void set(const GLchar *name, const glm::mat4 &mat) { glUniformMatrix4fv(glGetUniformLocation(programID, name), 1, GL_FALSE, glm::value_ptr(mat)); };
 
     void setArray(const std::string &array, unsigned int index, const std::string &name, int i);
@@ -35,6 +38,9 @@ public:
 
 protected:
     GLuint programID;
+
+    // included holds the files already pasted in the shader, each file is only included once
+    static std::string loadShaderSource(const std::string &filePath, std::set<std::string> &included);
 };
 
 #endif // SHADER_PROGRAM_HPP
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "TemporalReprojection.hpp"
+
+#include "AdaptiveSampler.hpp"
+
+static GLuint genImage(int width, int height, GLenum format) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+TemporalReprojection::TemporalReprojection(int width, int height)
+    : width(width), height(height), reprojectProgram("shaders/reproject.glsl") {
+
+    historyColorTexture = genImage(width, height, GL_RGBA32F);
+    historyVarianceTexture = genImage(width, height, GL_RGBA32F);
+    firstHitTextures[0] = genImage(width, height, GL_RGBA32F);
+    firstHitTextures[1] = genImage(width, height, GL_RGBA32F);
+}
+
+TemporalReprojection::~TemporalReprojection() {
+    glDeleteTextures(1, &historyColorTexture);
+    glDeleteTextures(1, &historyVarianceTexture);
+    glDeleteTextures(2, firstHitTextures);
+}
+
+void TemporalReprojection::storeFirstHits(const std::function<void(ShaderProgram &)> &setUniforms) {
+    reprojectProgram.use();
+    setUniforms(reprojectProgram);
+    reprojectProgram.set("reprojectHistory", 0);
+
+    glBindImageTexture(5, firstHitTextures[current], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+    const int tileSize = AdaptiveSampler::tileSize;
+    glDispatchCompute((width + tileSize - 1) / tileSize, (height + tileSize - 1) / tileSize, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void TemporalReprojection::storeHistory(GLuint colorTexture, GLuint varianceTexture) {
+    // The images are read at other pixels than the ones written, and rendered again before the warp
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glCopyImageSubData(colorTexture, GL_TEXTURE_2D, 0, 0, 0, 0, historyColorTexture, GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+    glCopyImageSubData(varianceTexture, GL_TEXTURE_2D, 0, 0, 0, 0, historyVarianceTexture, GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+}
+
+void TemporalReprojection::reproject(const glm::vec3 &historyCameraPosition, const glm::mat4 &historyViewMatrix,
+                                     const std::function<void(ShaderProgram &)> &setUniforms) {
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    reprojectProgram.use();
+    setUniforms(reprojectProgram);
+    reprojectProgram.set("reprojectHistory", 1);
+    reprojectProgram.set("historyCameraPosition", historyCameraPosition);
+    reprojectProgram.set("historyViewMatrix", historyViewMatrix);
+
+    glBindImageTexture(3, historyColorTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(4, historyVarianceTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(5, firstHitTextures[1 - current], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glBindImageTexture(6, firstHitTextures[current], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+
+    const int tileSize = AdaptiveSampler::tileSize;
+    glDispatchCompute((width + tileSize - 1) / tileSize, (height + tileSize - 1) / tileSize, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    current = 1 - current;
+}
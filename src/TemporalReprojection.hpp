@@ -0,0 +1,43 @@
+#ifndef TEMPORAL_REPROJECTION_HPP
+#define TEMPORAL_REPROJECTION_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <functional>
+
+#include "ComputeShader.hpp"
+
+// Keeps the accumulated samples across camera moves (shaders/reproject.glsl)
+// The first hit of every pixel is stored for the camera of the accumulation, after a move the image is
+// warped into the new view and the pixels whose first hit does not match (disocclusions) restart from zero
+// The history is copied when the move starts and warped once, when the camera holds still again
+class TemporalReprojection {
+public:
+    TemporalReprojection(int width, int height);
+    ~TemporalReprojection();
+
+    // Stores the first hits of the current camera, for an accumulation started from scratch
+    void storeFirstHits(const std::function<void(ShaderProgram &)> &setUniforms);
+
+    // Keeps a copy of the accumulated and variance images of the camera of the stored first hits
+    void storeHistory(GLuint colorTexture, GLuint varianceTexture);
+
+    // Replaces the accumulated image bound on image unit 0 and the variance image bound on unit 2 by the
+    // reprojection of the stored history from the history camera to the current one
+    // setUniforms sends the scene and the current camera
+    void reproject(const glm::vec3 &historyCameraPosition, const glm::mat4 &historyViewMatrix,
+                   const std::function<void(ShaderProgram &)> &setUniforms);
+
+private:
+    int width;
+    int height;
+
+    ComputeShader reprojectProgram;
+
+    GLuint historyColorTexture;
+    GLuint historyVarianceTexture;
+    GLuint firstHitTextures[2]; // current and history camera, swapped by reproject
+    int current = 0;
+};
+
+#endif // TEMPORAL_REPROJECTION_HPP
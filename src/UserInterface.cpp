@@ -2,10 +2,13 @@
 
 #include <GLFW/glfw3.h>
 
-UserInterface::UserInterface(GLFWwindow *window, int UIwidth, char filename[], ObjectManager *objManager)
-    : window(window), UIwidth(UIwidth), objManager(objManager) {
+UserInterface::UserInterface(GLFWwindow *window, int UIwidth, char filename[], ObjectManager *objManager, RenderSettings *settings, Benchmark *benchmark,
+                             const MetropolisRenderer *metropolis, const ProbeGrid *probeGrid)
+    : window(window), UIwidth(UIwidth), objManager(objManager), settings(settings), benchmark(benchmark), metropolis(metropolis),
+      probeGrid(probeGrid) {
 
     strncpy(UI_filename, filename, 64);
+    strncpy(UI_environmentFile, objManager->getEnvironment().getFilename().c_str(), 63);
     ImGui::CreateContext();
     ImGui::StyleColorsDark();
 
@@ -51,6 +54,27 @@ void UserInterface::render() {
             ImGui::EndCombo();
         }
 
+        // Equirectangular PFM or Radiance .hdr file of data/environments, an empty name keeps the sky gradient
+        EnvironmentMap &environment = objManager->getEnvironment();
+        ImGui::InputText("Environment", UI_environmentFile, 64);
+        ImGui::SameLine();
+        if (ImGui::Button("Load")) {
+            environment.load(UI_environmentFile);
+            objManager->markAllDirty();
+            UI_isModified = true;
+            UI_shouldReset = true;
+        }
+
+        if (environment.isLoaded()) {
+            float strength = environment.getStrength();
+            if (ImGui::DragFloat("Env. strength", &strength, 0.01f, 0.0f, 100.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp)) {
+                environment.setStrength(strength);
+                objManager->markAllDirty();
+                UI_isModified = true;
+                UI_shouldReset = true;
+            }
+        }
+
         auto &names = objManager->getNames();
 
         if (names.size() > 0) {
@@ -86,30 +110,35 @@ void UserInterface::render() {
             float uniformScale = size.x;
 
             if (ImGui::ColorEdit3("Color", colorArray)) {
+                objManager->markDirty(UI_selectedObj);
                 selectedObj.setColor(glm::vec3(colorArray[0], colorArray[1], colorArray[2]));
                 UI_isModified = true;
                 UI_shouldReset = true;
             }
 
             if (ImGui::ColorEdit3("Emiss. Color", emiColorArray)) {
+                objManager->markDirty(UI_selectedObj);
                 selectedObj.setEmiColor(glm::vec3(emiColorArray[0], emiColorArray[1], emiColorArray[2]));
                 UI_isModified = true;
                 UI_shouldReset = true;
             }
 
             if (ImGui::DragFloat("EmissionStrength", &emissionStrength, 0.01f, 0.0f, 100.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp)) {
+                objManager->markDirty(UI_selectedObj);
                 selectedObj.setEmissionStrength(emissionStrength);
                 UI_isModified = true;
                 UI_shouldReset = true;
             }
 
             if (ImGui::SliderFloat("Smoothness", &smoothness, 0.0f, 1.0f, "%.2f")) {
+                objManager->markDirty(UI_selectedObj);
                 selectedObj.setSmoothness(smoothness);
                 UI_isModified = true;
                 UI_shouldReset = true;
             }
 
             if (ImGui::SliderFloat("Reflexivity", &reflexivity, 0.0f, 1.0f, "%.2f")) {
+                objManager->markDirty(UI_selectedObj);
                 selectedObj.setReflexivity(reflexivity);
                 UI_isModified = true;
                 UI_shouldReset = true;
@@ -121,6 +150,7 @@ void UserInterface::render() {
             if (ImGui::DragFloat("Y##pos", &posArray[1], 0.01f, 0.0f, 0.0f, "%.2f")) updatePos = true;
             if (ImGui::DragFloat("Z##pos", &posArray[2], 0.01f, 0.0f, 0.0f, "%.2f")) updatePos = true;
             if (updatePos) {
+                objManager->markDirty(UI_selectedObj);
                 selectedObj.setPos(glm::vec3(posArray[0], posArray[1], posArray[2]));
                 UI_isModified = true;
                 UI_shouldReset = true;
@@ -132,6 +162,7 @@ void UserInterface::render() {
             if (ImGui::DragFloat("Y##rot", &rotArray[1], 0.2f, -360.0f, 360.0f, "%.0f", ImGuiSliderFlags_AlwaysClamp)) updateRot = true;
             if (ImGui::DragFloat("Z##rot", &rotArray[2], 0.2f, -360.0f, 360.0f, "%.0f", ImGuiSliderFlags_AlwaysClamp)) updateRot = true;
             if (updateRot) {
+                objManager->markDirty(UI_selectedObj);
                 selectedObj.setRotation(glm::vec3(rotArray[0], rotArray[1], rotArray[2]));
                 UI_isModified = true;
                 UI_shouldReset = true;
@@ -141,6 +172,7 @@ void UserInterface::render() {
             ImGui::Checkbox("Uniform Size", &UI_uniformSize);
             if (UI_uniformSize) {
                 if (ImGui::DragFloat("Scale", &uniformScale, 0.01f, 0.0f, 0.0f, "%.2f")) {
+                    objManager->markDirty(UI_selectedObj);
                     selectedObj.setSize(uniformScale);
                     UI_isModified = true;
                     UI_shouldReset = true;
@@ -151,6 +183,7 @@ void UserInterface::render() {
                 if (ImGui::DragFloat("Y##scale", &sizeArray[1], 0.01f, 0.0f, 0.0f, "%.2f")) updateScale = true;
                 if (ImGui::DragFloat("Z##scale", &sizeArray[2], 0.01f, 0.0f, 0.0f, "%.2f")) updateScale = true;
                 if (updateScale) {
+                    objManager->markDirty(UI_selectedObj);
                     selectedObj.setSize(glm::vec3(sizeArray[0], sizeArray[1], sizeArray[2]));
                     UI_isModified = true;
                     UI_shouldReset = true;
@@ -186,11 +219,167 @@ void UserInterface::render() {
             }
         }
     } else if (page == 1) {
+        // With the roulette the paths are capped by its own setting below
         int maxBounces = objManager->getMaxBounces();
-        if (ImGui::DragInt("maxBounces", &maxBounces, 0.1f, 1.0f, 50.0f, "%d", ImGuiSliderFlags_AlwaysClamp)) {
+        if (!settings->useRussianRoulette && ImGui::DragInt("maxBounces", &maxBounces, 0.1f, 1.0f, 50.0f, "%d", ImGuiSliderFlags_AlwaysClamp)) {
             objManager->setMaxBounces(maxBounces);
             UI_shouldReset = true;
         }
+
+        const char *pipelines[] = {"Megakernel", "Wavefront"};
+        if (ImGui::Combo("Pipeline", &settings->pipeline, pipelines, IM_ARRAYSIZE(pipelines))) {
+            UI_shouldReset = true;
+        }
+
+        if (settings->pipeline == PIPELINE_WAVEFRONT) {
+            ImGui::Checkbox("Sort secondary rays", &settings->sortRays);
+        } else {
+            if (!settings->useMLT && ImGui::Checkbox("Bidirectional path tracing", &settings->useBDPT)) {
+                UI_shouldReset = true;
+            }
+            if (!settings->useBDPT && ImGui::Checkbox("Metropolis (PSSMLT)", &settings->useMLT)) {
+                UI_shouldReset = true;
+            }
+            if (settings->useMLT && metropolis->getSmallStepAcceptance() >= 0.0f) {
+                ImGui::Text("Acceptance: small %.1f%%  large %.1f%%", 100.0f * metropolis->getSmallStepAcceptance(),
+                            100.0f * metropolis->getLargeStepAcceptance());
+            }
+            bool pathTracer = !settings->useBDPT && !settings->useMLT;
+            if (pathTracer) ImGui::Checkbox("Persistent threads", &settings->usePersistentThreads);
+            if (settings->usePersistentThreads && pathTracer) {
+                ImGui::SliderInt("Work groups", &settings->persistentWorkGroups, 1, 1024);
+            }
+        }
+
+        if (ImGui::Checkbox("Rasterized primary rays", &settings->useRasterPrimary)) {
+            UI_shouldReset = true;
+        }
+
+        if (ImGui::Checkbox("Cache primary hits", &settings->usePrimaryCache)) {
+            UI_shouldReset = true;
+        }
+
+        if (ImGui::Checkbox("Next event estimation", &settings->useNEE)) {
+            UI_shouldReset = true;
+        }
+
+        if (settings->useNEE && ImGui::Checkbox("Multiple importance sampling", &settings->useMIS)) {
+            UI_shouldReset = true;
+        }
+
+        if (settings->useNEE && ImGui::Checkbox("Light BVH", &settings->useLightTree)) {
+            UI_shouldReset = true;
+        }
+
+        if (settings->useNEE && settings->pipeline == PIPELINE_MEGAKERNEL && !settings->useBDPT && !settings->useMLT) {
+            if (ImGui::Checkbox("ReSTIR direct light", &settings->useReSTIR)) {
+                UI_shouldReset = true;
+            }
+            if (settings->useReSTIR && ImGui::DragInt("Candidates", &settings->restirCandidates, 0.1f, 1, 32, "%d", ImGuiSliderFlags_AlwaysClamp)) {
+                UI_shouldReset = true;
+            }
+        }
+
+        if (settings->pipeline == PIPELINE_MEGAKERNEL && !settings->useBDPT && !settings->useMLT && ImGui::Checkbox("Path guiding", &settings->usePathGuiding)) {
+            UI_shouldReset = true;
+        }
+
+        // Only the preview frames use the probes, the accumulated image does not change
+        if (settings->pipeline == PIPELINE_MEGAKERNEL && !settings->useBDPT) {
+            ImGui::Checkbox("Irradiance probe preview", &settings->useProbeCache);
+            if (settings->useProbeCache) ImGui::Text("Probes: %.0f%%", 100.0f * probeGrid->getProgress());
+        }
+
+        if (ImGui::Checkbox("Russian roulette", &settings->useRussianRoulette)) {
+            UI_shouldReset = true;
+        }
+
+        if (settings->useRussianRoulette && ImGui::DragInt("Min depth", &settings->rrMinDepth, 0.1f, 1, 10, "%d", ImGuiSliderFlags_AlwaysClamp)) {
+            UI_shouldReset = true;
+        }
+
+        if (settings->useRussianRoulette && ImGui::DragInt("Max depth", &settings->rrMaxBounces, 0.1f, 1, 50, "%d", ImGuiSliderFlags_AlwaysClamp)) {
+            UI_shouldReset = true;
+        }
+
+        ImGui::Checkbox("Auto samples per frame", &settings->autoSpp);
+
+        if (settings->autoSpp) {
+            ImGui::DragFloat("Target GPU time (ms)", &settings->targetFrameTime, 1.0f, 5.0f, 1000.0f, "%.0f", ImGuiSliderFlags_AlwaysClamp);
+            ImGui::Text("Samples per frame: %d", settings->spp);
+        } else {
+            ImGui::DragInt("Samples per frame", &settings->spp, 0.2f, 1, 256, "%d", ImGuiSliderFlags_AlwaysClamp);
+        }
+
+        ImGui::Checkbox("Temporal reprojection", &settings->useReprojection);
+
+        ImGui::Checkbox("Denoiser", &settings->useDenoiser);
+        if (settings->useDenoiser) {
+            ImGui::DragInt("Denoiser iterations", &settings->denoiserIterations, 0.1f, 1, 8, "%d", ImGuiSliderFlags_AlwaysClamp);
+        }
+
+        ImGui::DragFloat("Exposure", &settings->exposure, 0.01f, 0.05f, 16.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_Logarithmic);
+
+        ImGui::Checkbox("Dynamic resolution", &settings->useDynamicResolution);
+        if (settings->useDynamicResolution) {
+            ImGui::Text("Resolution: 1/%d", settings->resolutionDivisor);
+        }
+
+        if (ImGui::Checkbox("Adaptive sampling", &settings->useAdaptiveSampling)) {
+            UI_shouldReset = true;
+        }
+
+        ImGui::Checkbox("Stop when converged", &settings->useAutoStop);
+
+        // Both use the per tile convergence test
+        if (settings->useAdaptiveSampling || settings->useAutoStop) {
+            ImGui::DragInt("Min samples", &settings->adaptiveMinSamples, 0.5f, 1, 1024, "%d", ImGuiSliderFlags_AlwaysClamp);
+            ImGui::DragFloat("Error threshold", &settings->adaptiveThreshold, 0.001f, 0.001f, 0.5f, "%.3f", ImGuiSliderFlags_AlwaysClamp);
+        }
+
+        if (settings->useAutoStop) {
+            ImGui::DragInt("Max samples", &settings->autoStopSamples, 16.0f, 1, 1 << 20, "%d", ImGuiSliderFlags_AlwaysClamp);
+        }
+
+        const char *samplers[] = {"Random (PCG)", "Sobol (Owen)", "Blue noise"};
+        if (ImGui::Combo("Sampler", &settings->samplerType, samplers, IM_ARRAYSIZE(samplers))) {
+            UI_shouldReset = true;
+        }
+
+        ImGui::Separator();
+        ImGui::Text("Benchmark");
+        ImGui::Text("Samples: %d  Time: %.1fs", benchmark->getSamples(), benchmark->getElapsed());
+
+        if (ImGui::Button("Save reference")) {
+            benchmark->saveReference();
+        }
+
+        if (benchmark->hasReference()) {
+            ImGui::SameLine();
+            if (ImGui::Button("RMSE")) {
+                benchmark->computeRMSE();
+            }
+            if (benchmark->getLastRMSE() >= 0.0f) {
+                ImGui::SameLine();
+                ImGui::Text("%.5f", benchmark->getLastRMSE());
+            }
+
+            ImGui::DragFloat("Duration (s)", &UI_benchmarkDuration, 0.1f, 1.0f, 600.0f, "%.1f", ImGuiSliderFlags_AlwaysClamp);
+            ImGui::DragFloat("Target RMSE", &UI_targetRMSE, 0.0001f, 0.0001f, 1.0f, "%.4f", ImGuiSliderFlags_AlwaysClamp);
+            if (benchmark->isRunning()) {
+                ImGui::Text("Running...");
+            } else {
+                if (ImGui::Button("Run equal time")) {
+                    benchmark->startRun(UI_benchmarkDuration);
+                    UI_shouldReset = true;
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Run to target")) {
+                    benchmark->startTargetRun(UI_targetRMSE, UI_benchmarkDuration);
+                    UI_shouldReset = true;
+                }
+            }
+        }
     }
 
     ImGui::End();
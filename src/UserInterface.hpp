@@ -6,10 +6,15 @@
 #include "backends/imgui_impl_opengl3.h"
 
 #include "ObjectsManager.hpp"
+#include "RenderSettings.hpp"
+#include "Benchmark.hpp"
+#include "MetropolisRenderer.hpp"
+#include "ProbeGrid.hpp"
 
 class UserInterface {
 public:
-    UserInterface(GLFWwindow *window, int UIwidth, char filename[], ObjectManager *objManager);
+    UserInterface(GLFWwindow *window, int UIwidth, char filename[], ObjectManager *objManager, RenderSettings *settings, Benchmark *benchmark,
+                  const MetropolisRenderer *metropolis, const ProbeGrid *probeGrid);
     void render();
 
     bool shouldReset();
@@ -21,14 +26,21 @@ private:
     bool UI_showOpen = false;
     bool UI_isModified = false;
     char UI_filename[64];
+    char UI_environmentFile[64] = "";
 
     int page = 0;
     bool UI_shouldReset = false;
     bool UI_resetTriangleBuff = false;
+    float UI_benchmarkDuration = 10.0f;
+    float UI_targetRMSE = 0.01f;
 
     int UIwidth;
     GLFWwindow *window;
     ObjectManager *objManager;
+    RenderSettings *settings;
+    Benchmark *benchmark;
+    const MetropolisRenderer *metropolis;
+    const ProbeGrid *probeGrid;
 };
 
 #endif // USERINTERFACE_HPP
@@ -0,0 +1,188 @@
+#include "WavefrontRenderer.hpp"
+
+#include <algorithm>
+
+// std430 sizes of the structs of shaders/wavefront.glsl
+const int pathStateSize = 144;
+const int shadowRaySize = 64;
+const int queueCounterSize = 16;
+
+// Order of the counters in the QueueCounters buffer
+enum Queue {
+    RAY_QUEUE = 0,
+    HIT_QUEUE = 1,
+    SHADOW_QUEUE = 2
+};
+
+const GLuint groupSize = 64; // local_size_x of the kernels
+
+// Stages and bins of shaders/wavefront_sort.glsl
+enum SortStage {
+    SORT_STAGE_BOUNDS = 0,
+    SORT_STAGE_HISTOGRAM = 1,
+    SORT_STAGE_SCAN = 2,
+    SORT_STAGE_SCATTER = 3
+};
+
+const int sortBinCount = 8 << (3 * 4); // octant and 4 Morton bits per axis
+
+WavefrontRenderer::WavefrontRenderer()
+    : generateProgram("shaders/wavefront_generate.glsl"),
+      extendProgram("shaders/wavefront_extend.glsl"),
+      shadeProgram("shaders/wavefront_shade.glsl"),
+      connectProgram("shaders/wavefront_connect.glsl"),
+      accumulateProgram("shaders/wavefront_accumulate.glsl"),
+      sortProgram("shaders/wavefront_sort.glsl") {
+
+    GLuint *buffers[] = {&pathBuffer, &rayQueueBuffer, &hitQueueBuffer, &shadowQueueBuffer,
+                         &sortedRayQueueBuffer, &sortKeyBuffer, &sortBinBuffer};
+    GLsizeiptr sizes[] = {poolSize * pathStateSize, poolSize * sizeof(GLuint), poolSize * sizeof(GLuint), poolSize * shadowRaySize,
+                          poolSize * sizeof(GLuint), poolSize * sizeof(GLuint), (6 + sortBinCount) * sizeof(GLuint)};
+
+    for (int i = 0; i < 7; i++) {
+        glGenBuffers(1, buffers[i]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[i], NULL, GL_DYNAMIC_COPY);
+    }
+
+    // count, groupsX, groupsY, groupsZ for each queue
+    const GLuint counters[12] = {0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1};
+    glGenBuffers(1, &counterBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(counters), counters, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+WavefrontRenderer::~WavefrontRenderer() {
+    glDeleteBuffers(1, &pathBuffer);
+    glDeleteBuffers(1, &rayQueueBuffer);
+    glDeleteBuffers(1, &hitQueueBuffer);
+    glDeleteBuffers(1, &shadowQueueBuffer);
+    glDeleteBuffers(1, &counterBuffer);
+    glDeleteBuffers(1, &sortedRayQueueBuffer);
+    glDeleteBuffers(1, &sortKeyBuffer);
+    glDeleteBuffers(1, &sortBinBuffer);
+}
+
+void WavefrontRenderer::bindBuffers() {
+    // bindings 3 to 7 in shaders/wavefront.glsl
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, pathBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, rayQueueBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, hitQueueBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, shadowQueueBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, counterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, sortedRayQueueBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, sortKeyBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, sortBinBuffer);
+}
+
+void WavefrontRenderer::clearQueue(int queue) {
+    // Resets count and groupsX, the queue content is overwritten
+    const GLuint zero = 0;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, queue * queueCounterSize, 2 * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void WavefrontRenderer::dispatchQueue(ComputeShader &program, int queue) {
+    // The previous kernel filled the queue and its counters
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    program.use();
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counterBuffer);
+    glDispatchComputeIndirect(queue * queueCounterSize + sizeof(GLuint));
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+void WavefrontRenderer::sortRayQueue() {
+    // Empty bounds (min = all ones, max = 0 in the ordered encoding) and bins
+    const GLuint ones = 0xffffffff;
+    const GLuint zero = 0;
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sortBinBuffer);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, 3 * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &ones);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 3 * sizeof(GLuint), (3 + sortBinCount) * sizeof(GLuint),
+                         GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    sortProgram.use();
+    sortProgram.set("sortStage", (int)SORT_STAGE_BOUNDS);
+    dispatchQueue(sortProgram, RAY_QUEUE);
+
+    sortProgram.set("sortStage", (int)SORT_STAGE_HISTOGRAM);
+    dispatchQueue(sortProgram, RAY_QUEUE);
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    sortProgram.set("sortStage", (int)SORT_STAGE_SCAN);
+    glDispatchCompute(1, 1, 1);
+
+    sortProgram.set("sortStage", (int)SORT_STAGE_SCATTER);
+    dispatchQueue(sortProgram, RAY_QUEUE);
+
+    // extend reads the sorted copy, the old queue receives the rays of the next bounce
+    std::swap(rayQueueBuffer, sortedRayQueueBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, rayQueueBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, sortedRayQueueBuffer);
+}
+
+void WavefrontRenderer::render(int firstTile, int tileCount, bool useTileList, bool clearAccumulation, int spp, int maxBounces, bool sortRays,
+                               const std::function<void(ShaderProgram &)> &setUniforms) {
+    const int tilePixels = 256;
+    int firstPixel = firstTile * tilePixels;
+    int pixelCount = tileCount * tilePixels;
+
+    bindBuffers();
+
+    ComputeShader *programs[] = {&generateProgram, &extendProgram, &shadeProgram, &connectProgram, &accumulateProgram};
+    for (ComputeShader *program : programs) {
+        program->use();
+        setUniforms(*program);
+    }
+
+    generateProgram.use();
+    generateProgram.set("useTileList", (int)useTileList);
+
+    shadeProgram.use();
+    shadeProgram.set("maxBounces", maxBounces);
+
+    for (int s = 0; s < spp; s++) {
+        for (int offset = 0; offset < pixelCount; offset += poolSize) {
+            int chunk = std::min(poolSize, pixelCount - offset);
+            bool clear = clearAccumulation && s == 0;
+            GLuint groups = (chunk + groupSize - 1) / groupSize;
+
+            clearQueue(RAY_QUEUE);
+            clearQueue(SHADOW_QUEUE);
+
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+            generateProgram.use();
+            generateProgram.set("clearAccumulation", (int)clear);
+            generateProgram.set("pixelOffset", firstPixel + offset);
+            generateProgram.set("pixelCount", chunk);
+            glDispatchCompute(groups, 1, 1);
+
+            for (int m = 0; m < maxBounces; m++) {
+                // Camera rays are already coherent
+                if (sortRays && m > 0) sortRayQueue();
+
+                clearQueue(HIT_QUEUE);
+                dispatchQueue(extendProgram, RAY_QUEUE);
+
+                clearQueue(RAY_QUEUE);
+                dispatchQueue(shadeProgram, HIT_QUEUE);
+
+                dispatchQueue(connectProgram, SHADOW_QUEUE);
+                clearQueue(SHADOW_QUEUE);
+            }
+
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            accumulateProgram.use();
+            accumulateProgram.set("clearAccumulation", (int)clear);
+            accumulateProgram.set("pixelCount", chunk);
+            glDispatchCompute(groups, 1, 1);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef WAVEFRONT_RENDERER_HPP
+#define WAVEFRONT_RENDERER_HPP
+
+#include <glad/gl.h>
+#include <functional>
+
+#include "ComputeShader.hpp"
+
+// Wavefront path tracing: the megakernel of compute_shader.glsl split into generate, extend, shade and connect kernels
+// (shaders/wavefront_*.glsl) communicating through path states and queues in SSBOs
+// Each kernel is dispatched indirectly with the size of the queue it consumes, so the lanes of a work group
+// all run the same stage of live paths
+class WavefrontRenderer {
+public:
+    WavefrontRenderer();
+    ~WavefrontRenderer();
+
+    // Adds spp samples to the pixels of tileCount tiles from firstTile (tiles of the image in row order,
+    // or the tiles listed by AdaptiveSampler), numbered like the work groups of compute_shader.glsl
+    // The accumulated image must be bound on image unit 0, the variance image and the tile list by AdaptiveSampler::bind
+    // setUniforms sends the scene, camera and render settings to a kernel
+    // sortRays sorts the secondary rays by direction and origin before tracing them (shaders/wavefront_sort.glsl)
+    void render(int firstTile, int tileCount, bool useTileList, bool clearAccumulation, int spp, int maxBounces, bool sortRays,
+                const std::function<void(ShaderProgram &)> &setUniforms);
+
+    static const int poolSize = 1 << 18; // paths in flight, the image is rendered by chunks of poolSize pixels
+
+private:
+    void bindBuffers();
+    void clearQueue(int queue);
+    void dispatchQueue(ComputeShader &program, int queue);
+    void sortRayQueue();
+
+    ComputeShader generateProgram;
+    ComputeShader extendProgram;
+    ComputeShader shadeProgram;
+    ComputeShader connectProgram;
+    ComputeShader accumulateProgram;
+    ComputeShader sortProgram;
+
+    GLuint pathBuffer;
+    GLuint rayQueueBuffer;
+    GLuint hitQueueBuffer;
+    GLuint shadowQueueBuffer;
+    GLuint counterBuffer;
+
+    GLuint sortedRayQueueBuffer; // swapped with rayQueueBuffer after each sort
+    GLuint sortKeyBuffer;
+    GLuint sortBinBuffer;
+};
+
+#endif // WAVEFRONT_RENDERER_HPP
@@ -3,6 +3,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -18,6 +20,22 @@
 #include "ObjectsManager.hpp"
 #include "utils.hpp"
 #include "UserInterface.hpp"
+#include "RenderSettings.hpp"
+#include "Benchmark.hpp"
+#include "AdaptiveSampler.hpp"
+#include "WavefrontRenderer.hpp"
+#include "PersistentScheduler.hpp"
+#include "GpuTimer.hpp"
+#include "TemporalReprojection.hpp"
+#include "Denoiser.hpp"
+#include "GBuffer.hpp"
+#include "PrimaryCache.hpp"
+#include "LightReservoirs.hpp"
+#include "GuidingTree.hpp"
+#include "LightSplats.hpp"
+#include "MetropolisRenderer.hpp"
+#include "ProbeGrid.hpp"
+#include "ReferenceRenderer.hpp"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
@@ -29,8 +47,7 @@ unsigned int SCR_HEIGHT = 800;
 const int textureWidth = 1600;
 const int textureHeight = 1600;
 
-GLuint texOutput1;
-GLuint texOutput2;
+GLuint texOutput;
 
 char scenePath[64] = "scene.scene";
 
@@ -44,6 +61,7 @@ glm::vec3 lightPos(0.0f, 2.0f, 2.0f);
 glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
 
 bool useRaytracing = false;
+bool saveRender = false; // set by the screenshot key, the render loop saves the full resolution image
 
 // Fonction pour sauvegarder l'écran
 void SaveScreenshot(const char *filename, int width, int height) {
@@ -67,6 +85,101 @@ void SaveScreenshot(const char *filename, int width, int height) {
     }
 }
 
+// 8 bit value of a color channel, tone mapped like the display image (shaders/tone_map.glsl)
+unsigned char ToDisplay(float value, float exposure) {
+    float x = std::max(value * exposure, 0.0f);
+    float mapped = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+    return (unsigned char)(glm::clamp(mapped, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// Reads back a RGBA float texture
+std::vector<float> ReadTexture(GLuint texture, int width, int height) {
+    std::vector<float> pixels(width * height * 4);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return pixels;
+}
+
+// Saves the full resolution path traced image, denoised on the CPU with the guides of the denoiser when iterations > 0
+void SaveRender(const char *filename, GLuint texture, GLuint varianceTexture, const Denoiser &denoiser, int iterations, float exposure) {
+    std::vector<float> color = ReadTexture(texture, textureWidth, textureHeight);
+
+    if (iterations > 0) {
+        std::vector<float> variance = ReadTexture(varianceTexture, textureWidth, textureHeight);
+        std::vector<float> albedo, normalDepth, denoised;
+        denoiser.readGuides(albedo, normalDepth);
+        Denoiser::denoiseOnCpu(textureWidth, textureHeight, color, variance, albedo, normalDepth, iterations, denoised);
+        color.swap(denoised);
+    }
+
+    // Like the display, first row at the top
+    std::vector<unsigned char> pixels(textureWidth * textureHeight * 3);
+    for (int y = 0; y < textureHeight; ++y) {
+        for (int x = 0; x < textureWidth; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                pixels[(y * textureWidth + x) * 3 + c] = ToDisplay(color[((textureHeight - y - 1) * textureWidth + x) * 4 + c], exposure);
+            }
+        }
+    }
+
+    if (stbi_write_png(filename, textureWidth, textureHeight, 3, pixels.data(), textureWidth * 3)) {
+        std::cout << "Render saved to " << filename << std::endl;
+    } else {
+        std::cout << "Failed to save render" << std::endl;
+    }
+}
+
+// Writes the accumulated image bound on image unit 0 into its 8 bit display copy bound on unit 7, tone mapped
+void CopyToDisplay(ComputeShader &program, int width, int height, float exposure) {
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    program.use();
+    program.set("width", width);
+    program.set("height", height);
+    program.set("exposure", exposure);
+
+    glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+// Headless reference image: Raytracing --reference <scene> <spp> <image.pfm> [width height]
+// The scene is rendered on the CPU by the bidirectional path tracer from the default camera, without OpenGL context
+int RenderReference(int argc, char **argv) {
+    std::string scene = argv[2];
+    int spp = std::max(std::atoi(argv[3]), 1);
+    std::string filename = argv[4];
+    int width = argc >= 7 ? std::atoi(argv[5]) : 512;
+    int height = argc >= 7 ? std::atoi(argv[6]) : 512;
+    if (width <= 0 || height <= 0) {
+        std::cerr << "Invalid reference image size: " << width << "x" << height << std::endl;
+        return -1;
+    }
+
+    ObjectManager objManager;
+    objManager.loadMeshes();
+    objManager.loadScene(scene);
+    objManager.genAllTriangles();
+    // Converged image of the default render, whose paths are ended by the roulette at its cap
+    objManager.setMaxBounces(RenderSettings().rrMaxBounces);
+
+    ReferenceRenderer renderer(objManager, camera.getPos(), camera.getViewMat(), width, height);
+
+    // By slices of samples, to follow the progress
+    int done = 0;
+    while (done < spp) {
+        int samples = std::min(spp - done, 16);
+        renderer.render(samples);
+        done += samples;
+        std::cout << "[reference] " << done << "/" << spp << " spp" << std::endl;
+    }
+
+    if (!renderer.savePfm(filename)) return -1;
+    std::cout << "Reference saved to " << filename << std::endl;
+    return 0;
+}
+
 // Callback functions
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     width -= UIwidth;
@@ -109,10 +222,11 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         useRaytracing = !useRaytracing;
     } else if (key == GLFW_KEY_P && action == GLFW_PRESS) {
         SaveScreenshot("data/output/texture.png", SCR_WIDTH + UIwidth, SCR_HEIGHT);
+        saveRender = useRaytracing;
     }
 }
 
-GLuint genTexture(int width, int height) {
+GLuint genTexture(int width, int height, GLint internalFormat = GL_RGBA32F) {
     GLuint texture;
     glGenTextures(1, &texture);
     glActiveTexture(GL_TEXTURE0);
@@ -121,7 +235,58 @@ GLuint genTexture(int width, int height) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+
+    return texture;
+}
+
+// Loads the blue noise tiles written by tools/BlueNoiseGenerator (16 bit binary PGM, one tile per channel stacked vertically)
+// into a RGBA16UI texture holding the ranks, returns 0 on failure
+GLuint loadBlueNoiseTexture(const char *path) {
+    std::ifstream infile(path, std::ios::binary);
+    if (!infile) {
+        std::cerr << "Failed to open blue noise texture: " << path << std::endl;
+        return 0;
+    }
+
+    std::string magic;
+    int width, height, maxValue;
+    infile >> magic >> width >> height >> maxValue;
+    infile.get();
+
+    int channels = width > 0 ? height / width : 0;
+    if (magic != "P5" || maxValue < 256 || channels < 1 || channels > 4 || channels * width != height) {
+        std::cerr << "Invalid blue noise texture: " << path << std::endl;
+        return 0;
+    }
+
+    std::vector<unsigned char> bytes(width * height * 2);
+    if (!infile.read((char *)bytes.data(), bytes.size())) {
+        std::cerr << "Truncated blue noise texture: " << path << std::endl;
+        return 0;
+    }
+
+    // Missing channels reuse the first tiles, shifted to decorrelate them
+    std::vector<unsigned short> ranks(width * width * 4);
+    for (int c = 0; c < 4; c++) {
+        for (int y = 0; y < width; y++) {
+            for (int x = 0; x < width; x++) {
+                int src = (c % channels) * width * width + ((y + c / channels * width / 2) % width) * width + x;
+                ranks[(y * width + x) * 4 + c] = (bytes[2 * src] << 8) | bytes[2 * src + 1];
+            }
+        }
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, width, width, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, ranks.data());
+    glActiveTexture(GL_TEXTURE0);
 
     return texture;
 }
@@ -204,7 +369,111 @@ void beginRender(ShaderProgram &shaderProgram) {
     shaderProgram.set("lightColor", lightColor);
 }
 
-int main() {
+// Headless check of the CPU denoiser: Raytracing --check-denoiser <scene> [spp]
+// A small image of the scene is path traced in a hidden window and filtered by shaders/denoise_atrous.glsl and by
+// Denoiser::denoiseOnCpu, the two 8 bit images may only differ by one level (rounding of the GPU floats)
+int CheckDenoiser(int argc, char **argv) {
+    const int width = 256;
+    const int height = 256;
+    const int iterations = RenderSettings().denoiserIterations;
+    const float exposure = RenderSettings().exposure;
+    int spp = argc >= 4 ? std::max(std::atoi(argv[3]), 1) : 16;
+
+    initGLFW();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window = glfwCreateWindow(width, height, "Raytracing", nullptr, nullptr);
+    if (window == nullptr) {
+        std::cerr << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGL(glfwGetProcAddress)) {
+        std::cerr << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    int differing = 0;
+    int maxDifference = 0;
+    {
+        ObjectManager objManager;
+        objManager.loadMeshes();
+        objManager.loadScene(argv[2]);
+        objManager.genAllTriangles();
+        GLuint ssboTri = genTrianglesSSBO(objManager.getTriangles());
+
+        ComputeShader tracer("shaders/compute_shader.glsl");
+        GLuint texture = genTexture(width, height);
+        GLuint displayTexture = genTexture(width, height, GL_RGBA8);
+        AdaptiveSampler adaptiveSampler(width, height);
+        Denoiser denoiser(width, height);
+
+        auto setUniforms = [&](ShaderProgram &program) {
+            program.set("width", width);
+            program.set("height", height);
+            program.set("cameraPosition", camera.getPos());
+            program.set("viewMatrix", camera.getViewMat());
+            program.set("useNEE", 1);
+            program.set("useMIS", 1);
+            program.set("useRussianRoulette", 1);
+            program.set("rrMinDepth", RenderSettings().rrMinDepth);
+            program.set("samplerType", SAMPLER_SOBOL);
+            program.set("exposure", exposure);
+            objManager.setUniforms(program);
+        };
+
+        adaptiveSampler.bind();
+        glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindImageTexture(7, displayTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+        tracer.use();
+        setUniforms(tracer);
+        tracer.set("useTileList", 0);
+        tracer.set("frameCount", 0);
+        tracer.set("spp", spp);
+        tracer.set("maxBounces", RenderSettings().rrMaxBounces);
+        tracer.set("tileOffset", 0);
+        const int tileSize = AdaptiveSampler::tileSize;
+        glDispatchCompute(((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize), 1, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        denoiser.renderGuides(setUniforms);
+        denoiser.denoise(iterations, exposure);
+
+        std::vector<float> color = ReadTexture(texture, width, height);
+        std::vector<float> variance = ReadTexture(adaptiveSampler.getVarianceTexture(), width, height);
+        std::vector<float> albedo, normalDepth, denoised;
+        denoiser.readGuides(albedo, normalDepth);
+        Denoiser::denoiseOnCpu(width, height, color, variance, albedo, normalDepth, iterations, denoised);
+
+        std::vector<unsigned char> display(width * height * 4);
+        glBindTexture(GL_TEXTURE_2D, displayTexture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, display.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        for (int i = 0; i < width * height; i++) {
+            int difference = 0;
+            for (int c = 0; c < 3; c++) difference = std::max(difference, std::abs(ToDisplay(denoised[4 * i + c], exposure) - display[4 * i + c]));
+            if (difference > 0) differing++;
+            maxDifference = std::max(maxDifference, difference);
+        }
+
+        glDeleteTextures(1, &texture);
+        glDeleteTextures(1, &displayTexture);
+        glDeleteBuffers(1, &ssboTri);
+    }
+    glfwTerminate();
+
+    std::cout << "[denoiser] CPU and GPU outputs: " << differing << " of " << width * height
+              << " pixels differ, by at most " << maxDifference << " levels" << std::endl;
+    return maxDifference <= 1 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 5 && std::string(argv[1]) == "--reference") return RenderReference(argc, argv);
+    if (argc >= 3 && std::string(argv[1]) == "--check-denoiser") return CheckDenoiser(argc, argv);
+
     if (!init()) return -1;
 
     ///////////////////
@@ -234,9 +503,17 @@ int main() {
     std::shared_ptr<Mesh> quadMesh = Mesh::createQuad();
 
     ComputeShader computeShaderProgram("shaders/compute_shader.glsl");
-
-    GLuint texOutput1 = genTexture(textureWidth, textureHeight);
-    GLuint texOutput2 = genTexture(textureWidth, textureHeight);
+    ComputeShader persistentShaderProgram("shaders/compute_shader_persistent.glsl");
+    ComputeShader bdptShaderProgram("shaders/compute_shader_bdpt.glsl");
+
+    // Accumulated in place: with adaptive sampling the pixels of the skipped tiles must keep their value
+    GLuint texOutput = genTexture(textureWidth, textureHeight);
+    // 8 bit copy written by the kernels along with the accumulated image (shaders/display_image.glsl), read by the display pass
+    GLuint texDisplay = genTexture(textureWidth, textureHeight, GL_RGBA8);
+    ComputeShader displayCopyProgram("shaders/display_copy.glsl"); // rewrites it when no kernel does
+    AdaptiveSampler adaptiveSampler(textureWidth, textureHeight);
+    WavefrontRenderer wavefront;
+    PersistentScheduler persistentScheduler;
 
     ObjectManager objManager;
     objManager.loadMeshes();
@@ -245,9 +522,91 @@ int main() {
     objManager.genAllTriangles();
     GLuint ssboTri = genTrianglesSSBO(objManager.getTriangles());
 
-    UserInterface UI(window, UIwidth, scenePath, &objManager);
-
-    int frameCount = 0;
+    RenderSettings settings;
+
+    GLuint texBlueNoise = loadBlueNoiseTexture("data/bluenoise/bluenoise64.pgm");
+    if (texBlueNoise == 0 && settings.samplerType == SAMPLER_BLUE_NOISE) settings.samplerType = SAMPLER_SOBOL;
+
+    Benchmark benchmark(textureWidth, textureHeight);
+
+    // Metropolis chains, bootstrapped again by the first pass of every render
+    MetropolisRenderer metropolis(textureWidth, textureHeight);
+
+    // Irradiance probes of the preview, in world space: kept across camera moves, restarted around the edited objects
+    ProbeGrid probeGrid;
+
+    UserInterface UI(window, UIwidth, scenePath, &objManager, &settings, &benchmark, &metropolis, &probeGrid);
+
+    int frameCount = 0;  // passes over the image since the last reset
+    int sampleCount = 0; // per pixel, several samples can be computed by one pass
+    bool converged = false;
+    double renderStartTime = 0.0;
+
+    // A pass can be split over several frames to keep the GPU time of a frame under the target
+    // The image is accumulated in place, the tiles not rendered yet keep showing the previous pass
+    int tileCount = ((textureWidth + AdaptiveSampler::tileSize - 1) / AdaptiveSampler::tileSize) *
+                    ((textureHeight + AdaptiveSampler::tileSize - 1) / AdaptiveSampler::tileSize);
+    int passTile = 0;  // next tile of the current pass
+    int passTiles = 0; // tiles of the current pass
+    bool emptyPass = false; // every tile of the list converged, nothing to trace
+    int listMinSamples = -1; // parameters of the last tile list read back
+    float listThreshold = -1.0f;
+    bool useTileList = false;
+    GpuTimer gpuTimer;
+
+    // Dynamic resolution: while the camera moves, whole frames are rendered at a fraction of the resolution
+    // in texPreview and upscaled by the display pass, the full resolution image restarts once it stops
+    // Until its first pass is complete, the tiles not rendered yet still show the upscaled preview
+    const double interactionDelay = 0.15; // seconds without camera move before going back to full resolution
+    const int maxPreviewDivisor = 8;
+    GLuint texPreview = genTexture(textureWidth / 2, textureHeight / 2);
+    GLuint texPreviewVariance = genTexture(textureWidth / 2, textureHeight / 2, GL_RGBA32F); // keeps the full resolution one intact
+    GLuint texPreviewDisplay = genTexture(textureWidth / 2, textureHeight / 2, GL_RGBA8);
+    int previewWidth = 0;
+    int previewHeight = 0;
+    int previewFrameCount = 0; // accumulated while the camera holds still during the interaction
+    bool previewValid = false; // matches the current scene and camera
+    double lastMoveTime = -interactionDelay;
+
+    // Temporal reprojection: after a camera move the accumulated image is warped into the new view instead of
+    // restarting, once the camera holds still. historyCamera* is the camera of the accumulation
+    // The history is the last image rendered before the move, copied once: the frames rendered during the move
+    // (without dynamic resolution) start from scratch and are not warped again frame after frame
+    TemporalReprojection reprojection(textureWidth, textureHeight);
+    bool reprojectionPending = false; // a history is stored, waiting for the end of the move
+    glm::vec3 historyCameraPosition(0.0f);
+    glm::mat4 historyViewMatrix(1.0f);
+
+    // Guides rendered with the first hits of each new camera, the image is filtered again when it changes
+    Denoiser denoiser(textureWidth, textureHeight);
+    int denoisedIterations = 0; // iterations of the current denoiser output, 0 when outdated
+    float displayedExposure = settings.exposure;
+    GpuTimer denoiseTimer;      // one unit of work per denoised frame, its cost is taken out of the frame budget
+
+    // Hybrid mode: the triangles seen by the camera rays of a pass are rasterized once, at the pass start
+    GBuffer gbuffer(textureWidth, textureHeight);
+    glm::vec2 primaryJitter(0.5f);
+
+    // First hits of the camera rays, traced again only after a camera move or a scene change
+    PrimaryCache primaryCache(textureWidth, textureHeight);
+    bool primaryCacheValid = false;
+
+    // ReSTIR reservoirs of the last pass, kept across camera moves: the shaders only reuse the similar first vertices
+    LightReservoirs lightReservoirs(textureWidth, textureHeight);
+
+    // Incident radiance learned by the path guiding, in world space: kept across camera moves, cleared with the scene
+    GuidingTree guidingTree;
+    glm::vec3 sceneMin, sceneMax;
+    objManager.getBounds(sceneMin, sceneMax);
+    guidingTree.setBounds(sceneMin, sceneMax);
+    probeGrid.setBounds(sceneMin, sceneMax);
+
+    // Light tracing contributions of the bidirectional path tracer, in screen space: cleared with the camera and the scene
+    LightSplats lightSplats(textureWidth, textureHeight);
+
+    // Size of the image being traced, read by setRenderUniforms
+    int renderWidth = textureWidth;
+    int renderHeight = textureHeight;
 
     // Boucle de rendu
     while (!glfwWindowShouldClose(window)) {
@@ -258,15 +617,64 @@ int main() {
         if (UI.shouldResetTriBuff()) {
             objManager.genAllTriangles();
             ssboTri = resetTrianglesSSBO(ssboTri, objManager.getTriangles());
+            lightReservoirs.clear();
+            lightSplats.clear();
+            objManager.getBounds(sceneMin, sceneMax);
+            guidingTree.setBounds(sceneMin, sceneMax);
+            // Adding or deleting objects moves the grid, all the probes restart
+            glm::vec3 dirtyMin, dirtyMax;
+            bool allDirty;
+            objManager.takeDirtyBounds(dirtyMin, dirtyMax, allDirty);
+            probeGrid.setBounds(sceneMin, sceneMax);
             frameCount = 0;
+            passTile = 0;
+            previewFrameCount = 0;
+            previewValid = false;
+            reprojectionPending = false;
+            primaryCacheValid = false;
             UI.shouldReset();
         } else if (UI.shouldReset()) {
             frameCount = 0;
+            passTile = 0;
+            previewFrameCount = 0;
+            previewValid = false;
+            reprojectionPending = false;
+            primaryCacheValid = false;
             objManager.genAllTriangles(); // TODO: only update when model matrix is changed
             updateTrianglesSSBO(ssboTri, objManager.getTriangles());
+            lightReservoirs.clear();
+            lightSplats.clear();
+            objManager.getBounds(sceneMin, sceneMax);
+            guidingTree.setBounds(sceneMin, sceneMax);
+
+            glm::vec3 dirtyMin, dirtyMax;
+            bool allDirty;
+            if (objManager.takeDirtyBounds(dirtyMin, dirtyMax, allDirty)) {
+                if (allDirty) probeGrid.invalidateAll();
+                else probeGrid.invalidate(dirtyMin, dirtyMax);
+                // The edits are previewed like the camera moves, with the probes
+                if (settings.useProbeCache) lastMoveTime = glfwGetTime();
+            }
         }
 
-        if (camera.hasMoved()) frameCount = 0;
+        if (camera.hasMoved()) {
+            // A complete pass is needed to reproject, benchmarks always restart from scratch
+            // The Metropolis chains and their normalization only hold for the camera they were bootstrapped with
+            bool reprojectMove = settings.useReprojection && !benchmark.isRunning() && !settings.useMLT;
+            if (!reprojectMove) {
+                reprojectionPending = false;
+            } else if (!reprojectionPending && frameCount > 0) {
+                reprojection.storeHistory(texOutput, adaptiveSampler.getVarianceTexture());
+                reprojectionPending = true;
+            }
+            frameCount = 0;
+            lightSplats.clear();
+            passTile = 0;
+            previewFrameCount = 0;
+            previewValid = false;
+            primaryCacheValid = false;
+            lastMoveTime = glfwGetTime();
+        }
 
         if (!useRaytracing) {
             beginRender(shaderProgram);
@@ -275,96 +683,331 @@ int main() {
 
         } else {
 
-            computeShaderProgram.use();
+            adaptiveSampler.bind();
 
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, texBlueNoise);
             glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texOutput1);
-            computeShaderProgram.set("prevImage", 0);
-
-            glBindImageTexture(0, texOutput2, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-
-            computeShaderProgram.set("frameCount", frameCount);
-            computeShaderProgram.set("maxBounces", objManager.getMaxBounces());
-
-            computeShaderProgram.set("width", (int)textureWidth);
-            computeShaderProgram.set("height", (int)textureHeight);
-            computeShaderProgram.set("cameraPosition", camera.getPos());
-            computeShaderProgram.set("viewMatrix", camera.getViewMat());
-
-            std::vector<int> spheres = objManager.getObjectsPerMesh("Sphere");
-            for (int i = 0; i < spheres.size(); i++) {
-                computeShaderProgram.setArray("spheres", i, "pos", objManager.getObject(spheres[i]).getPos());
-                computeShaderProgram.setArray("spheres", i, "r", objManager.getObject(spheres[i]).getSize()[0]);
-                computeShaderProgram.setArray("spheres", i, "mat.color", objManager.getObject(spheres[i]).getColor());
-                computeShaderProgram.setArray("spheres", i, "mat.emissionColor", objManager.getObject(spheres[i]).getEmiColor());
-                computeShaderProgram.setArray("spheres", i, "mat.emissionStrength", objManager.getObject(spheres[i]).getEmissionStrength());
-                computeShaderProgram.setArray("spheres", i, "mat.smoothness", objManager.getObject(spheres[i]).getSmoothness());
-                computeShaderProgram.setArray("spheres", i, "mat.reflexivity", objManager.getObject(spheres[i]).getReflexivity());
-            }
 
-            computeShaderProgram.set("sphereCount", (int)spheres.size());
-
-            std::vector<int> tores = objManager.getObjectsPerMesh("Tore");
-            for (int i = 0; i < tores.size(); i++) {
-                computeShaderProgram.setArray("tores", i, "pos", objManager.getObject(tores[i]).getPos());
-                computeShaderProgram.setArray("tores", i, "R", objManager.getObject(tores[i]).getSize()[0]);
-                computeShaderProgram.setArray("tores", i, "r", 0.1f);
-                computeShaderProgram.setArray("tores", i, "mat.color", objManager.getObject(tores[i]).getColor());
-                computeShaderProgram.setArray("tores", i, "mat.emissionColor", objManager.getObject(tores[i]).getEmiColor());
-                computeShaderProgram.setArray("tores", i, "mat.emissionStrength", objManager.getObject(tores[i]).getEmissionStrength());
-                computeShaderProgram.setArray("tores", i, "mat.smoothness", objManager.getObject(tores[i]).getSmoothness());
-                computeShaderProgram.setArray("tores", i, "mat.reflexivity", objManager.getObject(tores[i]).getReflexivity());
+            bool interactive = settings.useDynamicResolution && glfwGetTime() - lastMoveTime < interactionDelay;
+
+            // The camera moves are previewed by the path tracer
+            bool metropolisMode = settings.useMLT && settings.pipeline == PIPELINE_MEGAKERNEL && !interactive;
+
+            // Scene, camera and integrator settings, shared by the megakernel and the wavefront kernels
+            // Roulette paths only stop at a high safety cap, without roulette the scene's bounce count applies
+            int maxBounces = settings.useRussianRoulette ? settings.rrMaxBounces : objManager.getMaxBounces();
+
+            auto setRenderUniforms = [&](ShaderProgram &program) {
+                program.set("width", renderWidth);
+                program.set("height", renderHeight);
+                program.set("cameraPosition", camera.getPos());
+                program.set("viewMatrix", camera.getViewMat());
+
+                program.set("useNEE", (int)settings.useNEE);
+                program.set("useMIS", (int)settings.useMIS);
+                program.set("useLightTree", (int)settings.useLightTree);
+                program.set("useRussianRoulette", (int)settings.useRussianRoulette);
+                program.set("rrMinDepth", settings.rrMinDepth);
+                program.set("samplerType", settings.samplerType);
+                program.set("blueNoise", 1);
+                program.set("useRasterPrimary", (int)settings.useRasterPrimary);
+                program.set("primaryJitter", primaryJitter);
+                program.set("usePrimaryCache", (int)(settings.usePrimaryCache && primaryCacheValid));
+                program.set("primaryCacheStrata", PrimaryCache::strata);
+                program.set("exposure", settings.exposure);
+
+                objManager.setUniforms(program);
+            };
+
+            // Adds spp samples to the tiles [firstTile, firstTile + tiles) of the image bound on image unit 0
+            // In Metropolis mode the tiles are the chain groups, the samples land on the image when the pass is resolved
+            auto traceTiles = [&](int firstTile, int tiles, bool tileList, int pass, int spp) {
+                // The cached first hits replace the rasterized ones
+                bool useCache = settings.usePrimaryCache && primaryCacheValid;
+                if (useCache) primaryCache.bind();
+
+                // All the samples of the pass start from the same rasterized positions, the jitter changes with the pass
+                if (settings.useRasterPrimary && !useCache && !metropolisMode && firstTile == 0) {
+                    primaryJitter = GBuffer::getJitter(pass);
+                    gbuffer.render(objManager, camera.getPos(), camera.getViewMat(), renderWidth, renderHeight, primaryJitter);
+                }
+
+                gpuTimer.begin();
+
+                if (settings.pipeline == PIPELINE_WAVEFRONT) {
+                    wavefront.render(firstTile, tiles, tileList, pass == 0, spp, maxBounces,
+                                     settings.sortRays, setRenderUniforms);
+                } else if (metropolisMode) {
+                    metropolis.render(firstTile, tiles, pass, spp, maxBounces, setRenderUniforms);
+                } else {
+                    // The paths of the guiding training passes are recorded by tracePath, which persistent threads do not use
+                    bool recordGuiding = settings.usePathGuiding && guidingTree.isTraining();
+                    bool usePersistent = settings.usePersistentThreads && !recordGuiding && !settings.useBDPT;
+                    ComputeShader &tracer = settings.useBDPT ? bdptShaderProgram : (usePersistent ? persistentShaderProgram : computeShaderProgram);
+                    tracer.use();
+
+                    tracer.set("useTileList", (int)tileList);
+
+                    tracer.set("frameCount", pass);
+                    tracer.set("spp", spp);
+                    tracer.set("maxBounces", maxBounces);
+
+                    setRenderUniforms(tracer);
+
+                    tracer.set("useReSTIR", (int)settings.useReSTIR);
+                    tracer.set("restirCandidates", settings.restirCandidates);
+                    if (settings.useReSTIR) lightReservoirs.bind(tracer, renderWidth, renderHeight);
+                    guidingTree.bind(tracer, settings.usePathGuiding);
+                    probeGrid.bind(tracer, settings.useProbeCache && interactive && !settings.useBDPT);
+                    if (settings.useBDPT) lightSplats.bind(tracer, renderWidth, renderHeight);
+
+                    // Launch compute shader, one work group per tile
+                    const int tilePixels = AdaptiveSampler::tileSize * AdaptiveSampler::tileSize;
+                    if (usePersistent) {
+                        int itemEnd = (firstTile + tiles) * tilePixels;
+                        tracer.set("workItemEnd", itemEnd);
+                        persistentScheduler.dispatch(firstTile * tilePixels, itemEnd, settings.persistentWorkGroups);
+                    } else {
+                        tracer.set("tileOffset", firstTile);
+                        glDispatchCompute(tiles, 1, 1);
+                    }
+                }
+
+                gpuTimer.end(tiles * spp);
+
+                // Wait for the compute shader to stop
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+            };
+
+            auto countTiles = [](int width, int height) {
+                return ((width + AdaptiveSampler::tileSize - 1) / AdaptiveSampler::tileSize) *
+                       ((height + AdaptiveSampler::tileSize - 1) / AdaptiveSampler::tileSize);
+            };
+
+            // A few probes are traced every frame until the grid is complete, before the image so that it uses them
+            if (settings.useProbeCache && settings.pipeline == PIPELINE_MEGAKERNEL && !settings.useBDPT) {
+                probeGrid.update(maxBounces, setRenderUniforms);
             }
 
-            computeShaderProgram.set("toreCount", (int)tores.size());
-
-            std::vector<TriangleMeshInfo> trianglesInfo = objManager.getTriangleToObject();
-            for (int i = 0; i < trianglesInfo.size(); i++) {
-
-                computeShaderProgram.setArray("triangleMeshes", i, "startIdx", trianglesInfo[i].startIdx);
-                computeShaderProgram.setArray("triangleMeshes", i, "endIdx", trianglesInfo[i].endIdx);
-                computeShaderProgram.setArray("triangleMeshes", i, "mat.color", objManager.getObject(trianglesInfo[i].matIdx).getColor());
-                computeShaderProgram.setArray("triangleMeshes", i, "mat.emissionColor", objManager.getObject(trianglesInfo[i].matIdx).getEmiColor());
-                computeShaderProgram.setArray("triangleMeshes", i, "mat.emissionStrength", objManager.getObject(trianglesInfo[i].matIdx).getEmissionStrength());
-                computeShaderProgram.setArray("triangleMeshes", i, "mat.smoothness", objManager.getObject(trianglesInfo[i].matIdx).getSmoothness());
-                computeShaderProgram.setArray("triangleMeshes", i, "mat.reflexivity", objManager.getObject(trianglesInfo[i].matIdx).getReflexivity());
+            if (interactive) {
+                // Smallest divisor whose whole image fits in the target at one sample per pixel, picked when the camera moves
+                if (previewFrameCount == 0) {
+                    double tileTime = gpuTimer.getTileSampleTime();
+                    int divisor = tileTime > 0.0 ? 2 : 4;
+                    while (divisor < maxPreviewDivisor && countTiles(textureWidth / divisor, textureHeight / divisor) * tileTime > settings.targetFrameTime) {
+                        divisor++;
+                    }
+                    settings.resolutionDivisor = divisor;
+                    previewWidth = textureWidth / divisor;
+                    previewHeight = textureHeight / divisor;
+                }
+
+                renderWidth = previewWidth;
+                renderHeight = previewHeight;
+                glBindImageTexture(0, texPreview, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+                glBindImageTexture(2, texPreviewVariance, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+                glBindImageTexture(7, texPreviewDisplay, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+                traceTiles(0, countTiles(previewWidth, previewHeight), false, previewFrameCount, 1);
+                lightReservoirs.endPass(previewWidth, previewHeight);
+                lightSplats.endPass(previewWidth, previewHeight);
+
+                previewFrameCount++;
+                previewValid = true;
+                converged = false;
+            } else {
+                settings.resolutionDivisor = 1;
+                renderWidth = textureWidth;
+                renderHeight = textureHeight;
+                glBindImageTexture(0, texOutput, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+                glBindImageTexture(7, texDisplay, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+                if (reprojectionPending && glfwGetTime() - lastMoveTime >= interactionDelay) {
+                    reprojection.reproject(historyCameraPosition, historyViewMatrix, setRenderUniforms);
+                    reprojectionPending = false;
+
+                    // The reprojected pixels keep their samples, the adaptive tile list sends the new ones to the disocclusions
+                    // The samples rendered from scratch during the move are replaced, the next pass accumulates
+                    frameCount = 1;
+                    passTile = 0;
+                    historyCameraPosition = camera.getPos();
+                    historyViewMatrix = camera.getViewMat();
+                    renderStartTime = glfwGetTime();
+                    sampleCount = 0;
+                    adaptiveSampler.restart();
+                    denoiser.renderGuides(setRenderUniforms);
+                    denoisedIterations = 0;
+                } else if (frameCount == 0 && passTile == 0) {
+                    // The first hits of the stored history are kept until it is reprojected
+                    if (!reprojectionPending) {
+                        reprojection.storeFirstHits(setRenderUniforms);
+                        historyCameraPosition = camera.getPos();
+                        historyViewMatrix = camera.getViewMat();
+                    }
+                    denoiser.renderGuides(setRenderUniforms);
+                }
+
+                // The preview frames of the camera moves never use the cache
+                if (settings.usePrimaryCache && !primaryCacheValid) {
+                    primaryCache.build(setRenderUniforms);
+                    primaryCacheValid = true;
+                }
+
+                // The image changes on every frame while accumulating, so the denoiser runs on every frame too:
+                // its GPU time comes out of the budget of the path tracer, which keeps at least a quarter of it
+                int iterations = settings.useDenoiser ? settings.denoiserIterations : 0;
+                float traceBudget = settings.targetFrameTime;
+                if (iterations > 0) {
+                    traceBudget = std::max(traceBudget - (float)denoiseTimer.getTileSampleTime(), 0.25f * settings.targetFrameTime);
+                }
+
+                // Tile list, convergence and samples per pixel are set once per pass
+                if (passTile == 0) {
+                    // The first pass after a reset covers the whole image, and every pass of the bidirectional path tracer
+                    // since its light subpaths start from every pixel, and of the Metropolis chains which reach any pixel
+                    bool bidirectional = settings.useBDPT && settings.pipeline == PIPELINE_MEGAKERNEL;
+                    useTileList = settings.useAdaptiveSampling && frameCount > 0 && !bidirectional && !metropolisMode;
+                    bool checkConvergence = settings.useAutoStop && frameCount > 0;
+                    if (useTileList || checkConvergence) adaptiveSampler.buildTileList(settings.adaptiveMinSamples, settings.adaptiveThreshold);
+
+                    if (frameCount == 0) {
+                        adaptiveSampler.restart();
+                        benchmark.restart();
+                        renderStartTime = glfwGetTime();
+                        sampleCount = 0;
+                    }
+
+                    // The count is one pass late while rendering, the tiles listed past it wait for the next pass
+                    // A wake up, or a new threshold or minimum (which can list many more tiles), waits for the list it
+                    // just built
+                    bool wasConverged = converged;
+                    bool listChanged = settings.adaptiveMinSamples != listMinSamples || settings.adaptiveThreshold != listThreshold;
+                    int activeTiles = tileCount;
+                    if (useTileList || checkConvergence) {
+                        activeTiles = adaptiveSampler.getActiveTiles(wasConverged || listChanged);
+                        listMinSamples = settings.adaptiveMinSamples;
+                        listThreshold = settings.adaptiveThreshold;
+                    }
+
+                    // Converged when every tile is under the error threshold or the samples target is reached
+                    // Checked on every wake up, a lower threshold or a higher target resumes the render
+                    converged = false;
+                    if (checkConvergence && !benchmark.isRunning()) {
+                        converged = sampleCount >= settings.autoStopSamples || activeTiles == 0;
+                    }
+
+                    if (converged && !wasConverged) {
+                        std::cout << "[render] converged: spp=" << sampleCount << " time=" << glfwGetTime() - renderStartTime << "s" << std::endl;
+                        if (metropolisMode) {
+                            std::cout << "[mlt] acceptance: small=" << metropolis.getSmallStepAcceptance()
+                                      << " large=" << metropolis.getLargeStepAcceptance() << std::endl;
+                        }
+                    }
+
+                    passTiles = metropolisMode ? MetropolisRenderer::chainGroups : (useTileList ? activeTiles : tileCount);
+
+                    // Without auto-stop the tile list can also end up empty: nothing to trace, the loop sleeps like after
+                    // a convergence (benchmarks keep their clock running instead)
+                    emptyPass = passTiles == 0;
+                    if (emptyPass && !benchmark.isRunning()) converged = true;
+
+                    // Several samples per pixel when the whole pass fits in the target, from the GPU time of the last frames
+                    if (settings.autoSpp) {
+                        int work = gpuTimer.getWorkForBudget(traceBudget);
+                        settings.spp = glm::clamp(work / std::max(passTiles, 1), 1, 256);
+                    }
+                }
+
+                if (emptyPass && !converged) {
+                    // No pass is counted, the samples per pixel and the benchmark only follow the traced tiles
+                    benchmark.update(texOutput, sampleCount);
+                } else if (!converged) {
+                    // Tiles of this frame: the rest of the pass, or as many as fit in the target
+                    int tiles = passTiles - passTile;
+                    if (settings.autoSpp) {
+                        int work = gpuTimer.getWorkForBudget(traceBudget);
+                        tiles = std::min(tiles, std::max(work / settings.spp, 1));
+                    }
+
+                    traceTiles(passTile, tiles, useTileList, frameCount, settings.spp);
+                    denoisedIterations = 0;
+
+                    passTile += tiles;
+                    if (passTile >= passTiles) {
+                        passTile = 0;
+                        if (metropolisMode) metropolis.resolve(frameCount, settings.spp, setRenderUniforms);
+                        frameCount++;
+                        sampleCount = metropolisMode ? (int)metropolis.getMutationsPerPixel() : sampleCount + settings.spp;
+                        lightReservoirs.endPass(textureWidth, textureHeight);
+                        lightSplats.endPass(textureWidth, textureHeight);
+                        if (settings.usePathGuiding && settings.pipeline == PIPELINE_MEGAKERNEL && !settings.useBDPT && !metropolisMode) guidingTree.endPass();
+
+                        benchmark.update(texOutput, sampleCount);
+                    }
+                }
+
+                // Only when the image or the settings changed, a converged render is filtered once
+                // The filtered image replaces the display copy, which is restored when the denoiser is turned off
+                // A new exposure maps the image again, -1 outdates the display copy written by the kernels too
+                if (settings.exposure != displayedExposure) {
+                    displayedExposure = settings.exposure;
+                    denoisedIterations = -1;
+                }
+                if (iterations > 0 && iterations != denoisedIterations) {
+                    denoiseTimer.begin();
+                    denoiser.denoise(iterations, settings.exposure);
+                    denoiseTimer.end(1);
+                }
+                if (iterations == 0 && denoisedIterations != 0) CopyToDisplay(displayCopyProgram, textureWidth, textureHeight, settings.exposure);
+                denoisedIterations = iterations;
+
+                if (saveRender) {
+                    SaveRender("data/output/render.png", texOutput, adaptiveSampler.getVarianceTexture(), denoiser, iterations, settings.exposure);
+                    saveRender = false;
+                }
             }
 
-            computeShaderProgram.set("triangleMeshCount", (int)trianglesInfo.size());
-
-            // Launch compute shader
-            glDispatchCompute(textureWidth / 16, textureHeight / 16, 1);
-
-            // Wait for the compute shader to stop
-            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-
             RTshaderProgram.use();
 
             glBindVertexArray(quadMesh->getVAO());
 
+            // Tiles of the first full resolution pass not rendered yet and pixels left empty by the reprojection show the preview
+            RTshaderProgram.set("fullResTiles", previewValid && frameCount == 0 ? passTile : tileCount);
+            RTshaderProgram.set("previewValid", (int)previewValid);
+            RTshaderProgram.set("previewWidth", previewWidth);
+            RTshaderProgram.set("previewHeight", previewHeight);
+
+            RTshaderProgram.set("previewImage", 2);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, texPreviewDisplay);
+
             RTshaderProgram.set("renderedImage", 0);
             glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texOutput1);
+            glBindTexture(GL_TEXTURE_2D, texDisplay);
 
             glDrawElements(GL_TRIANGLES, quadMesh->getIndexCount(), GL_UNSIGNED_INT, 0);
             glBindVertexArray(0);
-
-            std::swap(texOutput1, texOutput2);
-            frameCount++;
         }
 
         UI.render();
 
         glfwSwapBuffers(window);
-        glfwPollEvents();
+
+        // Nothing left to render: sleep until an input or window event (camera, UI) wakes the loop up
+        if (useRaytracing && converged) glfwWaitEvents();
+        else glfwPollEvents();
     }
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
-    glDeleteTextures(1, &texOutput1);
-    glDeleteTextures(1, &texOutput2);
+    glDeleteTextures(1, &texOutput);
+    glDeleteTextures(1, &texPreview);
+    glDeleteTextures(1, &texPreviewVariance);
+    glDeleteTextures(1, &texDisplay);
+    glDeleteTextures(1, &texPreviewDisplay);
+    glDeleteTextures(1, &texBlueNoise);
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -0,0 +1,149 @@
+// Generates the tileable blue noise texture used by the blue noise sampler (shaders/sampler.glsl)
+// Void-and-cluster method, "The void-and-cluster method for dither array generation" (Ulichney 1993)
+//
+// Usage: BlueNoiseGenerator [size] [channels] [output]
+// Output: 16 bit binary PGM, one size x size tile per channel stacked vertically,
+// each pixel holding its rank in [0, size * size - 1]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+class VoidAndCluster {
+public:
+    VoidAndCluster(int size, float sigma, unsigned int seed)
+        : size(size), kernel(size * size), energy(size * size, 0.0f), pattern(size * size, false), rng(seed) {
+
+        // Gaussian of the toroidal distance, so that the tile repeats without seams
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                int dx = std::min(x, size - x);
+                int dy = std::min(y, size - y);
+                kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+            }
+        }
+    }
+
+    std::vector<int> generate() {
+        int count = size * size;
+        std::vector<int> rank(count);
+
+        // Initial binary pattern: 10% of random pixels
+        std::uniform_int_distribution<int> pick(0, count - 1);
+        int ones = 0;
+        while (ones < count / 10) {
+            int idx = pick(rng);
+            if (pattern[idx]) continue;
+            toggle(idx, true);
+            ones++;
+        }
+
+        // Move the pixel of the tightest cluster to the largest void until it does not move anymore
+        while (true) {
+            int cluster = tightestCluster();
+            toggle(cluster, false);
+            int empty = largestVoid();
+            toggle(empty, true);
+            if (empty == cluster) break;
+        }
+
+        std::vector<bool> prototype = pattern;
+        std::vector<float> prototypeEnergy = energy;
+
+        // Phase 1: rank the pixels of the pattern, removing the tightest cluster first
+        for (int r = ones - 1; r >= 0; r--) {
+            int cluster = tightestCluster();
+            toggle(cluster, false);
+            rank[cluster] = r;
+        }
+
+        pattern = prototype;
+        energy = prototypeEnergy;
+
+        // Phase 2 and 3: fill the largest void until the tile is full
+        for (int r = ones; r < count; r++) {
+            int empty = largestVoid();
+            toggle(empty, true);
+            rank[empty] = r;
+        }
+
+        return rank;
+    }
+
+private:
+    void toggle(int idx, bool value) {
+        pattern[idx] = value;
+        float sign = value ? 1.0f : -1.0f;
+        int px = idx % size;
+        int py = idx / size;
+        for (int y = 0; y < size; y++) {
+            int ky = (y - py + size) % size;
+            for (int x = 0; x < size; x++) {
+                int kx = (x - px + size) % size;
+                energy[y * size + x] += sign * kernel[ky * size + kx];
+            }
+        }
+    }
+
+    int tightestCluster() const {
+        int best = -1;
+        for (int i = 0; i < (int)energy.size(); i++) {
+            if (pattern[i] && (best < 0 || energy[i] > energy[best])) best = i;
+        }
+        return best;
+    }
+
+    int largestVoid() const {
+        int best = -1;
+        for (int i = 0; i < (int)energy.size(); i++) {
+            if (!pattern[i] && (best < 0 || energy[i] < energy[best])) best = i;
+        }
+        return best;
+    }
+
+    int size;
+    std::vector<float> kernel;
+    std::vector<float> energy;
+    std::vector<bool> pattern;
+    std::mt19937 rng;
+};
+
+int main(int argc, char **argv) {
+    int size = argc > 1 ? std::atoi(argv[1]) : 64;
+    int channels = argc > 2 ? std::atoi(argv[2]) : 4;
+    std::string output = argc > 3 ? argv[3] : "data/bluenoise/bluenoise64.pgm";
+
+    if (size <= 0 || size > 256 || channels <= 0 || channels > 4) {
+        std::cerr << "Usage: BlueNoiseGenerator [size <= 256] [channels <= 4] [output]" << std::endl;
+        return 1;
+    }
+
+    std::ofstream outfile(output, std::ios::binary);
+    if (!outfile.is_open()) {
+        std::cerr << "Failed to open " << output << std::endl;
+        return 1;
+    }
+
+    outfile << "P5\n"
+            << size << " " << size * channels << "\n"
+            << size * size - 1 << "\n";
+
+    for (int c = 0; c < channels; c++) {
+        // Each channel is an independent tile
+        std::vector<int> rank = VoidAndCluster(size, 1.5f, 1234 + c).generate();
+        for (int r : rank) {
+            // PGM stores 16 bit values in big endian
+            outfile.put((char)(r >> 8));
+            outfile.put((char)(r & 0xff));
+        }
+        std::cout << "Channel " << c + 1 << "/" << channels << " done" << std::endl;
+    }
+
+    std::cout << "Blue noise saved to " << output << std::endl;
+    return 0;
+}